@@ -0,0 +1,889 @@
+/*
+ *  Wavefront Alignments Algorithms
+ *  Copyright (c) 2024 by Diego García Aranda <diego.garcia1@bsc.es>
+ *
+ *  This file is part of Wavefront Alignments Algorithms.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * PROJECT: Wavefront Alignments Algorithms
+ * AUTHOR(S): Diego García Aranda <diego.garcia1@bsc.es>
+ */
+
+/*
+ * Edit distance aligner of the CPU
+ *   Wavefronts, offsets arena and kernels (wfa_edit_core.h) and the library
+ *   API on top of them (wfa_edit.h). Only those entry points are exported.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#include <x86intrin.h>
+#endif
+
+#include "wfa_edit_common.h"
+#include "wfa_edit_core.h"
+#include "wfa_edit.h"
+
+static double wall_time () {
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC,&ts);
+   return (double) (ts.tv_sec) + (double) ts.tv_nsec * 1.0e-9;
+}
+
+/*
+ * Translate k and offset to coordinates h,v
+ */
+#define EWAVEFRONT_V(k,offset) ((offset)-(k))
+#define EWAVEFRONT_H(k,offset) (offset)
+
+#define EWAVEFRONT_DIAGONAL(h,v) ((h)-(v))
+#define EWAVEFRONT_OFFSET(h,v)   (h)
+
+#define ARENA_SLAB_MIN_LENGTH (1<<17) // Bytes
+#define ARENA_ALIGNMENT 8 // Slices start at multiples of it (bytes)
+
+#define WAVEFRONT_PADDING 2 // Sentinel offsets on each side of a wavefront (lo-2,lo-1,hi+1,hi+2)
+
+#define ROLLING_INIT_MAX_DISTANCE 64
+#define ROLLING_CENTER(max_distance) ((max_distance)+WAVEFRONT_PADDING)
+#define ROLLING_LENGTH(max_distance) (2*ROLLING_CENTER(max_distance)+1)
+
+#define BIWFA_BASE_SCORE 64 // Sub-problems up to this score use regular WFA (must be >= 1)
+#define EWF_OFFSET_MAX_SIZE sizeof(ewf_offset32_t)
+
+#define LIBRARY_INIT_LENGTH 128 // Pair length an aligner is initialized for (grown on demand)
+
+/*
+ * Hot-path Statistics counters and timers (the hooks expand to nothing without EWF_STATS)
+ */
+#ifdef EWF_STATS
+// Time stamp counter (nanoseconds where there is none)
+static uint64_t ewf_stats_cycles() {
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC,&ts);
+  return (uint64_t)ts.tv_sec*1000000000ull + ts.tv_nsec;
+#endif
+}
+
+static void ewf_stats_wavefront(
+    ewf_stats_t* const stats,
+    const int wavefront_length) {
+  stats->cells += wavefront_length;
+  ++(stats->wavefronts);
+  stats->max_wavefront_length = MAX(stats->max_wavefront_length,wavefront_length);
+}
+
+void wfa_edit_stats_merge(
+    ewf_stats_t* const stats,
+    const ewf_stats_t* const task_stats) {
+  stats->cells += task_stats->cells;
+  stats->wavefronts += task_stats->wavefronts;
+  stats->max_wavefront_length = MAX(stats->max_wavefront_length,task_stats->max_wavefront_length);
+  stats->extend_chars += task_stats->extend_chars;
+  stats->backtrace_steps += task_stats->backtrace_steps;
+  stats->extend_cycles += task_stats->extend_cycles;
+  stats->compute_cycles += task_stats->compute_cycles;
+  stats->reduce_cycles += task_stats->reduce_cycles;
+  stats->backtrace_cycles += task_stats->backtrace_cycles;
+}
+
+/*
+ * Print the statistics of a repetition (and append them as a JSON line to stats_file)
+ */
+void wfa_edit_stats_report(
+    const ewf_stats_t* const stats,
+    const int repetition,
+    const int num_alignments,
+    FILE* const stats_file) {
+  const uint64_t total_cycles = MAX(stats->extend_cycles+stats->compute_cycles+stats->reduce_cycles+stats->backtrace_cycles,1);
+  PRINTF("Stats wavefronts: %ld, cells %ld, average length %.2f, max length %d\n",
+      stats->wavefronts,stats->cells,(double)stats->cells/MAX(stats->wavefronts,1),stats->max_wavefront_length);
+  PRINTF("Stats extend: %ld characters compared, %" PRIu64 " cycles (%.2f%%)\n",
+      stats->extend_chars,stats->extend_cycles,100.0*stats->extend_cycles/total_cycles);
+  PRINTF("Stats compute: %.2f cycles/cell, %" PRIu64 " cycles (%.2f%%)\n",
+      (double)stats->compute_cycles/MAX(stats->cells,1),stats->compute_cycles,100.0*stats->compute_cycles/total_cycles);
+  PRINTF("Stats reduce: %" PRIu64 " cycles (%.2f%%)\n",
+      stats->reduce_cycles,100.0*stats->reduce_cycles/total_cycles);
+  PRINTF("Stats backtrace: %ld steps, %" PRIu64 " cycles (%.2f%%)\n",
+      stats->backtrace_steps,stats->backtrace_cycles,100.0*stats->backtrace_cycles/total_cycles);
+  if (stats_file == NULL) return;
+  fprintf(stats_file,"{\"repetition\": %d, \"alignments\": %d, \"wavefronts\": %ld, \"cells\": %ld, "
+      "\"max_wavefront_length\": %d, \"extend_chars\": %ld, \"backtrace_steps\": %ld, "
+      "\"extend_cycles\": %" PRIu64 ", \"compute_cycles\": %" PRIu64 ", \"reduce_cycles\": %" PRIu64 ", \"backtrace_cycles\": %" PRIu64 "}\n",
+      repetition,num_alignments,stats->wavefronts,stats->cells,
+      stats->max_wavefront_length,stats->extend_chars,stats->backtrace_steps,
+      stats->extend_cycles,stats->compute_cycles,stats->reduce_cycles,stats->backtrace_cycles);
+}
+
+#define EWF_STATS_TIMER_START(timer) const uint64_t timer = ewf_stats_cycles()
+#define EWF_STATS_TIMER_STOP(wavefronts,phase,timer) ((wavefronts)->stats.phase##_cycles += ewf_stats_cycles()-(timer))
+#define EWF_STATS_ADD(wavefronts,counter,value) ((wavefronts)->stats.counter += (value))
+#define EWF_STATS_WAVEFRONT(wavefronts,length) ewf_stats_wavefront(&(wavefronts)->stats,(length))
+#else
+#define EWF_STATS_TIMER_START(timer)
+#define EWF_STATS_TIMER_STOP(wavefronts,phase,timer)
+#define EWF_STATS_ADD(wavefronts,counter,value)
+#define EWF_STATS_WAVEFRONT(wavefronts,length)
+#endif
+
+
+static void ewf_arena_init(
+    ewf_arena_t* const arena) {
+  arena->num_slabs = 0;
+  arena->current_slab = 0;
+  arena->used = 0;
+}
+
+
+/*
+ * Release all slices at once (slabs are kept for the next alignment)
+ */
+static void ewf_arena_reset(
+    ewf_arena_t* const arena) {
+  arena->current_slab = 0;
+  arena->used = 0;
+}
+
+
+static void ewf_arena_free(
+    ewf_arena_t* const arena) {
+  int i;
+  for (i=0;i<arena->num_slabs;++i) {
+    free(arena->slabs[i]);
+  }
+  arena->num_slabs = 0;
+}
+
+
+/*
+ * Allocate a contiguous slice of offsets (not initialized)
+ */
+static void* ewf_arena_allocate(
+    ewf_arena_t* const arena,
+    const size_t size) {
+  const size_t length = (size + ARENA_ALIGNMENT - 1) & ~(size_t)(ARENA_ALIGNMENT - 1); // Bytes
+  // Move to the next slab if the slice does not fit
+  while (arena->current_slab < arena->num_slabs &&
+         arena->used + length > arena->slabs_length[arena->current_slab]) {
+    ++(arena->current_slab);
+    arena->used = 0;
+  }
+  // Allocate a new slab (doubling the last one)
+  if (arena->current_slab == arena->num_slabs) {
+    if (arena->num_slabs == ARENA_MAX_SLABS) {
+      PRINTF_ERROR("Offsets arena is full\n");
+      return NULL;
+    }
+    const size_t last_length = (arena->num_slabs > 0) ? arena->slabs_length[arena->num_slabs-1] : 0;
+    const size_t slab_length = MAX(MAX(length,2*last_length),ARENA_SLAB_MIN_LENGTH);
+    void* const slab = malloc(slab_length);
+    if (slab == NULL) {
+      PRINTF_ERROR("Allocation of offsets arena slab failed\n");
+      return NULL;
+    }
+    arena->slabs[arena->num_slabs] = slab;
+    arena->slabs_length[arena->num_slabs] = slab_length;
+    ++(arena->num_slabs);
+  }
+  // Hand out the slice
+  void* const slice = (char*)arena->slabs[arena->current_slab] + arena->used;
+  arena->used += length;
+  return slice;
+}
+
+
+/*
+ * Allocate a slice of the offsets arena of the wavefronts (flagging failures)
+ */
+static void* edit_wavefronts_allocate(
+    edit_wavefronts_t* const wavefronts,
+    const size_t size) {
+  void* const slice = ewf_arena_allocate(&wavefronts->arena,size);
+  wavefronts->allocation_failed |= (slice == NULL);
+  return slice;
+}
+
+
+/*
+ * Allocate wavefronts for pairs up to these lengths
+ *   On failure, the buffers allocated are released by wfa_edit_wavefronts_free
+ */
+int wfa_edit_wavefronts_init(
+    edit_wavefronts_t* const wavefronts,
+    const int pattern_length,
+    const int text_length,
+    const int max_score,
+    const ewf_reduction_t reduction,
+    const bool filter) {
+  // Dimensions
+  wavefronts->pattern_length = pattern_length;
+  wavefronts->text_length = text_length;
+  wavefronts->max_score = max_score;
+  wavefronts->max_distance = MIN(pattern_length+text_length,max_score);
+  wavefronts->max_cigar_length = edit_wavefronts_max_cigar_length(pattern_length,text_length,max_score);
+  // Allocate wavefronts
+  wavefronts->wavefronts = calloc(wavefronts->max_distance+1,sizeof(edit_wavefront_t));
+  ewf_arena_init(&wavefronts->arena);
+  wavefronts->packed = NULL;
+  wavefronts->lanes = NULL;
+  wavefronts->reduction = reduction;
+  wavefronts->filter = filter;
+  wavefronts->num_pairs_filtered = 0;
+  wavefronts->num_pairs_lanes = 0;
+  // Allocate rolling wavefronts (grown on demand)
+  int i;
+  wavefronts->rolling_max_distance = ROLLING_INIT_MAX_DISTANCE;
+  for (i=0;i<ROLLING_WAVEFRONTS;++i) {
+    wavefronts->rolling_mem[i] = malloc(ROLLING_LENGTH(ROLLING_INIT_MAX_DISTANCE)*EWF_OFFSET_MAX_SIZE);
+  }
+  for (i=0;i<EWF_OFFSET_WIDTHS;++i) {
+    wavefronts->num_pairs_width[i] = 0;
+  }
+#ifdef EWF_STATS
+  memset(&wavefronts->stats,0,sizeof(ewf_stats_t));
+#endif
+  // Allocate CIGAR
+  wavefronts->edit_cigar = malloc(wavefronts->max_cigar_length);
+  wavefronts->allocation_failed = false;
+  wavefronts->num_pairs_failed = 0;
+  bool allocated = (wavefronts->wavefronts != NULL && wavefronts->edit_cigar != NULL);
+  for (i=0;i<ROLLING_WAVEFRONTS;++i) {
+    allocated &= (wavefronts->rolling_mem[i] != NULL);
+  }
+  if (!allocated) {
+    PRINTF_ERROR("Allocation of wavefronts failed\n");
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
+
+
+static void edit_wavefronts_clean(
+    edit_wavefronts_t* const wavefronts) {
+  ewf_arena_reset(&wavefronts->arena);
+}
+
+
+void wfa_edit_wavefronts_free(
+    edit_wavefronts_t* const wavefronts) {
+  ewf_arena_free(&wavefronts->arena);
+  free(wavefronts->wavefronts);
+  int i;
+  for (i=0;i<ROLLING_WAVEFRONTS;++i) {
+    free(wavefronts->rolling_mem[i]);
+  }
+  free(wavefronts->edit_cigar);
+}
+
+
+/*
+ * Fit the wavefronts to a pair (current buffers are kept if the allocation fails)
+ */
+static int edit_wavefronts_resize(
+    edit_wavefronts_t* const wavefronts,
+    const int pattern_length,
+    const int text_length) {
+  // Keep current buffers if the pair fits
+  const int max_distance = MIN(pattern_length+text_length,wavefronts->max_score);
+  const int max_cigar_length = edit_wavefronts_max_cigar_length(pattern_length,text_length,wavefronts->max_score);
+  if (max_distance <= wavefronts->max_distance && max_cigar_length <= wavefronts->max_cigar_length) return EXIT_SUCCESS;
+  // Reallocate for the new dimensions (offsets arena and rolling wavefronts are kept)
+  if (max_distance > wavefronts->max_distance) {
+    edit_wavefront_t* const wavefronts_mem = calloc(max_distance+1,sizeof(edit_wavefront_t));
+    if (wavefronts_mem == NULL) {
+      PRINTF_ERROR("Allocation of wavefronts failed\n");
+      return EXIT_FAILURE;
+    }
+    free(wavefronts->wavefronts);
+    wavefronts->wavefronts = wavefronts_mem;
+    wavefronts->max_distance = max_distance;
+  }
+  if (max_cigar_length > wavefronts->max_cigar_length) {
+    char* const edit_cigar = malloc(max_cigar_length);
+    if (edit_cigar == NULL) {
+      PRINTF_ERROR("Allocation of CIGAR failed\n");
+      return EXIT_FAILURE;
+    }
+    free(wavefronts->edit_cigar);
+    wavefronts->edit_cigar = edit_cigar;
+    wavefronts->max_cigar_length = max_cigar_length;
+  }
+  wavefronts->pattern_length = pattern_length;
+  wavefronts->text_length = text_length;
+  edit_wavefronts_clean(wavefronts);
+  return EXIT_SUCCESS;
+}
+
+
+/*
+ * Match Extension Kernels
+ *   Return the length of the common run of pattern and text (at most max_length),
+ *   comparing a whole word per iteration. Loads may overrun the run by up to
+ *   SEQUENCE_PADDING-1 bytes, so sequences must be padded on both sides.
+ *   Reverse kernels compare backwards from the byte before pattern/text.
+ */
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define WORD_FIRST_MISMATCH(x) (__builtin_clzll(x)/8)
+#define WORD_LAST_MISMATCH(x)  (__builtin_ctzll(x)/8)
+#else
+#define WORD_FIRST_MISMATCH(x) (__builtin_ctzll(x)/8)
+#define WORD_LAST_MISMATCH(x)  (__builtin_clzll(x)/8)
+#endif
+
+typedef int (*ewf_match_kernel_t)(const char*,const char*,int);
+
+static int ewf_match_forward_word(
+    const char* const pattern,
+    const char* const text,
+    const int max_length) {
+  int length = 0;
+  while (length < max_length) {
+    uint64_t pattern_word, text_word;
+    memcpy(&pattern_word,pattern+length,sizeof(uint64_t));
+    memcpy(&text_word,text+length,sizeof(uint64_t));
+    const uint64_t mismatches = pattern_word ^ text_word;
+    if (mismatches) return MIN(length+WORD_FIRST_MISMATCH(mismatches),max_length);
+    length += sizeof(uint64_t);
+  }
+  return max_length;
+}
+
+static int ewf_match_reverse_word(
+    const char* const pattern,
+    const char* const text,
+    const int max_length) {
+  int length = 0;
+  while (length < max_length) {
+    uint64_t pattern_word, text_word;
+    memcpy(&pattern_word,pattern-length-sizeof(uint64_t),sizeof(uint64_t));
+    memcpy(&text_word,text-length-sizeof(uint64_t),sizeof(uint64_t));
+    const uint64_t mismatches = pattern_word ^ text_word;
+    if (mismatches) return MIN(length+WORD_LAST_MISMATCH(mismatches),max_length);
+    length += sizeof(uint64_t);
+  }
+  return max_length;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+__attribute__((target("avx2")))
+static int ewf_match_forward_avx2(
+    const char* const pattern,
+    const char* const text,
+    const int max_length) {
+  int length = 0;
+  while (length < max_length) {
+    const __m256i pattern_vector = _mm256_loadu_si256((const __m256i*)(pattern+length));
+    const __m256i text_vector = _mm256_loadu_si256((const __m256i*)(text+length));
+    const uint32_t mismatches = ~(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(pattern_vector,text_vector));
+    if (mismatches) return MIN(length+__builtin_ctz(mismatches),max_length);
+    length += 32;
+  }
+  return max_length;
+}
+
+__attribute__((target("avx2")))
+static int ewf_match_reverse_avx2(
+    const char* const pattern,
+    const char* const text,
+    const int max_length) {
+  int length = 0;
+  while (length < max_length) {
+    const __m256i pattern_vector = _mm256_loadu_si256((const __m256i*)(pattern-length-32));
+    const __m256i text_vector = _mm256_loadu_si256((const __m256i*)(text-length-32));
+    const uint32_t mismatches = ~(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(pattern_vector,text_vector));
+    if (mismatches) return MIN(length+__builtin_clz(mismatches),max_length);
+    length += 32;
+  }
+  return max_length;
+}
+
+__attribute__((target("avx512bw")))
+static int ewf_match_forward_avx512(
+    const char* const pattern,
+    const char* const text,
+    const int max_length) {
+  int length = 0;
+  while (length < max_length) {
+    const __m512i pattern_vector = _mm512_loadu_si512((const void*)(pattern+length));
+    const __m512i text_vector = _mm512_loadu_si512((const void*)(text+length));
+    const uint64_t mismatches = _mm512_cmpneq_epi8_mask(pattern_vector,text_vector);
+    if (mismatches) return MIN(length+__builtin_ctzll(mismatches),max_length);
+    length += 64;
+  }
+  return max_length;
+}
+
+__attribute__((target("avx512bw")))
+static int ewf_match_reverse_avx512(
+    const char* const pattern,
+    const char* const text,
+    const int max_length) {
+  int length = 0;
+  while (length < max_length) {
+    const __m512i pattern_vector = _mm512_loadu_si512((const void*)(pattern-length-64));
+    const __m512i text_vector = _mm512_loadu_si512((const void*)(text-length-64));
+    const uint64_t mismatches = _mm512_cmpneq_epi8_mask(pattern_vector,text_vector);
+    if (mismatches) return MIN(length+__builtin_clzll(mismatches),max_length);
+    length += 64;
+  }
+  return max_length;
+}
+#endif
+
+/*
+ * Packed Match Extension Kernels (32 bases per word)
+ */
+static uint64_t ewf_packed_window(
+    const uint64_t* const words,
+    const int position) {
+  // Bases [position,position+32)
+  const uint64_t* const word = words + position/PACKED_BASES_PER_WORD;
+  const int shift = 2*(position%PACKED_BASES_PER_WORD);
+  return (word[0] >> shift) | ((word[1] << 1) << (63-shift));
+}
+
+static int ewf_match_forward_packed(
+    const uint64_t* const pattern,
+    const int pattern_position,
+    const uint64_t* const text,
+    const int text_position,
+    const int max_length) {
+  int length = 0;
+  while (length < max_length) {
+    const uint64_t mismatches =
+        ewf_packed_window(pattern,pattern_position+length) ^
+        ewf_packed_window(text,text_position+length);
+    if (mismatches) return MIN(length+__builtin_ctzll(mismatches)/2,max_length);
+    length += PACKED_BASES_PER_WORD;
+  }
+  return max_length;
+}
+
+static int ewf_match_reverse_packed(
+    const uint64_t* const pattern,
+    const int pattern_end,
+    const uint64_t* const text,
+    const int text_end,
+    const int max_length) {
+  int length = 0;
+  while (length < max_length) {
+    // Bases [end-length-32,end-length) (one word back, so positions stay positive)
+    const uint64_t mismatches =
+        ewf_packed_window(pattern-1,pattern_end-length) ^
+        ewf_packed_window(text-1,text_end-length);
+    if (mismatches) return MIN(length+__builtin_clzll(mismatches)/2,max_length);
+    length += PACKED_BASES_PER_WORD;
+  }
+  return max_length;
+}
+
+// Selected at startup (wfa_edit_select_extend_kernels)
+static ewf_match_kernel_t ewf_match_forward = ewf_match_forward_word;
+static ewf_match_kernel_t ewf_match_reverse = ewf_match_reverse_word;
+
+/*
+ * Select the widest match extension kernels supported (or the requested ones)
+ *   Returns the name of the selected kernels, NULL if unknown or unsupported
+ */
+const char* wfa_edit_select_extend_kernels(
+    const char* const requested) {
+  const bool any = (requested == NULL || !strcmp(requested,"auto"));
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_cpu_init();
+  if ((any || !strcmp(requested,"avx512")) && __builtin_cpu_supports("avx512bw")) {
+    ewf_match_forward = ewf_match_forward_avx512;
+    ewf_match_reverse = ewf_match_reverse_avx512;
+    return "avx512";
+  }
+  if ((any || !strcmp(requested,"avx2")) && __builtin_cpu_supports("avx2")) {
+    ewf_match_forward = ewf_match_forward_avx2;
+    ewf_match_reverse = ewf_match_reverse_avx2;
+    return "avx2";
+  }
+#endif
+  if (any || !strcmp(requested,"word")) {
+    ewf_match_forward = ewf_match_forward_word;
+    ewf_match_reverse = ewf_match_reverse_word;
+    return "word";
+  }
+  return NULL;
+}
+
+/*
+ * Wavefront code (one instance per offset width)
+ */
+#define EWF_OFFSET_BITS 8
+#include "wfa_edit_offsets.h"
+#undef EWF_OFFSET_BITS
+#define EWF_OFFSET_BITS 16
+#include "wfa_edit_offsets.h"
+#undef EWF_OFFSET_BITS
+#define EWF_OFFSET_BITS 32
+#include "wfa_edit_offsets.h"
+#undef EWF_OFFSET_BITS
+
+/*
+ * Offset Width Dispatch
+ *   Offsets reach text_length plus the distance, which is at most
+ *   MAX(pattern_length,text_length) for optimal alignments and
+ *   pattern_length+text_length with reduction (both capped by max_score)
+ */
+typedef void (*edit_wavefronts_aligner_t)(edit_wavefronts_t*,const char*,int,const char*,int,int*);
+
+static const edit_wavefronts_aligner_t edit_wavefronts_aligners[EWF_OFFSET_WIDTHS] =
+    {edit_wavefronts_align_i8,edit_wavefronts_align_i16,edit_wavefronts_align_i32};
+static const edit_wavefronts_aligner_t edit_wavefronts_aligners_score_only[EWF_OFFSET_WIDTHS] =
+    {edit_wavefronts_align_score_only_i8,edit_wavefronts_align_score_only_i16,edit_wavefronts_align_score_only_i32};
+static const edit_wavefronts_aligner_t edit_wavefronts_aligners_compact[EWF_OFFSET_WIDTHS] =
+    {edit_wavefronts_align_compact_i8,edit_wavefronts_align_compact_i16,edit_wavefronts_align_compact_i32};
+static const edit_wavefronts_aligner_t edit_bialign_aligners[EWF_OFFSET_WIDTHS] =
+    {edit_bialign_align_i8,edit_bialign_align_i16,edit_bialign_align_i32};
+
+typedef void (*edit_wavefronts_lanes_aligner_t)(edit_wavefronts_t*,const ewf_lanes_t*,bool);
+
+static const edit_wavefronts_lanes_aligner_t edit_wavefronts_aligners_lanes[EWF_OFFSET_WIDTHS] =
+    {edit_wavefronts_align_lanes_i8,edit_wavefronts_align_lanes_i16,edit_wavefronts_align_lanes_i32};
+
+/*
+ * Narrowest offset width of a pair (index, at least min_width)
+ */
+static int edit_wavefronts_offset_width(
+    const edit_wavefronts_t* const wavefronts,
+    const int pattern_length,
+    const int text_length,
+    const int min_width) {
+  const int64_t max_distance = wavefronts->reduction.enabled ?
+      (int64_t)pattern_length+text_length : MAX(pattern_length,text_length);
+  const int64_t max_offset = text_length + MIN(max_distance,wavefronts->max_score) + 1;
+  if (min_width <= EWF_OFFSET_WIDTH_8 && max_offset <= INT8_MAX) return EWF_OFFSET_WIDTH_8;
+  if (min_width <= EWF_OFFSET_WIDTH_16 && max_offset <= INT16_MAX) return EWF_OFFSET_WIDTH_16;
+  return EWF_OFFSET_WIDTH_32;
+}
+
+/*
+ * Offset width of a pair aligned in inter-pair lanes (index, at least min_width)
+ *   Lanes that dropped out keep growing up to the distance of the others, so the
+ *   pair is sized as if both sequences had the length of the longest one
+ *   (any two pairs of a width then fit it together)
+ */
+int wfa_edit_wavefronts_lanes_offset_width(
+    const edit_wavefronts_t* const wavefronts,
+    const int pattern_length,
+    const int text_length,
+    const int min_width) {
+  const int max_length = MAX(pattern_length,text_length);
+  return edit_wavefronts_offset_width(wavefronts,max_length,max_length,min_width);
+}
+
+/*
+ * Align the pairs of inter-pair lanes of a width (and empty them)
+ *   Lanes are left unaligned if an allocation fails
+ */
+void wfa_edit_wavefronts_align_lanes(
+    edit_wavefronts_t* const wavefronts,
+    ewf_lanes_t* const lanes,
+    const int width,
+    const bool score_only) {
+  if (lanes->num_lanes == 0) return;
+  int lane, max_pattern_length = 0, max_text_length = 0;
+  for (lane=0;lane<lanes->num_lanes;++lane) {
+    max_pattern_length = MAX(max_pattern_length,lanes->pattern_lengths[lane]);
+    max_text_length = MAX(max_text_length,lanes->text_lengths[lane]);
+  }
+  wavefronts->allocation_failed = false;
+  if (edit_wavefronts_resize(wavefronts,max_pattern_length,max_text_length) == EXIT_SUCCESS) {
+    edit_wavefronts_clean(wavefronts);
+    edit_wavefronts_aligners_lanes[width](wavefronts,lanes,score_only);
+  }
+  else {
+    wavefronts->allocation_failed = true;
+  }
+  if (wavefronts->allocation_failed) {
+    for (lane=0;lane<lanes->num_lanes;++lane) {
+      *(lanes->scores[lane]) = EWF_SCORE_UNALIGNED;
+      *(lanes->cigar_lengths[lane]) = 0;
+    }
+    wavefronts->num_pairs_failed += lanes->num_lanes;
+  }
+  else {
+    wavefronts->num_pairs_lanes += lanes->num_lanes;
+  }
+  lanes->num_lanes = 0;
+}
+
+/*
+ * Align a pair alone (narrowest offsets fitting the pair, at least min_width)
+ *   Returns EXIT_FAILURE if an allocation fails (the pair is left unaligned)
+ */
+int wfa_edit_wavefronts_align_pair(
+    edit_wavefronts_t* const wavefronts,
+    const char* const pattern,
+    const int pattern_length,
+    const char* const text,
+    const int text_length,
+    const bool score_only,
+    const bool biwfa,
+    const bool compact_backtrace,
+    const int min_width,
+    int* const score) {
+  const int width = edit_wavefronts_offset_width(wavefronts,pattern_length,text_length,min_width);
+  wavefronts->allocation_failed = false;
+  if (!score_only && edit_wavefronts_resize(wavefronts,pattern_length,text_length)) {
+    wavefronts->allocation_failed = true;
+  }
+  else if (score_only) {
+    edit_wavefronts_aligners_score_only[width](wavefronts,pattern,pattern_length,text,text_length,score);
+  }
+  else if (biwfa) {
+    edit_bialign_aligners[width](wavefronts,pattern,pattern_length,text,text_length,score);
+  }
+  else if (compact_backtrace) {
+    edit_wavefronts_clean(wavefronts);
+    edit_wavefronts_aligners_compact[width](wavefronts,pattern,pattern_length,text,text_length,score);
+  }
+  else {
+    edit_wavefronts_clean(wavefronts);
+    edit_wavefronts_aligners[width](wavefronts,pattern,pattern_length,text,text_length,score);
+  }
+  if (wavefronts->allocation_failed) {
+    ++(wavefronts->num_pairs_failed);
+    (*score) = EWF_SCORE_UNALIGNED;
+    wavefronts->edit_cigar_length = 0;
+    return EXIT_FAILURE;
+  }
+  ++(wavefronts->num_pairs_width[width]);
+  return EXIT_SUCCESS;
+}
+
+/*
+ * Select the compute kernel of every offset width (the same one for all of them)
+ */
+const char* wfa_edit_select_compute_kernel(
+    const char* const requested) {
+  if (edit_wavefronts_select_compute_kernel_i8(requested) == NULL ||
+      edit_wavefronts_select_compute_kernel_i32(requested) == NULL) return NULL;
+  return edit_wavefronts_select_compute_kernel_i16(requested);
+}
+
+/*
+ * Compute kernels benchmark for every offset width
+ */
+void wfa_edit_compute_benchmark(
+    const int width) {
+  edit_wavefronts_compute_benchmark_i8(width);
+  edit_wavefronts_compute_benchmark_i16(width);
+  edit_wavefronts_compute_benchmark_i32(width);
+}
+
+/*
+ * Library API (wfa_edit.h)
+ *   An aligner wraps a wavefronts set and aligns each pair as a batch task does,
+ *   from a padded copy of the pair (kernels are selected once, the widest supported)
+ */
+struct wfa_edit_aligner_s {
+  wfa_edit_options_t options;
+  edit_wavefronts_t wavefronts;
+  char* sequences_mem;         // Copied pattern and text (each one padded by SEQUENCE_PADDING)
+  size_t sequences_capacity;
+  int score;
+  char* cigar;                 // Run-length CIGAR text of the last pair (formatted on demand)
+  size_t cigar_capacity;
+  int cigar_length;
+  bool cigar_formatted;
+};
+
+static pthread_once_t wfa_edit_kernels_once = PTHREAD_ONCE_INIT;
+
+static void wfa_edit_select_kernels(void) {
+  wfa_edit_select_extend_kernels(NULL);
+  wfa_edit_select_compute_kernel(NULL);
+}
+
+void wfa_edit_options_default(
+    wfa_edit_options_t* const options) {
+  options->max_score = INT32_MAX;
+  options->score_only = false;
+  options->biwfa = false;
+  options->compact_backtrace = false;
+  options->reduction = false;
+  options->reduction_min_length = DEFAULT_REDUCTION_MIN_LENGTH;
+  options->reduction_max_distance = DEFAULT_REDUCTION_MAX_DISTANCE;
+  options->filter = false;
+}
+
+/*
+ * Allocate wavefronts for the options of an aligner (they grow with the pairs)
+ */
+static int wfa_edit_aligner_init_wavefronts(
+    const wfa_edit_options_t* const options,
+    edit_wavefronts_t* const wavefronts) {
+  const ewf_reduction_t reduction = {
+      .enabled = options->reduction,
+      .min_wavefront_length = options->reduction_min_length,
+      .max_distance_threshold = options->reduction_max_distance};
+  if (wfa_edit_wavefronts_init(wavefronts,LIBRARY_INIT_LENGTH,LIBRARY_INIT_LENGTH,
+      options->max_score,reduction,options->filter)) {
+    wfa_edit_wavefronts_free(wavefronts);
+    return EXIT_FAILURE;
+  }
+  wavefronts->edit_cigar_length = 0;
+  return EXIT_SUCCESS;
+}
+
+/*
+ * Release the pair and CIGAR buffers and clear the result
+ */
+static void wfa_edit_aligner_clear(
+    wfa_edit_aligner_t* const aligner) {
+  free(aligner->sequences_mem);
+  aligner->sequences_mem = NULL;
+  aligner->sequences_capacity = 0;
+  aligner->score = EWF_SCORE_UNALIGNED;
+  free(aligner->cigar);
+  aligner->cigar = NULL;
+  aligner->cigar_capacity = 0;
+  aligner->cigar_length = 0;
+  aligner->cigar_formatted = false;
+}
+
+wfa_edit_aligner_t* wfa_edit_aligner_new(
+    const wfa_edit_options_t* const options) {
+  wfa_edit_options_t aux_options;
+  wfa_edit_options_default(&aux_options);
+  if (options != NULL) aux_options = *options;
+  // Same ranges as the environment variables
+  if (aux_options.max_score < 0 || aux_options.reduction_min_length <= 0 || aux_options.reduction_max_distance < 0) {
+    PRINTF_ERROR("Invalid aligner options\n");
+    return NULL;
+  }
+  // Options that do not apply are disabled (as the binaries do)
+  aux_options.compact_backtrace &= !aux_options.score_only && !aux_options.biwfa;
+  aux_options.reduction &= !aux_options.score_only && !aux_options.biwfa;
+  aux_options.filter &= (aux_options.max_score != INT32_MAX);
+  wfa_edit_aligner_t* const aligner = malloc(sizeof(wfa_edit_aligner_t));
+  if (aligner == NULL) {
+    PRINTF_ERROR("Allocation of aligner failed\n");
+    return NULL;
+  }
+  pthread_once(&wfa_edit_kernels_once,wfa_edit_select_kernels);
+  aligner->options = aux_options;
+  if (wfa_edit_aligner_init_wavefronts(&aligner->options,&aligner->wavefronts)) {
+    free(aligner);
+    return NULL;
+  }
+  aligner->sequences_mem = NULL;
+  aligner->cigar = NULL;
+  wfa_edit_aligner_clear(aligner);
+  return aligner;
+}
+
+int wfa_edit_aligner_align(
+    wfa_edit_aligner_t* const aligner,
+    const char* const pattern,
+    const int pattern_length,
+    const char* const text,
+    const int text_length) {
+  edit_wavefronts_t* const wavefronts = &aligner->wavefronts;
+  aligner->score = EWF_SCORE_UNALIGNED;
+  aligner->cigar_formatted = false;
+  wavefronts->edit_cigar_length = 0;
+  if (pattern == NULL || text == NULL || pattern_length < 0 || text_length < 0) {
+    PRINTF_ERROR("Invalid pair to align\n");
+    return EXIT_FAILURE;
+  }
+  // Copy the pair (padded on both sides of each sequence)
+  const size_t length = (size_t)pattern_length + text_length + 3*SEQUENCE_PADDING;
+  if (length > aligner->sequences_capacity) {
+    free(aligner->sequences_mem);
+    aligner->sequences_mem = calloc(length,1);
+    aligner->sequences_capacity = (aligner->sequences_mem != NULL) ? length : 0;
+    if (aligner->sequences_mem == NULL) {
+      PRINTF_ERROR("Allocation of aligner sequences failed\n");
+      return EXIT_FAILURE;
+    }
+  }
+  char* const pattern_copy = aligner->sequences_mem + SEQUENCE_PADDING;
+  char* const text_copy = pattern_copy + pattern_length + SEQUENCE_PADDING;
+  memcpy(pattern_copy,pattern,pattern_length);
+  memcpy(text_copy,text,text_length);
+  // Align
+  const wfa_edit_options_t* const options = &aligner->options;
+  if (wavefronts->filter &&
+      edit_wavefronts_filter(pattern_copy,pattern_length,text_copy,text_length,wavefronts->max_score)) {
+    ++(wavefronts->num_pairs_filtered);
+    return EXIT_SUCCESS;
+  }
+  return wfa_edit_wavefronts_align_pair(wavefronts,pattern_copy,pattern_length,text_copy,text_length,
+      options->score_only,options->biwfa,options->compact_backtrace,EWF_OFFSET_WIDTH_8,&aligner->score);
+}
+
+int wfa_edit_aligner_score(
+    const wfa_edit_aligner_t* const aligner) {
+  return aligner->score;
+}
+
+const char* wfa_edit_aligner_cigar(
+    wfa_edit_aligner_t* const aligner,
+    int* const cigar_length) {
+  if (!aligner->cigar_formatted) {
+    const edit_wavefronts_t* const wavefronts = &aligner->wavefronts;
+    // Text CIGAR (at most 11 bytes per CIGAR byte, see edit_cigar_put_text) and terminator
+    const size_t length = 11*(size_t)wavefronts->edit_cigar_length + 1;
+    if (length > aligner->cigar_capacity) {
+      free(aligner->cigar);
+      aligner->cigar = malloc(length);
+      aligner->cigar_capacity = (aligner->cigar != NULL) ? length : 0;
+      if (aligner->cigar == NULL) {
+        PRINTF_ERROR("Allocation of aligner CIGAR failed\n");
+        return NULL;
+      }
+    }
+    char* const end = edit_cigar_put_text(aligner->cigar,wavefronts->edit_cigar,wavefronts->edit_cigar_length);
+    *end = '\0';
+    aligner->cigar_length = end - aligner->cigar;
+    aligner->cigar_formatted = true;
+  }
+  if (cigar_length != NULL) *cigar_length = aligner->cigar_length;
+  return aligner->cigar;
+}
+
+int wfa_edit_aligner_reset(
+    wfa_edit_aligner_t* const aligner) {
+  // Replace the wavefronts only once the new ones are allocated
+  edit_wavefronts_t wavefronts;
+  if (wfa_edit_aligner_init_wavefronts(&aligner->options,&wavefronts)) return EXIT_FAILURE;
+  wfa_edit_wavefronts_free(&aligner->wavefronts);
+  aligner->wavefronts = wavefronts;
+  wfa_edit_aligner_clear(aligner);
+  return EXIT_SUCCESS;
+}
+
+void wfa_edit_aligner_free(
+    wfa_edit_aligner_t* const aligner) {
+  if (aligner == NULL) return;
+  wfa_edit_wavefronts_free(&aligner->wavefronts);
+  free(aligner->sequences_mem);
+  free(aligner->cigar);
+  free(aligner);
+}
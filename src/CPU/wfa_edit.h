@@ -0,0 +1,113 @@
+/*
+ *  Wavefront Alignments Algorithms
+ *  Copyright (c) 2024 by Diego García Aranda <diego.garcia1@bsc.es>
+ *
+ *  This file is part of Wavefront Alignments Algorithms.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * PROJECT: Wavefront Alignments Algorithms
+ * AUTHOR(S): Diego García Aranda <diego.garcia1@bsc.es>
+ */
+
+/*
+ * Edit distance aligner library (libwfa_edit)
+ *   Aligners wrap the CPU wavefronts (wfa_edit.c), the FPGA accelerator is only
+ *   driven by its own programs. An aligner keeps its wavefronts and sequence
+ *   buffers between calls, so aligning many pairs only reallocates them for
+ *   longer pairs. Aligners are not shared between threads (one per thread).
+ *
+ *     wfa_edit_aligner_t* const aligner = wfa_edit_aligner_new(NULL);
+ *     if (wfa_edit_aligner_align(aligner,pattern,pattern_length,text,text_length) == 0) {
+ *       const int score = wfa_edit_aligner_score(aligner);
+ *       const char* const cigar = wfa_edit_aligner_cigar(aligner,NULL); // e.g. "12M1X3M"
+ *     }
+ *     wfa_edit_aligner_free(aligner);
+ */
+#ifndef WFA_EDIT_H
+#define WFA_EDIT_H
+
+#include <stdbool.h>
+
+#define WFA_EDIT_API __attribute__((visibility("default")))
+#define WFA_EDIT_SCORE_UNALIGNED (-1) // Score of pairs above the distance budget (max_score)
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+  int max_score;               // Distance budget (INT32_MAX unbounded)
+  bool score_only;             // No CIGAR
+  bool biwfa;                  // Bidirectional alignment (memory proportional to the score)
+  bool compact_backtrace;      // Backtrace from 2-bit predecessors (not with score_only/biwfa)
+  bool reduction;              // Heuristic wavefront reduction (not with score_only/biwfa)
+  int reduction_min_length;    // Wavefronts up to this width are not reduced
+  int reduction_max_distance;  // Diagonals this much further from the target than the best one are dropped
+  bool filter;                 // Q-gram lower bound before aligning (with max_score)
+} wfa_edit_options_t;
+
+typedef struct wfa_edit_aligner_s wfa_edit_aligner_t;
+
+/*
+ * Default options (those of the binaries without environment variables)
+ */
+WFA_EDIT_API void wfa_edit_options_default(
+    wfa_edit_options_t* options);
+
+/*
+ * New aligner (default options if NULL)
+ *   Returns NULL if the options are invalid or the allocation fails
+ */
+WFA_EDIT_API wfa_edit_aligner_t* wfa_edit_aligner_new(
+    const wfa_edit_options_t* options);
+
+/*
+ * Align a pair (sequences are copied, they need no padding nor terminator)
+ *   Returns 0 on success, non-zero if the pair is invalid or the allocation
+ *   fails (the pair is then unaligned, the aligner can still be used)
+ */
+WFA_EDIT_API int wfa_edit_aligner_align(
+    wfa_edit_aligner_t* aligner,
+    const char* pattern,
+    int pattern_length,
+    const char* text,
+    int text_length);
+
+/*
+ * Result of the last pair aligned
+ *   The CIGAR is run-length text (M match, X mismatch, I text only, D pattern
+ *   only), empty if score only or unaligned, valid until the next call
+ */
+WFA_EDIT_API int wfa_edit_aligner_score(
+    const wfa_edit_aligner_t* aligner);
+WFA_EDIT_API const char* wfa_edit_aligner_cigar(
+    wfa_edit_aligner_t* aligner,
+    int* cigar_length);
+
+/*
+ * Forget the last result and release the buffers grown for long pairs
+ *   Returns 0 on success, non-zero if the allocation fails (the aligner is kept as it was)
+ */
+WFA_EDIT_API int wfa_edit_aligner_reset(
+    wfa_edit_aligner_t* aligner);
+
+WFA_EDIT_API void wfa_edit_aligner_free(
+    wfa_edit_aligner_t* aligner);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // WFA_EDIT_H
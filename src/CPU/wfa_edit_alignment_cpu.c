@@ -30,322 +30,359 @@
 #include <sys/time.h>
 #include <time.h>
 
+#include "wfa_edit_common.h"
+#include "wfa_edit_core.h"
+#include "wfa_edit_io.h"
+
 double wall_time () {
    struct timespec ts;
    clock_gettime(CLOCK_MONOTONIC,&ts);
    return (double) (ts.tv_sec) + (double) ts.tv_nsec * 1.0e-9;
 }
 
-/*
- * Translate k and offset to coordinates h,v
- */
-#define EWAVEFRONT_V(k,offset) ((offset)-(k))
-#define EWAVEFRONT_H(k,offset) (offset)
-
-#define EWAVEFRONT_DIAGONAL(h,v) ((h)-(v))
-#define EWAVEFRONT_OFFSET(h,v)   (h)
+#define DEFAULT_BATCH_SIZE 4096
+#define DEFAULT_TASK_SIZE  64
+#define BATCH_SEQUENCES_INIT_CAPACITY (1<<20)
+#define DEFAULT_INPUT_THREADS 2
 
-#define MAX(a,b) (((a)>=(b))?(a):(b))
-#define ABS(a) (((a)>=0)?(a):-(a))
-
-#define PRINTF(format, ...) do { printf(format, ##__VA_ARGS__); } while(0)
-#define PRINTF_COND(condition,format, ...) do { if (condition) { printf(format, ##__VA_ARGS__); } } while(0)
-#define PRINTF_ERROR(format, ...) do { fprintf(stderr, format, ##__VA_ARGS__); } while(0);
+#ifdef _OMPSS_2
+#define OSS(p) _Pragma(p)
+#else
+#define OSS(...)
+#endif
 
 /*
- * Wavefront
+ * Batch of sequence pairs and their alignment results
+ *   Pairs are either slices of a mapped input (zero-copy) or copied, pattern and
+ *   text contiguously, to the sequences buffer (all pairs of a batch alike).
+ *   The CIGAR of a pair cannot be longer than pattern_length+text_length, so it is
+ *   stored at the offset the pair has (or would have) in the sequences buffer.
  */
-typedef int16_t ewf_offset_t;  // Edit Wavefront Offset
 typedef struct {
-  int lo;                      // Effective lowest diagonal (inclusive)
-  int hi;                      // Effective highest diagonal (inclusive)
-  ewf_offset_t* offsets;       // Offsets
-  ewf_offset_t* offsets_mem;   // Offsets memory
-} edit_wavefront_t;
-
+  int num_pairs;
+  int max_pairs;
+  // Sequences
+  const char** patterns;
+  const char** texts;
+  char* sequences_mem;         // Copied sequences memory (padded by SEQUENCE_PADDING on both sides)
+  char* sequences;
+  size_t sequences_length;     // Length of all pairs (copied or not)
+  size_t sequences_capacity;
+  size_t* offsets;
+  int* pattern_lengths;
+  int* text_lengths;
+  // Packed sequences (NULL if not packing)
+  uint64_t* packed;
+  size_t packed_length;
+  size_t packed_capacity;
+  size_t* packed_offsets;      // Pattern words (text follows), PACKED_ESCAPED for non-ACGT pairs
+  int num_escaped;
+  // Results
+  int* scores;
+  char* cigars;
+  size_t cigars_capacity;
+  int* cigar_lengths;
+  uint8_t* check_status;       // Verification of each result (CHECK_*)
+} sequence_batch_t;
 
 /*
- * Edit Wavefronts
+ * Pack a DNA sequence (2 bits per base, A=0 C=1 G=2 T=3) into PACKED_WORDS(length) words
+ *   Returns false if it has other symbols (the pair is aligned on characters)
  */
-typedef struct {
-  // Dimensions
-  int pattern_length;
-  int text_length;
-  int max_distance;
-  // Waves Offsets
-  edit_wavefront_t* wavefronts;
-  int wavefronts_allocated;
-  // CIGAR
-  char* edit_cigar;
-  int edit_cigar_length;
-} edit_wavefronts_t;
-
-
-void edit_wavefronts_init(
-    edit_wavefronts_t* const wavefronts,
-    const int pattern_length,
-    const int text_length) {
-  // Dimensions
-  wavefronts->pattern_length = pattern_length;
-  wavefronts->text_length = text_length;
-  wavefronts->max_distance = pattern_length + text_length;
-  // Allocate wavefronts
-  wavefronts->wavefronts = calloc(wavefronts->max_distance,sizeof(edit_wavefront_t));
-  wavefronts->wavefronts_allocated = 0;
-  // Allocate CIGAR
-  wavefronts->edit_cigar = malloc(wavefronts->max_distance);
-}
-
-
-void edit_wavefronts_clean(
-    edit_wavefronts_t* const wavefronts) {
+bool sequence_pack(
+    uint64_t* const packed,
+    const char* const sequence,
+    const int length) {
+  memset(packed,0,PACKED_WORDS(length)*sizeof(uint64_t));
+  uint64_t* const words = packed + 1; // Skip front padding word
   int i;
-  for (i=0;i<wavefronts->wavefronts_allocated;++i) {
-    free(wavefronts->wavefronts[i].offsets_mem);
+  for (i=0;i<length;++i) {
+    uint64_t base;
+    switch (sequence[i]) {
+      case 'A': base = 0; break;
+      case 'C': base = 1; break;
+      case 'G': base = 2; break;
+      case 'T': base = 3; break;
+      default: return false;
+    }
+    words[i/PACKED_BASES_PER_WORD] |= base << (2*(i%PACKED_BASES_PER_WORD));
   }
-  wavefronts->wavefronts_allocated = 0;
+  return true;
 }
 
-
-edit_wavefront_t* edit_wavefronts_allocate_wavefront(
-    edit_wavefronts_t* const edit_wavefronts,
-    const int distance,
-    const int lo_base,
-    const int hi_base) {
-  // Compute limits
-  const int wavefront_length = hi_base - lo_base + 2; // (+1) for k=0
-  // Allocate wavefront
-  edit_wavefront_t* const wavefront = edit_wavefronts->wavefronts + distance;
-  ++(edit_wavefronts->wavefronts_allocated); // Next
-  // Configure offsets
-  wavefront->lo = lo_base;
-  wavefront->hi = hi_base;
-  // Allocate offsets
-  ewf_offset_t* const offsets_mem = calloc(wavefront_length,sizeof(ewf_offset_t));
-  wavefront->offsets_mem = offsets_mem;
-  wavefront->offsets = offsets_mem - lo_base; // Center at k=0
-  ++(edit_wavefronts->wavefronts_allocated);
-  // Return
-  return wavefront;
+int sequence_batch_init(
+    sequence_batch_t* const batch,
+    const int max_pairs,
+    const bool packed) {
+  batch->num_pairs = 0;
+  batch->max_pairs = max_pairs;
+  batch->sequences_length = 0;
+  batch->sequences_capacity = BATCH_SEQUENCES_INIT_CAPACITY;
+  batch->sequences_mem = calloc(batch->sequences_capacity+2*SEQUENCE_PADDING,1);
+  batch->sequences = batch->sequences_mem + SEQUENCE_PADDING;
+  batch->cigars_capacity = BATCH_SEQUENCES_INIT_CAPACITY;
+  batch->cigars = malloc(batch->cigars_capacity);
+  batch->patterns = malloc(max_pairs*sizeof(const char*));
+  batch->texts = malloc(max_pairs*sizeof(const char*));
+  batch->offsets = malloc(max_pairs*sizeof(size_t));
+  batch->pattern_lengths = malloc(max_pairs*sizeof(int));
+  batch->text_lengths = malloc(max_pairs*sizeof(int));
+  batch->scores = malloc(max_pairs*sizeof(int));
+  batch->cigar_lengths = malloc(max_pairs*sizeof(int));
+  batch->check_status = malloc(max_pairs*sizeof(uint8_t));
+  batch->packed = NULL;
+  batch->packed_offsets = NULL;
+  batch->packed_length = 0;
+  batch->num_escaped = 0;
+  if (packed) {
+    batch->packed_capacity = BATCH_SEQUENCES_INIT_CAPACITY/PACKED_BASES_PER_WORD;
+    batch->packed = malloc(batch->packed_capacity*sizeof(uint64_t));
+    batch->packed_offsets = malloc(max_pairs*sizeof(size_t));
+    if (batch->packed == NULL || batch->packed_offsets == NULL) {
+      PRINTF_ERROR("Allocation of packed sequence batch failed\n");
+      return EXIT_FAILURE;
+    }
+  }
+  if (batch->sequences_mem == NULL || batch->cigars == NULL ||
+      batch->patterns == NULL || batch->texts == NULL || batch->offsets == NULL || batch->pattern_lengths == NULL || batch->text_lengths == NULL ||
+      batch->scores == NULL || batch->cigar_lengths == NULL || batch->check_status == NULL) {
+    PRINTF_ERROR("Allocation of sequence batch failed\n");
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
 }
-/*
- * Edit Wavefront Backtrace
- */
-int edit_wavefronts_backtrace(
-    edit_wavefronts_t* const wavefronts,
-    const int target_k,
-    const int target_distance) {
-  // Parameters
-  int edit_cigar_idx = 0;
-  int k = target_k, distance = target_distance;
-  ewf_offset_t offset = wavefronts->wavefronts[distance].offsets[k];
-  while (distance > 0) {
-    // Fetch
-    const edit_wavefront_t* const wavefront = &wavefronts->wavefronts[distance-1];
-    const ewf_offset_t* const offsets = wavefront->offsets;
-    // Traceback operation
-    if (wavefront->lo <= k+1 && k+1 <= wavefront->hi && offset == offsets[k+1]) {
-      wavefronts->edit_cigar[edit_cigar_idx++] = 'D';
-      ++k;
-      --distance;
-    } else if (wavefront->lo <= k-1 && k-1 <= wavefront->hi && offset == offsets[k-1] + 1) {
-      wavefronts->edit_cigar[edit_cigar_idx++] = 'I';
-      --k;
-      --offset;
-      --distance;
-    } else if (wavefront->lo <= k && k <= wavefront->hi && offset == offsets[k] + 1) {
-      wavefronts->edit_cigar[edit_cigar_idx++] = 'X';
-      --distance;
-      --offset;
-    } else {
-      wavefronts->edit_cigar[edit_cigar_idx++] = 'M';
-      --offset;
-    }
-  }
-  // Account for last offset of matches
-  while (offset > 0) {
-    wavefronts->edit_cigar[edit_cigar_idx++] = 'M';
-    --offset;
-  }
-  // Return CIGAR length
-  return edit_cigar_idx;
+
+void sequence_batch_clear(
+    sequence_batch_t* const batch) {
+  batch->num_pairs = 0;
+  batch->sequences_length = 0;
+  batch->packed_length = 0;
+  batch->num_escaped = 0;
 }
 
+void sequence_batch_free(
+    sequence_batch_t* const batch) {
+  free(batch->sequences_mem);
+  free(batch->cigars);
+  free(batch->patterns);
+  free(batch->texts);
+  free(batch->offsets);
+  free(batch->pattern_lengths);
+  free(batch->text_lengths);
+  free(batch->scores);
+  free(batch->cigar_lengths);
+  free(batch->check_status);
+  free(batch->packed);
+  free(batch->packed_offsets);
+}
 
 /*
- * Extend Wavefront
+ * Add a pair to the batch
+ *   Copied if copy is set, otherwise the batch keeps the sequences themselves
+ *   (padded by SEQUENCE_PADDING readable bytes, valid until the batch is aligned)
  */
-void edit_wavefronts_extend_wavefront(
-    edit_wavefronts_t* const wavefronts,
+int sequence_batch_add(
+    sequence_batch_t* const batch,
     const char* const pattern,
     const int pattern_length,
     const char* const text,
     const int text_length,
-    const int distance) {
-  // Parameters
-  edit_wavefront_t* const wavefront = &wavefronts->wavefronts[distance];
-  ewf_offset_t* const offsets = wavefront->offsets;
-  const int k_min = wavefront->lo;
-  const int k_max = wavefront->hi;
-  // Extend diagonally each wavefront point
-  int k;
-  for (k=k_min;k<=k_max;++k) {
-    int v = EWAVEFRONT_V(k,offsets[k]);
-    int h = EWAVEFRONT_H(k,offsets[k]);
-    while (v<pattern_length && h<text_length && pattern[v++]==text[h++]) {
-      ++(offsets[k]);
+    const bool copy) {
+  // Grow buffers (keeping their capacity across batches)
+  const size_t length = batch->sequences_length + pattern_length + text_length;
+  if (length > batch->cigars_capacity) {
+    const size_t capacity = MAX(2*batch->cigars_capacity,length);
+    char* const cigars = realloc(batch->cigars,capacity);
+    if (cigars == NULL) {
+      PRINTF_ERROR("Allocation of sequence batch buffers failed\n");
+      return EXIT_FAILURE;
+    }
+    batch->cigars = cigars;
+    batch->cigars_capacity = capacity;
+  }
+  if (copy && length > batch->sequences_capacity) {
+    const size_t capacity = MAX(2*batch->sequences_capacity,length);
+    char* const sequences_mem = realloc(batch->sequences_mem,capacity+2*SEQUENCE_PADDING);
+    if (sequences_mem == NULL) {
+      PRINTF_ERROR("Allocation of sequence batch buffers failed\n");
+      return EXIT_FAILURE;
+    }
+    batch->sequences_mem = sequences_mem;
+    batch->sequences = sequences_mem + SEQUENCE_PADDING;
+    memset(batch->sequences+capacity,0,SEQUENCE_PADDING); // Padding after the new capacity
+    batch->sequences_capacity = capacity;
+    // Copied pairs moved along
+    int i;
+    for (i=0;i<batch->num_pairs;++i) {
+      batch->patterns[i] = batch->sequences + batch->offsets[i];
+      batch->texts[i] = batch->patterns[i] + batch->pattern_lengths[i];
     }
   }
+  // Add pair
+  const int idx = batch->num_pairs++;
+  batch->offsets[idx] = batch->sequences_length;
+  batch->pattern_lengths[idx] = pattern_length;
+  batch->text_lengths[idx] = text_length;
+  if (copy) {
+    char* const sequences = batch->sequences + batch->sequences_length;
+    memcpy(sequences,pattern,pattern_length);
+    memcpy(sequences+pattern_length,text,text_length);
+    batch->patterns[idx] = sequences;
+    batch->texts[idx] = sequences + pattern_length;
+  }
+  else {
+    batch->patterns[idx] = pattern;
+    batch->texts[idx] = text;
+  }
+  batch->sequences_length = length;
+  // Pack pair
+  if (batch->packed != NULL) {
+    const size_t packed_length = batch->packed_length + PACKED_WORDS(pattern_length) + PACKED_WORDS(text_length);
+    if (packed_length > batch->packed_capacity) {
+      const size_t capacity = MAX(2*batch->packed_capacity,packed_length);
+      uint64_t* const packed = realloc(batch->packed,capacity*sizeof(uint64_t));
+      if (packed == NULL) {
+        PRINTF_ERROR("Allocation of packed sequence batch buffer failed\n");
+        return EXIT_FAILURE;
+      }
+      batch->packed = packed;
+      batch->packed_capacity = capacity;
+    }
+    uint64_t* const pattern_packed = batch->packed + batch->packed_length;
+    uint64_t* const text_packed = pattern_packed + PACKED_WORDS(pattern_length);
+    if (sequence_pack(pattern_packed,pattern,pattern_length) &&
+        sequence_pack(text_packed,text,text_length)) {
+      batch->packed_offsets[idx] = batch->packed_length;
+      batch->packed_length = packed_length;
+    }
+    else {
+      batch->packed_offsets[idx] = PACKED_ESCAPED;
+      ++(batch->num_escaped);
+    }
+  }
+  return EXIT_SUCCESS;
 }
 
 /*
- * Edit Wavefront Compute
+ * Read next batch of pairs (slices of the mapped input, the previous batch is released)
+ *   Returns the number of pairs read (0 at the end of input), -1 on error
  */
-void edit_wavefronts_compute_wavefront(
-    edit_wavefronts_t* const wavefronts,
-    const int distance) {
-  // Fetch wavefronts
-  edit_wavefront_t* const wavefront = &wavefronts->wavefronts[distance-1];
-  const int hi = wavefront->hi;
-  const int lo = wavefront->lo;
-  edit_wavefront_t* const next_wavefront = edit_wavefronts_allocate_wavefront(wavefronts,distance,lo-1,hi+1);
-  // Fetch offsets
-  ewf_offset_t* const offsets = wavefront->offsets;
-  ewf_offset_t* const next_offsets = next_wavefront->offsets;
-  // Loop peeling (k=lo-1)
-  next_offsets[lo-1] = offsets[lo];
-  // Loop peeling (k=lo)
-  const ewf_offset_t bottom_upper_del = ((lo+1) <= hi) ? offsets[lo+1] : -1;
-  next_offsets[lo] = MAX(offsets[lo]+1,bottom_upper_del);
-  // Compute next wavefront starting point
-  int k;
-  //#pragma GCC ivdep
-  for (k=lo+1;k<=hi-1;++k) {
-    /*
-     * const int del = offsets[k+1]; // Upper
-     * const int sub = offsets[k] + 1; // Mid
-     * const int ins = offsets[k-1] + 1; // Lower
-     * next_offsets[k] = MAX(sub,ins,del); // MAX
-     */
-    const ewf_offset_t max_ins_sub = MAX(offsets[k],offsets[k-1]) + 1;
-    next_offsets[k] = MAX(max_ins_sub,offsets[k+1]);
-  }
-  // Loop peeling (k=hi)
-  const ewf_offset_t top_lower_ins = (lo <= (hi-1)) ? offsets[hi-1] : -1;
-  next_offsets[hi] = MAX(offsets[hi],top_lower_ins) + 1;
-  // Loop peeling (k=hi+1)
-  next_offsets[hi+1] = offsets[hi] + 1;
+int sequence_reader_read_batch(
+    sequence_reader_t* const reader,
+    sequence_batch_t* const batch) {
+  sequence_batch_clear(batch);
+  sequence_reader_release(reader,reader->map_position);
+  while (batch->num_pairs < batch->max_pairs) {
+    const char* pattern;
+    const char* text;
+    int pattern_length, text_length;
+    const int status = sequence_reader_read_pair(reader,&pattern,&pattern_length,&text,&text_length);
+    if (status < 0) return -1;
+    if (status == 0) break;
+    if (sequence_batch_add(batch,pattern,pattern_length,text,text_length,reader->map == NULL)) return -1;
+  }
+  return batch->num_pairs;
 }
 
-
 /*
- * Edit distance alignment using wavefronts
+ * Align pairs [begin,end) of a batch (one task per chunk, each one with its own wavefronts)
+ *   With inter_pair, short pairs are gathered per offset width and aligned in lanes
  */
-void edit_wavefronts_align(
+OSS("oss task")
+void edit_wavefronts_align_batch_chunk(
     edit_wavefronts_t* const wavefronts,
-    const char* const pattern,
-    const int pattern_length,
-    const char* const text,
-    const int text_length,
-    int* const score) {
-  // Parameters
-  const int max_distance = pattern_length + text_length;
-  const int target_k = EWAVEFRONT_DIAGONAL(text_length,pattern_length);
-  const int target_k_abs = ABS(target_k);
-  const ewf_offset_t target_offset = EWAVEFRONT_OFFSET(text_length,pattern_length);
-  // Init wavefronts
-  int distance;
-  edit_wavefronts_allocate_wavefront(wavefronts,0,0,0);
-  wavefronts->wavefronts[0].offsets[0] = 0;
-  // Compute wavefronts for increasing distance
-  for (distance=0;distance<max_distance;++distance) {
-    // Extend diagonally each wavefront point
-    edit_wavefronts_extend_wavefront(wavefronts,
-        pattern,pattern_length,
-        text,text_length,distance);
-    // Exit condition
-    if (target_k_abs <= distance &&
-        wavefronts->wavefronts[distance].offsets[target_k] == target_offset) break;
-    // Compute next wavefront starting point
-    edit_wavefronts_compute_wavefront(
-        wavefronts,distance+1);
-  }
-
-  (*score) = distance;
-
-  // Backtrace wavefronts
-  wavefronts->edit_cigar_length = edit_wavefronts_backtrace(wavefronts,target_k,distance);
-}
-
-bool edit_wavefronts_check(
-  const char* const cigar,
-  const int cigar_length,
-  const int score, 
-  const char* const filename) {
-  
-  FILE* ref_file = fopen(filename, "r");
-  if (ref_file == NULL) {
-    PRINTF_ERROR("Error while opening check file %s\n", filename);
-    return false;
-  }
-
-  // Read reference score
-  int score_ref;
-  if (fscanf(ref_file, "%d", &score_ref) != 1) {
-    PRINTF_ERROR("Error while reading reference score in check file %s\n", filename);
-    return false;
-  }  
-
-  // Check score
-  if (score != score_ref) {
-    PRINTF_ERROR("Check has failed: reference score != result score\n");
-    PRINTF_ERROR("Reference score: %d\n", score_ref);
-    PRINTF_ERROR("Result score: %d\n", score);
-    return false;
+    sequence_batch_t* const batch,
+    const int begin,
+    const int end,
+    const bool score_only,
+    const bool biwfa,
+    const bool compact_backtrace,
+    const bool inter_pair,
+    const int min_offset_width) {
+  ewf_lanes_t lanes[EWF_OFFSET_WIDTHS];
+  int i;
+  for (i=0;i<EWF_OFFSET_WIDTHS;++i) {
+    lanes[i].num_lanes = 0;
   }
-
-  fgetc(ref_file); // Skip newline
-
-  char ref_ch;
-  int i = 0;
-  while ((ref_ch = fgetc(ref_file)) != EOF && ref_ch != '\n' && i < cigar_length) {
-    if(ref_ch != cigar[i]){
-      PRINTF_ERROR("Check has failed: reference CIGAR != result CIGAR at position %d\n", i);
-      PRINTF_ERROR("Reference CIGAR: %c\n", ref_ch);
-      PRINTF_ERROR("Result CIGAR: %c\n", cigar[i]);
-      return false;
+  for (i=begin;i<end;++i) {
+    const char* const pattern = batch->patterns[i];
+    const int pattern_length = batch->pattern_lengths[i];
+    const char* const text = batch->texts[i];
+    const int text_length = batch->text_lengths[i];
+    // Select packed or character sequences
+    ewf_packed_pair_t packed_pair;
+    wavefronts->packed = NULL;
+    if (batch->packed != NULL && batch->packed_offsets[i] != PACKED_ESCAPED) {
+      packed_pair.pattern = pattern;
+      packed_pair.pattern_packed = batch->packed + batch->packed_offsets[i] + 1;
+      packed_pair.text = text;
+      packed_pair.text_packed = packed_pair.pattern_packed + PACKED_WORDS(pattern_length);
+      wavefronts->packed = &packed_pair;
+    }
+    // Filter
+    if (wavefronts->filter &&
+        edit_wavefronts_filter(pattern,pattern_length,text,text_length,wavefronts->max_score)) {
+      ++(wavefronts->num_pairs_filtered);
+      batch->scores[i] = EWF_SCORE_UNALIGNED;
+      batch->cigar_lengths[i] = 0;
+      continue;
+    }
+    // Gather short pairs in the lanes of their width (aligned once all lanes are taken)
+    if (inter_pair && MAX(pattern_length,text_length) <= INTER_PAIR_MAX_LENGTH) {
+      const int width = wfa_edit_wavefronts_lanes_offset_width(wavefronts,pattern_length,text_length,min_offset_width);
+      ++(wavefronts->num_pairs_width[width]);
+      ewf_lanes_t* const width_lanes = &lanes[width];
+      const int lane = width_lanes->num_lanes++;
+      width_lanes->patterns[lane] = pattern;
+      width_lanes->pattern_lengths[lane] = pattern_length;
+      width_lanes->texts[lane] = text;
+      width_lanes->text_lengths[lane] = text_length;
+      width_lanes->packed[lane] = NULL;
+      if (wavefronts->packed != NULL) {
+        width_lanes->packed_pairs[lane] = packed_pair;
+        width_lanes->packed[lane] = &width_lanes->packed_pairs[lane];
+      }
+      width_lanes->scores[lane] = batch->scores + i;
+      width_lanes->cigars[lane] = batch->cigars + batch->offsets[i];
+      width_lanes->cigar_lengths[lane] = batch->cigar_lengths + i;
+      if (width_lanes->num_lanes == INTER_PAIR_LANES(width)) {
+        wfa_edit_wavefronts_align_lanes(wavefronts,width_lanes,width,score_only);
+      }
+      continue;
     }
+    // Align (narrowest offsets fitting the pair)
+    wfa_edit_wavefronts_align_pair(wavefronts,pattern,pattern_length,text,text_length,
+        score_only,biwfa,compact_backtrace,min_offset_width,batch->scores+i);
+    // Store CIGAR
+    memcpy(batch->cigars+batch->offsets[i],wavefronts->edit_cigar,wavefronts->edit_cigar_length);
+    batch->cigar_lengths[i] = wavefronts->edit_cigar_length;
   }
-
-  // Check CIGAR length
-  if (ref_ch != EOF || i != cigar_length) {
-    PRINTF_ERROR("Check has failed: reference CIGAR length != result CIGAR length\n");
-    return false;
+  wavefronts->packed = NULL;
+  // Align the lanes left
+  for (i=0;i<EWF_OFFSET_WIDTHS;++i) {
+    wfa_edit_wavefronts_align_lanes(wavefronts,&lanes[i],i,score_only);
   }
-
-  // Return
-  return true;
-
 }
 
-int edit_wavefronts_write_result(
-  const char* const cigar,
-  const int cigar_length,
-  const int score,
-  const char* const filename) {
-  
-  FILE* result_file = fopen(filename, "w");
-  if (result_file == NULL) {
-    PRINTF_ERROR("Error while opening result file %s\n", filename);
-    return EXIT_FAILURE;
+/*
+ * Verify the results of pairs [begin,end) of a batch (one task per chunk)
+ *   The pairs of the batch are numbered from first_pair
+ */
+OSS("oss task")
+void check_references_verify_batch_chunk(
+    const check_references_t* const references,
+    sequence_batch_t* const batch,
+    const int first_pair,
+    const int begin,
+    const int end,
+    const bool score_only,
+    const bool heuristic) {
+  int i;
+  for (i=begin;i<end;++i) {
+    batch->check_status[i] = check_references_verify(references,first_pair+i,
+        batch->patterns[i],batch->pattern_lengths[i],batch->texts[i],batch->text_lengths[i],
+        score_only ? NULL : batch->cigars+batch->offsets[i],batch->cigar_lengths[i],batch->scores[i],heuristic);
   }
-
-  fprintf(result_file, "%d\n", score);
-  fwrite(cigar, sizeof(char), cigar_length, result_file);
-  fclose(result_file);
-
-  return EXIT_SUCCESS;
-
 }
 
 // Display usage information
@@ -358,8 +395,31 @@ int usage(char* name){
   PRINTF_ERROR("\tREPS: number of reps to execute WFA, value must be between 0 and %d, default (0) \n", INT32_MAX);
   PRINTF_ERROR("\tDEBUG: print debug information, 0 -> inactive, 1 -> active, default (0) \n");
   PRINTF_ERROR("\tTIMES: print timing information, 0 -> inactive, 1 -> active, default (0) \n");
-  PRINTF_ERROR("\tCHECK: file to check the results\n");
-  PRINTF_ERROR("\tWRITE_RESULT: file to write the results\n");
+  PRINTF_ERROR("\tSCORE_ONLY: compute only the edit distance (no CIGAR) with O(s) memory, 0 -> inactive, 1 -> active, default (0) \n");
+  PRINTF_ERROR("\tBIWFA: align with bidirectional WFA (full CIGAR with O(s) memory), 0 -> inactive, 1 -> active, default (0) \n");
+  PRINTF_ERROR("\tCOMPACT_BACKTRACE: regular WFA keeps 2 bits per cell (winning operation) instead of every offset, re-extending matches in the backtrace, 0 -> inactive, 1 -> active, default (0) \n");
+  PRINTF_ERROR("\tREDUCTION: adaptive wavefront reduction (regular WFA, may be suboptimal, CHECK reports the accuracy cost), 0 -> inactive, 1 -> active, default (0) \n");
+  PRINTF_ERROR("\tREDUCTION_MIN_LENGTH: wavefronts up to this width are not reduced, value must be between 1 and %d, default (%d) \n", INT32_MAX, DEFAULT_REDUCTION_MIN_LENGTH);
+  PRINTF_ERROR("\tREDUCTION_MAX_DISTANCE: diagonals this much further from the target than the best one are dropped, value must be between 0 and %d, default (%d) \n", INT32_MAX, DEFAULT_REDUCTION_MAX_DISTANCE);
+  PRINTF_ERROR("\tMAX_SCORE: distance budget, pairs above it stop early and get score %d (unaligned), value must be between 0 and %d, default (unbounded) \n", EWF_SCORE_UNALIGNED, INT32_MAX);
+  PRINTF_ERROR("\tFILTER: pairs whose q-gram lower bound is above MAX_SCORE get score %d (unaligned) without running WFA, 0 -> inactive, 1 -> active, default (0) \n", EWF_SCORE_UNALIGNED);
+  PRINTF_ERROR("\tINTER_PAIR: align pairs up to %dbp together, one per vector lane (%d/%d/%d pairs of 8/16/32-bit offsets), regular WFA or score only, 0 -> inactive, 1 -> active, default (0) \n", INTER_PAIR_MAX_LENGTH, INTER_PAIR_LANES(EWF_OFFSET_WIDTH_8), INTER_PAIR_LANES(EWF_OFFSET_WIDTH_16), INTER_PAIR_LANES(EWF_OFFSET_WIDTH_32));
+  PRINTF_ERROR("\tCHECK: file with the reference results (run-length CIGARs, or former backwards CIGARs), loaded once and compared with every rep, mismatches are summarized\n");
+  PRINTF_ERROR("\tCHECK_STRICT: CIGARs compared byte for byte with the reference instead of replayed on their pair (equally optimal ones fail), 0 -> inactive, 1 -> active, default (0) \n");
+  PRINTF_ERROR("\tWRITE_RESULT: file to write the results of the first rep (buffered, written by a background thread)\n");
+  PRINTF_ERROR("\tRESULT_FORMAT: format of the results, text -> score and run-length CIGAR lines (e.g. 12M1X3M), paf -> PAF lines (text as query, NM and cg tags), binary -> score and CIGAR runs, default (text) \n");
+  PRINTF_ERROR("\tINPUT: file with the sequence pairs to align ('>pattern' and '<text' lines, may be gzip or BGZF compressed), aligned once per rep\n");
+  PRINTF_ERROR("\tINPUT_THREADS: threads inflating a BGZF input (other gzip inputs use one), value must be between 1 and %d, default (%d) \n", INFLATE_MAX_THREADS, DEFAULT_INPUT_THREADS);
+  PRINTF_ERROR("\tBATCH_SIZE: number of pairs read and aligned at once, value must be between 1 and %d, default (%d) \n", INT32_MAX, DEFAULT_BATCH_SIZE);
+  PRINTF_ERROR("\tTASK_SIZE: number of pairs aligned by each task, value must be between 1 and %d, default (%d) \n", INT32_MAX, DEFAULT_TASK_SIZE);
+  PRINTF_ERROR("\tPACKED: align ACGT pairs on 2-bit packed sequences (others on characters), 0 -> inactive, 1 -> active, default (0) \n");
+  PRINTF_ERROR("\tEXTEND: match extension kernel, auto -> widest supported, word -> 8 bytes, avx2 -> 32 bytes, avx512 -> 64 bytes, default (auto) \n");
+  PRINTF_ERROR("\tCOMPUTE: wavefront compute kernel, auto -> widest supported, peeled -> scalar with loop peeling, scalar -> scalar on sentinels, avx2 -> 32 bytes, avx512 -> 64 bytes, default (auto) \n");
+  PRINTF_ERROR("\tOFFSET_WIDTH: narrowest offset width, each pair uses the narrowest one fitting it (8 bits up to ~63bp, 16 bits up to ~16Kbp), auto, 8, 16 or 32, default (auto) \n");
+  PRINTF_ERROR("\tCOMPUTE_BENCH: only benchmark the compute kernels (cells/s) on a wavefront of this width, value must be between 1 and %d\n", INT16_MAX);
+#ifdef EWF_STATS
+  PRINTF_ERROR("\tSTATS: file to append the hot-path statistics of each rep (JSON lines), they are printed anyway\n");
+#endif
   PRINTF_ERROR("\n");
 
   return EXIT_FAILURE;
@@ -441,6 +501,157 @@ int main(int argc,char* argv[]) {
   const bool times = aux_times;
 
 
+  // Bool SCORE_ONLY variable
+  const char* sscore_only = getenv("SCORE_ONLY");
+  bool aux_score_only = false;
+  if (sscore_only != NULL) {
+    if (!strcmp(sscore_only,"0")){
+      aux_score_only = false;
+    }
+    else if(!strcmp(sscore_only,"1")){
+      aux_score_only = true;
+    }
+    else{
+      PRINTF_ERROR("Invalid value for SCORE_ONLY\n");
+      return usage(name);
+    }
+  }
+  const bool score_only = aux_score_only;
+
+
+  // Bool BIWFA variable
+  const char* sbiwfa = getenv("BIWFA");
+  bool aux_biwfa = false;
+  if (sbiwfa != NULL) {
+    if (!strcmp(sbiwfa,"0")){
+      aux_biwfa = false;
+    }
+    else if(!strcmp(sbiwfa,"1")){
+      aux_biwfa = true;
+    }
+    else{
+      PRINTF_ERROR("Invalid value for BIWFA\n");
+      return usage(name);
+    }
+  }
+  const bool biwfa = aux_biwfa;
+
+
+  // Bool COMPACT_BACKTRACE variable
+  const char* scompact_backtrace = getenv("COMPACT_BACKTRACE");
+  bool aux_compact_backtrace = false;
+  if (scompact_backtrace != NULL) {
+    if (!strcmp(scompact_backtrace,"0")){
+      aux_compact_backtrace = false;
+    }
+    else if(!strcmp(scompact_backtrace,"1")){
+      aux_compact_backtrace = true;
+    }
+    else{
+      PRINTF_ERROR("Invalid value for COMPACT_BACKTRACE\n");
+      return usage(name);
+    }
+  }
+  const bool compact_backtrace = aux_compact_backtrace && !score_only && !biwfa;
+
+
+  // Bool REDUCTION variable
+  const char* sreduction = getenv("REDUCTION");
+  bool aux_reduction = false;
+  if (sreduction != NULL) {
+    if (!strcmp(sreduction,"0")){
+      aux_reduction = false;
+    }
+    else if(!strcmp(sreduction,"1")){
+      aux_reduction = true;
+    }
+    else{
+      PRINTF_ERROR("Invalid value for REDUCTION\n");
+      return usage(name);
+    }
+  }
+
+
+  // Int REDUCTION_MIN_LENGTH variable
+  const char* sreduction_min_length = getenv("REDUCTION_MIN_LENGTH");
+  int aux_reduction_min_length = DEFAULT_REDUCTION_MIN_LENGTH;
+  if (sreduction_min_length != NULL) {
+    int aux = atoi(sreduction_min_length);
+    if (aux <= 0){
+      PRINTF_ERROR("Invalid value for REDUCTION_MIN_LENGTH\n");
+      return usage(name);
+    }
+    aux_reduction_min_length = aux;
+  }
+
+
+  // Int REDUCTION_MAX_DISTANCE variable
+  const char* sreduction_max_distance = getenv("REDUCTION_MAX_DISTANCE");
+  int aux_reduction_max_distance = DEFAULT_REDUCTION_MAX_DISTANCE;
+  if (sreduction_max_distance != NULL) {
+    int aux = atoi(sreduction_max_distance);
+    if (aux < 0){
+      PRINTF_ERROR("Invalid value for REDUCTION_MAX_DISTANCE\n");
+      return usage(name);
+    }
+    aux_reduction_max_distance = aux;
+  }
+  const ewf_reduction_t reduction = {
+      .enabled = aux_reduction && !score_only && !biwfa,
+      .min_wavefront_length = aux_reduction_min_length,
+      .max_distance_threshold = aux_reduction_max_distance};
+
+
+  // Int MAX_SCORE variable
+  const char* smax_score = getenv("MAX_SCORE");
+  int aux_max_score = INT32_MAX; // Unbounded
+  if (smax_score != NULL) {
+    int aux = atoi(smax_score);
+    if (aux < 0){
+      PRINTF_ERROR("Invalid value for MAX_SCORE\n");
+      return usage(name);
+    }
+    aux_max_score = aux;
+  }
+  const int max_score = aux_max_score;
+
+
+  // Bool FILTER variable
+  const char* sfilter = getenv("FILTER");
+  bool aux_filter = false;
+  if (sfilter != NULL) {
+    if (!strcmp(sfilter,"0")){
+      aux_filter = false;
+    }
+    else if(!strcmp(sfilter,"1")){
+      aux_filter = true;
+    }
+    else{
+      PRINTF_ERROR("Invalid value for FILTER\n");
+      return usage(name);
+    }
+  }
+  const bool filter = aux_filter && max_score != INT32_MAX;
+
+
+  // Bool INTER_PAIR variable
+  const char* sinter_pair = getenv("INTER_PAIR");
+  bool aux_inter_pair = false;
+  if (sinter_pair != NULL) {
+    if (!strcmp(sinter_pair,"0")){
+      aux_inter_pair = false;
+    }
+    else if(!strcmp(sinter_pair,"1")){
+      aux_inter_pair = true;
+    }
+    else{
+      PRINTF_ERROR("Invalid value for INTER_PAIR\n");
+      return usage(name);
+    }
+  }
+  const bool inter_pair = aux_inter_pair && !biwfa && !compact_backtrace && !reduction.enabled;
+
+
   // String CHECK variable
   const char* scheck = getenv("CHECK");
   if (scheck != NULL){
@@ -459,6 +670,24 @@ int main(int argc,char* argv[]) {
   const bool check = (cfilename != NULL);
 
 
+  // Bool CHECK_STRICT variable
+  const char* scheck_strict = getenv("CHECK_STRICT");
+  bool aux_check_strict = false;
+  if (scheck_strict != NULL) {
+    if (!strcmp(scheck_strict,"0")){
+      aux_check_strict = false;
+    }
+    else if(!strcmp(scheck_strict,"1")){
+      aux_check_strict = true;
+    }
+    else{
+      PRINTF_ERROR("Invalid value for CHECK_STRICT\n");
+      return usage(name);
+    }
+  }
+  const bool check_strict = aux_check_strict;
+
+
   // String WRITE_RESULT variable
   const char* swrite_result = getenv("WRITE_RESULT");
   if (swrite_result != NULL){
@@ -472,6 +701,172 @@ int main(int argc,char* argv[]) {
   const char* rfilename = swrite_result;
   const bool write_result = (rfilename != NULL);
 
+
+  // String RESULT_FORMAT variable
+  const char* sresult_format = getenv("RESULT_FORMAT");
+  result_format_t aux_result_format = RESULT_FORMAT_TEXT;
+  if (sresult_format != NULL) {
+    if (!strcmp(sresult_format,"text")) {
+      aux_result_format = RESULT_FORMAT_TEXT;
+    }
+    else if (!strcmp(sresult_format,"paf")) {
+      aux_result_format = RESULT_FORMAT_PAF;
+    }
+    else if (!strcmp(sresult_format,"binary")) {
+      aux_result_format = RESULT_FORMAT_BINARY;
+    }
+    else {
+      PRINTF_ERROR("Invalid value for RESULT_FORMAT\n");
+      return usage(name);
+    }
+  }
+  const result_format_t result_format = aux_result_format;
+
+
+  // String INPUT variable
+  const char* sinput = getenv("INPUT");
+  if (sinput != NULL){
+    if (access(sinput, F_OK) == 0){
+      if (access(sinput, R_OK) != 0){
+        PRINTF_ERROR("Input file %s is not readable\n", sinput);
+        return EXIT_FAILURE;
+      }
+    }
+    else{
+      PRINTF_ERROR("Input file %s does not exist\n", sinput);
+      return EXIT_FAILURE;
+    }
+  }
+  const char* ifilename = sinput;
+  const bool input = (ifilename != NULL);
+
+
+  // Int INPUT_THREADS variable
+  const char* sinput_threads = getenv("INPUT_THREADS");
+  int aux_input_threads = DEFAULT_INPUT_THREADS;
+  if (sinput_threads != NULL) {
+    int aux = atoi(sinput_threads);
+    if (aux <= 0 || aux > INFLATE_MAX_THREADS){
+      PRINTF_ERROR("Invalid value for INPUT_THREADS\n");
+      return usage(name);
+    }
+    aux_input_threads = aux;
+  }
+  const int input_threads = aux_input_threads;
+
+
+  // Int BATCH_SIZE variable
+  const char* sbatch_size = getenv("BATCH_SIZE");
+  int aux_batch_size = DEFAULT_BATCH_SIZE;
+  if (sbatch_size != NULL) {
+    int aux = atoi(sbatch_size);
+    if (aux <= 0){
+      PRINTF_ERROR("Invalid value for BATCH_SIZE\n");
+      return usage(name);
+    }
+    aux_batch_size = aux;
+  }
+  const int batch_size = aux_batch_size;
+
+
+  // Int TASK_SIZE variable
+  const char* stask_size = getenv("TASK_SIZE");
+  int aux_task_size = DEFAULT_TASK_SIZE;
+  if (stask_size != NULL) {
+    int aux = atoi(stask_size);
+    if (aux <= 0){
+      PRINTF_ERROR("Invalid value for TASK_SIZE\n");
+      return usage(name);
+    }
+    aux_task_size = aux;
+  }
+  const int task_size = aux_task_size;
+
+
+  // Bool PACKED variable
+  const char* spacked = getenv("PACKED");
+  bool aux_packed = false;
+  if (spacked != NULL) {
+    if (!strcmp(spacked,"0")){
+      aux_packed = false;
+    }
+    else if(!strcmp(spacked,"1")){
+      aux_packed = true;
+    }
+    else{
+      PRINTF_ERROR("Invalid value for PACKED\n");
+      return usage(name);
+    }
+  }
+  const bool packed = aux_packed;
+
+
+  // String EXTEND variable
+  const char* sextend = getenv("EXTEND");
+  const char* const extend = wfa_edit_select_extend_kernels(sextend);
+  if (extend == NULL) {
+    PRINTF_ERROR("Invalid or unsupported value for EXTEND\n");
+    return usage(name);
+  }
+
+
+  // String COMPUTE variable
+  const char* scompute = getenv("COMPUTE");
+  const char* const compute = wfa_edit_select_compute_kernel(scompute);
+  if (compute == NULL) {
+    PRINTF_ERROR("Invalid or unsupported value for COMPUTE\n");
+    return usage(name);
+  }
+
+
+  // String OFFSET_WIDTH variable
+  const char* soffset_width = getenv("OFFSET_WIDTH");
+  int aux_offset_width = EWF_OFFSET_WIDTH_8;
+  if (soffset_width != NULL) {
+    if(!strcmp(soffset_width,"auto") || !strcmp(soffset_width,"8")){
+      aux_offset_width = EWF_OFFSET_WIDTH_8;
+    }
+    else if(!strcmp(soffset_width,"16")){
+      aux_offset_width = EWF_OFFSET_WIDTH_16;
+    }
+    else if(!strcmp(soffset_width,"32")){
+      aux_offset_width = EWF_OFFSET_WIDTH_32;
+    }
+    else{
+      PRINTF_ERROR("Invalid value for OFFSET_WIDTH\n");
+      return usage(name);
+    }
+  }
+  const int min_offset_width = aux_offset_width;
+
+
+  // Int COMPUTE_BENCH variable
+  const char* scompute_bench = getenv("COMPUTE_BENCH");
+  if (scompute_bench != NULL) {
+    int aux = atoi(scompute_bench);
+    if (aux <= 0 || aux > INT16_MAX){
+      PRINTF_ERROR("Invalid value for COMPUTE_BENCH\n");
+      return usage(name);
+    }
+    wfa_edit_compute_benchmark(aux);
+    return EXIT_SUCCESS;
+  }
+
+
+#ifdef EWF_STATS
+  // String STATS variable
+  const char* sstats = getenv("STATS");
+  if (sstats != NULL){
+    if (access(sstats, F_OK) == 0){
+      if (access(sstats, W_OK) != 0){
+        PRINTF_ERROR("File %s is not writable\n", sstats);
+        return EXIT_FAILURE;
+      }
+    }
+  }
+  const char* sfilename = sstats;
+#endif
+
   // --------------------------------------------------------------------------------------------------------
 
 
@@ -486,10 +881,34 @@ int main(int argc,char* argv[]) {
       "YYYYYYYYYYYYYYYYYYYYYYYYYYYYYYYYYYYYYYYYYYYYYYYYYYYYYYYYYYYYYYYY";
 
   // Pattern & Text
-  char* pattern = pattern_mem + 64;
-  char* text = text_mem + 64;
-  const int pattern_length = strlen(pattern_mem)-2*64;
-  const int text_length = strlen(text_mem)-2*64;
+  char* pattern = pattern_mem + SEQUENCE_PADDING;
+  char* text = text_mem + SEQUENCE_PADDING;
+  const int pattern_length = strlen(pattern_mem)-2*SEQUENCE_PADDING;
+  const int text_length = strlen(text_mem)-2*SEQUENCE_PADDING;
+
+  // Files
+  sequence_reader_t reader;
+  if (input && sequence_reader_open(&reader,ifilename,input_threads)) {
+    return EXIT_FAILURE;
+  }
+  check_references_t references;
+  if (check && check_references_load(&references,cfilename,check_strict)) {
+    return EXIT_FAILURE;
+  }
+  result_writer_t result_writer;
+  if (write_result && result_writer_open(&result_writer,rfilename,result_format)) {
+    return EXIT_FAILURE;
+  }
+#ifdef EWF_STATS
+  FILE* stats_file = NULL;
+  if (sfilename != NULL){
+    stats_file = fopen(sfilename, "a");
+    if (stats_file == NULL) {
+      PRINTF_ERROR("Error while opening stats file %s\n", sfilename);
+      return EXIT_FAILURE;
+    }
+  }
+#endif
 
   PRINTF("#######################################################################################\n");
   PRINTF("Configuration summary:\n");
@@ -499,86 +918,224 @@ int main(int argc,char* argv[]) {
   PRINTF("\tRepetitions: %d\n",reps);
   PRINTF("\tDebug: %d\n",debug);
   PRINTF("\tTimes: %d\n",times);
-  PRINTF_COND(check,"\tCheck results from filename: %s\n",cfilename);
+  PRINTF("\tScore only: %d\n",score_only);
+  PRINTF("\tBiWFA: %d\n",biwfa);
+  PRINTF("\tCompact backtrace: %d\n",compact_backtrace);
+  PRINTF_COND(max_score != INT32_MAX,"\tMax score: %d\n",max_score);
+  PRINTF_COND(filter,"\tFilter: %d-gram lower bound\n",FILTER_QGRAM_LENGTH);
+  PRINTF_COND(inter_pair,"\tInter-pair lanes: pairs up to %dbp\n",INTER_PAIR_MAX_LENGTH);
+  PRINTF_COND(reduction.enabled,"\tReduction: min length %d, max distance %d\n",
+      reduction.min_wavefront_length,reduction.max_distance_threshold);
+  PRINTF_COND(check,"\tCheck results from filename: %s (%d references)\n",cfilename,references.num_pairs);
+  PRINTF_COND(check,"\tCheck CIGARs: %s\n",check_strict ? "compared with the reference" : "replayed on their pair");
   PRINTF_COND(write_result,"\tWrite result to filename: %s\n",rfilename);
+  PRINTF_COND(write_result,"\tResult format: %s\n",
+      (result_format == RESULT_FORMAT_PAF) ? "paf" : (result_format == RESULT_FORMAT_BINARY) ? "binary" : "text");
+  PRINTF_COND(input,"\tInput sequences from filename: %s\n",ifilename);
+  PRINTF_COND(input,"\tInput memory-mapped: %d\n",input && reader.map != NULL);
+  PRINTF_COND(input && reader.compressed,"\tInput compressed: %s, %d inflate threads\n",reader.bgzf ? "BGZF" : "gzip",reader.num_threads);
+  PRINTF("\tBatch size: %d\n",batch_size);
+  PRINTF("\tTask size: %d\n",task_size);
+  PRINTF("\tPacked: %d\n",packed);
+  PRINTF("\tExtend kernel: %s\n",extend);
+  PRINTF("\tCompute kernel: %s\n",compute);
+  PRINTF("\tOffset width: %d bits or wider\n",8<<min_offset_width);
+#ifdef EWF_STATS
+  PRINTF("\tHot-path statistics: 1\n");
+  PRINTF_COND(sfilename != NULL,"\tWrite statistics to filename: %s\n",sfilename);
+#endif
 
   PRINTF("\n");
-  PRINTF("Pattern length: %d\n",pattern_length);
-  PRINTF("Text length: %d\n",text_length);
-  PRINTF("\n");
+  PRINTF_COND(!input,"Pattern length: %d\n",pattern_length);
+  PRINTF_COND(!input,"Text length: %d\n",text_length);
+  PRINTF_COND(!input,"\n");
 
   PRINTF("#######################################################################################\n");
   PRINTF("\n");
 
-  edit_wavefronts_t wavefronts;
+  // One wavefronts set per task of a batch
+  const int num_tasks = (batch_size + task_size - 1) / task_size;
+  edit_wavefronts_t* const wavefronts = malloc(num_tasks*sizeof(edit_wavefronts_t));
+  if (wavefronts == NULL) {
+    PRINTF_ERROR("Allocation of wavefronts failed\n");
+    return EXIT_FAILURE;
+  }
+  sequence_batch_t batch;
+  if (sequence_batch_init(&batch,batch_size,packed)) {
+    return EXIT_FAILURE;
+  }
 
-  // Initialize Wavefronts
+  // Initialize Wavefronts (resized on demand for input pairs)
   PRINTF("\nInitializing wavefronts\n");
   const double tStartInit = wall_time();
-  edit_wavefronts_init(&wavefronts,pattern_length,text_length);
+  int t;
+  for (t=0;t<num_tasks;++t) {
+    if (wfa_edit_wavefronts_init(wavefronts+t,pattern_length,text_length,max_score,reduction,filter)) return EXIT_FAILURE;
+  }
   const double tEndInit = wall_time();
   PRINTF("Wavefronts initialized\n");
   PRINTF_COND(times,"Init time: %f\n", tEndInit-tStartInit);
 
   int i;
-  int score = 0;
+  bool check_failed = false;
   for (i=0;i<reps;++i) {
 
     PRINTF("\n---------------------------------------------------------------------------------------\n");
 
     PRINTF("\nRepetition: %d\n",i);
 
-    // Clean Wavefronts Offsets
-    PRINTF("\nCleaning wavefronts offsets...\n");
-    const double tStartClean = wall_time();
-    edit_wavefronts_clean(&wavefronts);
-    const double tEndClean = wall_time();
-    PRINTF("Cleaning finished\n");
-    PRINTF_COND(times,"Clean time: %f\n", tEndClean-tStartClean);
+    if (input) sequence_reader_rewind(&reader);
 
-    // Align Wavefronts
+    // Align all pairs (a single one if there is no input file)
     PRINTF("\nAligning...\n");
-    const double tStartAlign = wall_time();
-    edit_wavefronts_align(&wavefronts,pattern,pattern_length,text,text_length,&score);
-    const double tEndAlign = wall_time();
-    PRINTF("Alignment finished\n");
-    PRINTF_COND(times,"WFA execution time: %f\n",tEndAlign-tStartAlign);
-
-    // Check results
-    PRINTF_COND(check,"\nChecking results...\n");
-    const double tStartCheck = wall_time();
-    if (check){
-      if(edit_wavefronts_check(wavefronts.edit_cigar,wavefronts.edit_cigar_length,score,cfilename)) {
+    double tRead = 0.0, tAlign = 0.0, tCheck = 0.0, tWrite = 0.0;
+    int num_alignments = 0, num_escaped = 0, num_unaligned = 0, num_reported = 0;
+    int check_counts[CHECK_STATUSES] = {0};
+    long score_excess = 0;
+    const double tStartBatch = wall_time();
+    while (true) {
+
+      // Fetch batch
+      const double tStartRead = wall_time();
+      if (input) {
+        if (sequence_reader_read_batch(&reader,&batch) < 0) return EXIT_FAILURE;
+      }
+      else {
+        sequence_batch_clear(&batch);
+        if (num_alignments == 0 &&
+            sequence_batch_add(&batch,pattern,pattern_length,text,text_length,true)) return EXIT_FAILURE;
+      }
+      const double tEndRead = wall_time();
+      tRead += tEndRead-tStartRead;
+      if (batch.num_pairs == 0) break;
+
+      // Align Wavefronts
+      const double tStartAlign = wall_time();
+      int begin;
+      for (begin=0,t=0;begin<batch.num_pairs;begin+=task_size,++t) {
+        const int end = MIN(begin+task_size,batch.num_pairs);
+        edit_wavefronts_align_batch_chunk(wavefronts+t,&batch,begin,end,score_only,biwfa,compact_backtrace,inter_pair,min_offset_width);
+      }
+      OSS("oss taskwait")
+      const double tEndAlign = wall_time();
+      tAlign += tEndAlign-tStartAlign;
+      int num_failed = 0;
+      for (t=0;t<num_tasks;++t) {
+        num_failed += wavefronts[t].num_pairs_failed;
+      }
+      if (num_failed > 0) {
+        PRINTF_ERROR("Alignment of %d pairs failed (allocation of wavefronts)\n", num_failed);
         return EXIT_FAILURE;
       }
-    }
-    PRINTF_COND(check,"Check finished\n");
-    const double tEndCheck = wall_time();
-    PRINTF_COND(check && times,"Check results time: %f\n", tEndCheck-tStartCheck);
 
-    // Write results
-    PRINTF_COND(write_result,"\nWriting results...\n");
-    const double tStartWrite = wall_time();
-    if (write_result){
-      if(edit_wavefronts_write_result(wavefronts.edit_cigar,wavefronts.edit_cigar_length,score,rfilename)){
-        return EXIT_FAILURE;
+      // Verify results (heuristic scores are only compared with the reference)
+      const double tStartCheck = wall_time();
+      if (check) {
+        for (begin=0;begin<batch.num_pairs;begin+=task_size) {
+          const int end = MIN(begin+task_size,batch.num_pairs);
+          check_references_verify_batch_chunk(&references,&batch,num_alignments,begin,end,score_only,reduction.enabled);
+        }
+        OSS("oss taskwait")
+      }
+      const double tEndCheck = wall_time();
+      tCheck += tEndCheck-tStartCheck;
+
+      // Gather checks and write results (in input order)
+      int j;
+      for (j=0;j<batch.num_pairs;++j) {
+        const char* const cigar = batch.cigars + batch.offsets[j];
+
+        // Gather checks
+        if (check) {
+          const int status = batch.check_status[j];
+          ++check_counts[status];
+          if (status == CHECK_SUBOPTIMAL && batch.scores[j] != EWF_SCORE_UNALIGNED) {
+            score_excess += batch.scores[j] - references.scores[num_alignments+j];
+          }
+          if (status != CHECK_OK && status != CHECK_SUBOPTIMAL && num_reported++ < CHECK_MAX_REPORTED) {
+            check_references_report(&references,num_alignments+j,status,batch.patterns[j],batch.pattern_lengths[j],
+                batch.texts[j],batch.text_lengths[j],cigar,batch.cigar_lengths[j],batch.scores[j],reduction.enabled);
+          }
+        }
+
+        // Write results
+        const double tStartWrite = wall_time();
+        if (write_result && !i){
+          if(result_writer_write(&result_writer,cigar,batch.cigar_lengths[j],batch.scores[j],
+              batch.pattern_lengths[j],batch.text_lengths[j])){
+            return EXIT_FAILURE;
+          }
+        }
+        const double tEndWrite = wall_time();
+        tWrite += tEndWrite-tStartWrite;
+
+        num_unaligned += (batch.scores[j] == EWF_SCORE_UNALIGNED);
+      }
+      num_alignments += batch.num_pairs;
+      num_escaped += batch.num_escaped;
+
+    }
+    const double tEndBatch = wall_time();
+    int num_pairs_width[EWF_OFFSET_WIDTHS] = {0,0,0}, num_filtered = 0, num_lanes = 0;
+    for (t=0;t<num_tasks;++t) {
+      num_filtered += wavefronts[t].num_pairs_filtered;
+      wavefronts[t].num_pairs_filtered = 0;
+      num_lanes += wavefronts[t].num_pairs_lanes;
+      wavefronts[t].num_pairs_lanes = 0;
+      int w;
+      for (w=0;w<EWF_OFFSET_WIDTHS;++w) {
+        num_pairs_width[w] += wavefronts[t].num_pairs_width[w];
+        wavefronts[t].num_pairs_width[w] = 0;
       }
     }
-    PRINTF_COND(write_result,"Results written\n");
-    const double tEndWrite = wall_time();
-    PRINTF_COND(write_result && times,"Write results time: %f\n", tEndWrite-tStartWrite);
+#ifdef EWF_STATS
+    ewf_stats_t stats;
+    memset(&stats,0,sizeof(ewf_stats_t));
+    for (t=0;t<num_tasks;++t) {
+      wfa_edit_stats_merge(&stats,&wavefronts[t].stats);
+      memset(&wavefronts[t].stats,0,sizeof(ewf_stats_t));
+    }
+#endif
+    PRINTF("Alignment finished\n");
+    PRINTF_COND(input,"Alignments: %d\n",num_alignments);
+    PRINTF_COND(input && packed,"Escaped alignments (non-ACGT): %d\n",num_escaped);
+    PRINTF_COND(input,"Offset widths (8/16/32 bits): %d/%d/%d\n",
+        num_pairs_width[EWF_OFFSET_WIDTH_8],num_pairs_width[EWF_OFFSET_WIDTH_16],num_pairs_width[EWF_OFFSET_WIDTH_32]);
+    PRINTF_COND(input && max_score != INT32_MAX,"Unaligned alignments (above max score): %d\n",num_unaligned);
+    PRINTF_COND(input && filter,"Filtered alignments (q-gram bound above max score): %d\n",num_filtered);
+    PRINTF_COND(input && inter_pair,"Inter-pair alignments (vector lanes): %d\n",num_lanes);
+    PRINTF_COND(check && reduction.enabled,"Suboptimal alignments (reduction): %d (%.2f%%), score excess %ld (%.4f per alignment)\n",
+        check_counts[CHECK_SUBOPTIMAL],100.0*check_counts[CHECK_SUBOPTIMAL]/MAX(num_alignments,1),score_excess,(double)score_excess/MAX(num_alignments,1));
+    const int num_mismatches = num_alignments - check_counts[CHECK_OK] - check_counts[CHECK_SUBOPTIMAL];
+    PRINTF_COND(check,"Check mismatches: %d (scores %d, CIGARs %d, below reference %d, without reference %d)\n",
+        num_mismatches,check_counts[CHECK_SCORE],check_counts[CHECK_CIGAR],check_counts[CHECK_BELOW],check_counts[CHECK_MISSING]);
+    check_failed |= check && num_mismatches > 0;
+    PRINTF_COND(input && times,"Read time: %f\n",tRead);
+    PRINTF_COND(times,"WFA execution time: %f\n",tAlign);
+    PRINTF_COND(check && times,"Check results time: %f\n",tCheck);
+    PRINTF_COND(write_result && !i && times,"Write results time: %f\n",tWrite);
+    PRINTF_COND(input && times,"Total time: %f\n",tEndBatch-tStartBatch);
+    PRINTF_COND(input && times,"Throughput: %f alignments/s\n",num_alignments/(tEndBatch-tStartBatch));
+#ifdef EWF_STATS
+    wfa_edit_stats_report(&stats,i,num_alignments,stats_file);
+#endif
 
   }
 
-  PRINTF("\n");
-
-}
-
-
-
-
-
-
-
+  // Free resources
+  for (t=0;t<num_tasks;++t) {
+    wfa_edit_wavefronts_free(wavefronts+t);
+  }
+  free(wavefronts);
+  sequence_batch_free(&batch);
+  if (input) sequence_reader_close(&reader);
+  if (check) check_references_free(&references);
+#ifdef EWF_STATS
+  if (stats_file != NULL) fclose(stats_file);
+#endif
+  if (write_result && result_writer_close(&result_writer)) return EXIT_FAILURE;
+  if (check_failed) return EXIT_FAILURE;
 
+  PRINTF("\n");
 
+}
\ No newline at end of file
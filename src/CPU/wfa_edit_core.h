@@ -0,0 +1,257 @@
+/*
+ *  Wavefront Alignments Algorithms
+ *  Copyright (c) 2024 by Diego García Aranda <diego.garcia1@bsc.es>
+ *
+ *  This file is part of Wavefront Alignments Algorithms.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * PROJECT: Wavefront Alignments Algorithms
+ * AUTHOR(S): Diego García Aranda <diego.garcia1@bsc.es>
+ */
+
+/*
+ * Aligner core of the CPU (wfa_edit.c)
+ *   Wavefronts of a task and the entry points the program and the library
+ *   API (wfa_edit.h) are built on. Not installed, the layout of
+ *   edit_wavefronts_t depends on EWF_STATS.
+ */
+#ifndef WFA_EDIT_CORE_H
+#define WFA_EDIT_CORE_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#define SEQUENCE_PADDING 64 // Readable bytes around sequences (widest match extension load)
+
+#define PACKED_BASES_PER_WORD 32
+#define PACKED_WORDS(length) (1+((length)+PACKED_BASES_PER_WORD-1)/PACKED_BASES_PER_WORD+1) // Padding words before and after
+#define PACKED_ESCAPED SIZE_MAX
+
+#define ARENA_MAX_SLABS 32
+
+#define ROLLING_WAVEFRONTS 4
+
+#define EWF_OFFSET_WIDTHS 3 // Offset widths (8, 16 and 32 bits), narrowest fitting one per pair
+#define EWF_OFFSET_WIDTH_8  0
+#define EWF_OFFSET_WIDTH_16 1
+#define EWF_OFFSET_WIDTH_32 2
+#define INTER_PAIR_LANES_MAX 32 // Pairs aligned together (one per lane of a 256-bit vector of offsets)
+#define INTER_PAIR_LANES(width) (INTER_PAIR_LANES_MAX >> (width)) // 32, 16 and 8 lanes
+#define INTER_PAIR_MAX_LENGTH 512 // Longer pairs are aligned alone
+
+#define DEFAULT_REDUCTION_MIN_LENGTH 10
+#define DEFAULT_REDUCTION_MAX_DISTANCE 50
+
+/*
+ * Wavefront
+ */
+typedef int8_t ewf_offset8_t;    // Edit Wavefront Offset (short pairs)
+typedef int16_t ewf_offset16_t;  // Edit Wavefront Offset
+typedef int32_t ewf_offset32_t;  // Edit Wavefront Offset (long pairs)
+typedef struct {
+  int lo;                      // Effective lowest diagonal (inclusive)
+  int hi;                      // Effective highest diagonal (inclusive)
+  void* offsets;               // Offsets (of the width of the pair)
+  void* offsets_mem;           // Offsets memory
+  uint8_t* predecessors;       // Winning operation of each diagonal k at bit 2*(k+distance) (compact backtrace)
+} edit_wavefront_t;
+
+
+/*
+ * Adaptive Wavefront Reduction (regular WFA only)
+ */
+typedef struct {
+  bool enabled;
+  int min_wavefront_length;    // Narrower wavefronts are not reduced
+  int max_distance_threshold;  // Drop diagonals this much further from the target than the best one
+} ewf_reduction_t;
+
+
+/*
+ * Offsets Arena (slabs of growing length, kept across alignments)
+ */
+typedef struct {
+  void* slabs[ARENA_MAX_SLABS];
+  size_t slabs_length[ARENA_MAX_SLABS]; // Bytes
+  int num_slabs;               // Slabs allocated
+  int current_slab;            // Slab in use
+  size_t used;                 // Bytes used in the current slab
+} ewf_arena_t;
+
+
+/*
+ * Packed Pair (2 bits per base, words start after the front padding word)
+ *   Sub-sequences are located by their distance to the pair characters
+ */
+typedef struct {
+  const char* pattern;
+  const uint64_t* pattern_packed;
+  const char* text;
+  const uint64_t* text_packed;
+} ewf_packed_pair_t;
+
+
+/*
+ * Inter-pair Lanes (short pairs aligned together, one per vector lane)
+ *   Results are written straight to the batch
+ */
+typedef struct {
+  int num_lanes;
+  const char* patterns[INTER_PAIR_LANES_MAX];
+  int pattern_lengths[INTER_PAIR_LANES_MAX];
+  const char* texts[INTER_PAIR_LANES_MAX];
+  int text_lengths[INTER_PAIR_LANES_MAX];
+  const ewf_packed_pair_t* packed[INTER_PAIR_LANES_MAX]; // NULL to align characters
+  ewf_packed_pair_t packed_pairs[INTER_PAIR_LANES_MAX];
+  // Results
+  int* scores[INTER_PAIR_LANES_MAX];
+  char* cigars[INTER_PAIR_LANES_MAX];
+  int* cigar_lengths[INTER_PAIR_LANES_MAX];
+} ewf_lanes_t;
+
+
+/*
+ * Hot-path Statistics (only built with -DEWF_STATS, otherwise the hooks expand to nothing)
+ *   Gathered by each task on its own wavefronts, summed per repetition
+ */
+#ifdef EWF_STATS
+typedef struct {
+  long cells;                  // Offsets computed
+  long wavefronts;             // Wavefronts computed
+  int max_wavefront_length;
+  long extend_chars;           // Characters compared extending diagonals
+  long backtrace_steps;        // CIGAR operations traced back
+  uint64_t extend_cycles;
+  uint64_t compute_cycles;
+  uint64_t reduce_cycles;
+  uint64_t backtrace_cycles;
+} ewf_stats_t;
+#endif
+
+
+/*
+ * Edit Wavefronts
+ */
+typedef struct {
+  // Dimensions
+  int pattern_length;
+  int text_length;
+  int max_score;               // Distance budget (pairs above it are not aligned)
+  int max_distance;            // Wavefronts index length-1 (sized from the budget)
+  int max_cigar_length;
+  // Waves Offsets
+  edit_wavefront_t* wavefronts;
+  ewf_arena_t arena;
+  // Rolling wavefronts (score only: 0-1, BiWFA forward: 0-1, BiWFA reverse: 2-3)
+  void* rolling_mem[ROLLING_WAVEFRONTS]; // Widest offsets
+  int rolling_max_distance;
+  // Packed pair being aligned (NULL to align characters)
+  const ewf_packed_pair_t* packed;
+  // Inter-pair lanes being aligned
+  const ewf_lanes_t* lanes;
+  // Heuristics
+  ewf_reduction_t reduction;
+  // Q-gram filter (pairs proven above max_score are not aligned)
+  bool filter;
+  int num_pairs_filtered;
+  // Pairs aligned in inter-pair lanes
+  int num_pairs_lanes;
+  // Pairs aligned with each offset width
+  int num_pairs_width[EWF_OFFSET_WIDTHS];
+#ifdef EWF_STATS
+  // Hot-path statistics
+  ewf_stats_t stats;
+#endif
+  // CIGAR
+  char* edit_cigar;
+  int edit_cigar_length;
+  // Pairs not aligned for lack of memory (allocation_failed is set while aligning)
+  bool allocation_failed;
+  int num_pairs_failed;
+} edit_wavefronts_t;
+
+/*
+ * Allocate wavefronts for pairs up to these lengths
+ *   On failure, the buffers allocated are released by wfa_edit_wavefronts_free
+ */
+int wfa_edit_wavefronts_init(
+    edit_wavefronts_t* wavefronts,
+    int pattern_length,
+    int text_length,
+    int max_score,
+    ewf_reduction_t reduction,
+    bool filter);
+void wfa_edit_wavefronts_free(
+    edit_wavefronts_t* wavefronts);
+
+/*
+ * Align a pair alone (narrowest offsets fitting the pair, at least min_width)
+ *   Returns EXIT_FAILURE if an allocation fails (the pair is left unaligned)
+ */
+int wfa_edit_wavefronts_align_pair(
+    edit_wavefronts_t* wavefronts,
+    const char* pattern,
+    int pattern_length,
+    const char* text,
+    int text_length,
+    bool score_only,
+    bool biwfa,
+    bool compact_backtrace,
+    int min_width,
+    int* score);
+
+/*
+ * Offset width of a pair aligned in inter-pair lanes (index, at least min_width)
+ */
+int wfa_edit_wavefronts_lanes_offset_width(
+    const edit_wavefronts_t* wavefronts,
+    int pattern_length,
+    int text_length,
+    int min_width);
+
+/*
+ * Align the pairs of inter-pair lanes of a width (and empty them)
+ *   Lanes are left unaligned if an allocation fails
+ */
+void wfa_edit_wavefronts_align_lanes(
+    edit_wavefronts_t* wavefronts,
+    ewf_lanes_t* lanes,
+    int width,
+    bool score_only);
+
+/*
+ * Kernels (shared by all wavefronts, selected before aligning)
+ *   Return the name of the selected kernels, NULL if unknown or unsupported
+ */
+const char* wfa_edit_select_extend_kernels(
+    const char* requested);
+const char* wfa_edit_select_compute_kernel(
+    const char* requested);
+void wfa_edit_compute_benchmark(
+    int width);
+
+#ifdef EWF_STATS
+void wfa_edit_stats_merge(
+    ewf_stats_t* stats,
+    const ewf_stats_t* task_stats);
+void wfa_edit_stats_report(
+    const ewf_stats_t* stats,
+    int repetition,
+    int num_alignments,
+    FILE* stats_file);
+#endif
+
+#endif // WFA_EDIT_CORE_H
@@ -0,0 +1,235 @@
+/*
+ *  Wavefront Alignments Algorithms
+ *  Copyright (c) 2024 by Diego García Aranda <diego.garcia1@bsc.es>
+ *
+ *  This file is part of Wavefront Alignments Algorithms.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * PROJECT: Wavefront Alignments Algorithms
+ * AUTHOR(S): Diego García Aranda <diego.garcia1@bsc.es>
+ */
+
+/*
+ * Library example (wfa_edit.h)
+ *   Aligns known pairs with aligners of every kind and checks their scores and
+ *   CIGARs, exits with failure on any mismatch. Ambiguous CIGARs (equally optimal
+ *   ones) are replayed on their pair instead of compared.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "wfa_edit.h"
+
+#define LONG_PAIR_LENGTH 3000
+#define LONG_PAIR_EDITS_SPACING 100
+
+typedef struct {
+  const char* pattern;
+  const char* text;
+  int score;
+  const char* cigar;           // NULL if ambiguous (replayed)
+} example_pair_t;
+
+static const example_pair_t example_pairs[] = {
+  {"ACGTACGTAC","ACGTACGTAC",0,"10M"},
+  {"ACGTACGTAC","ACGAACGTAC",1,"3M1X6M"},
+  {"ACGTACGTAC","ACGTAGTAC",1,"5M1D4M"},
+  {"ACGTAGTAC","ACGTACGTAC",1,"5M1I4M"},
+  {"GATTACA","GATTACATTT",3,"7M3I"},
+  {"","ACG",3,"3I"},
+  {"ACG","",3,"3D"},
+  {"","",0,""},
+  {"AAAAAAAA","AAAAA",3,NULL},
+  {"TCTTTACTCGCGCGTTGGAGAAATACAATAGT","TCTATACTGCGCGTTTGGAGAAATAAAATAGT",4,NULL},
+};
+#define EXAMPLE_PAIRS (int)(sizeof(example_pairs)/sizeof(example_pairs[0]))
+
+/*
+ * Replay a text CIGAR on its pair
+ *   Returns true if it aligns the whole pair with score edits
+ */
+static bool example_replay(
+    const char* pattern,
+    const char* text,
+    const char* cigar,
+    const int score) {
+  const int pattern_length = strlen(pattern), text_length = strlen(text);
+  int v = 0, h = 0, edits = 0;
+  while (*cigar != '\0') {
+    char* op;
+    const long length = strtol(cigar,&op,10);
+    if (length <= 0) return false;
+    int i;
+    for (i=0;i<length;++i) {
+      switch (*op) {
+        case 'M': if (v >= pattern_length || h >= text_length || pattern[v++] != text[h++]) return false; break;
+        case 'X': if (v >= pattern_length || h >= text_length || pattern[v++] == text[h++]) return false; ++edits; break;
+        case 'I': if (h++ >= text_length) return false; ++edits; break;
+        case 'D': if (v++ >= pattern_length) return false; ++edits; break;
+        default: return false;
+      }
+    }
+    cigar = op + 1;
+  }
+  return v == pattern_length && h == text_length && edits == score;
+}
+
+/*
+ * Align a pair and check the result
+ *   Returns the number of mismatches (0 or 1)
+ */
+static int example_check(
+    wfa_edit_aligner_t* const aligner,
+    const char* const name,
+    const char* const pattern,
+    const char* const text,
+    const int score,
+    const char* const cigar,
+    const bool score_only) {
+  if (wfa_edit_aligner_align(aligner,pattern,strlen(pattern),text,strlen(text))) {
+    fprintf(stderr,"%s: alignment failed\n",name);
+    return 1;
+  }
+  const int aligned_score = wfa_edit_aligner_score(aligner);
+  int aligned_cigar_length;
+  const char* const aligned_cigar = wfa_edit_aligner_cigar(aligner,&aligned_cigar_length);
+  bool ok = (aligned_score == score && aligned_cigar != NULL && (int)strlen(aligned_cigar) == aligned_cigar_length);
+  if (ok && (score_only || score == WFA_EDIT_SCORE_UNALIGNED)) {
+    ok = (aligned_cigar_length == 0);
+  }
+  else if (ok && cigar != NULL) {
+    ok = !strcmp(aligned_cigar,cigar);
+  }
+  else if (ok) {
+    ok = example_replay(pattern,text,aligned_cigar,score);
+  }
+  if (!ok) {
+    fprintf(stderr,"%s: score %d CIGAR %s (expected score %d CIGAR %s)\n",name,aligned_score,
+        aligned_cigar != NULL ? aligned_cigar : "(null)",score,cigar != NULL ? cigar : "(replayed)");
+    return 1;
+  }
+  return 0;
+}
+
+/*
+ * Long pair with a substitution every LONG_PAIR_EDITS_SPACING bases (pseudo-random bases)
+ */
+static void example_long_pair(
+    char* const pattern,
+    char* const text) {
+  uint32_t seed = 12345;
+  int i;
+  for (i=0;i<LONG_PAIR_LENGTH;++i) {
+    seed = seed*1103515245u + 12345u;
+    pattern[i] = "ACGT"[(seed>>16)&3];
+    text[i] = pattern[i];
+    if (i%LONG_PAIR_EDITS_SPACING == LONG_PAIR_EDITS_SPACING/2) {
+      text[i] = (pattern[i] == 'A') ? 'C' : 'A';
+    }
+  }
+  pattern[LONG_PAIR_LENGTH] = '\0';
+  text[LONG_PAIR_LENGTH] = '\0';
+}
+
+/*
+ * Align every pair (and the long one) with an aligner of these options, twice (reset in between)
+ */
+static int example_run(
+    const char* const name,
+    const wfa_edit_options_t* const options,
+    const char* const long_pattern,
+    const char* const long_text) {
+  wfa_edit_aligner_t* const aligner = wfa_edit_aligner_new(options);
+  if (aligner == NULL) {
+    fprintf(stderr,"%s: aligner not created\n",name);
+    return 1;
+  }
+  const bool score_only = (options != NULL && options->score_only);
+  int mismatches = 0, round, i;
+  for (round=0;round<2;++round) {
+    for (i=0;i<EXAMPLE_PAIRS;++i) {
+      const example_pair_t* const pair = &example_pairs[i];
+      mismatches += example_check(aligner,name,pair->pattern,pair->text,pair->score,pair->cigar,score_only);
+    }
+    mismatches += example_check(aligner,name,long_pattern,long_text,
+        LONG_PAIR_LENGTH/LONG_PAIR_EDITS_SPACING,NULL,score_only);
+    if (wfa_edit_aligner_reset(aligner)) {
+      fprintf(stderr,"%s: reset failed\n",name);
+      ++mismatches;
+    }
+  }
+  wfa_edit_aligner_free(aligner);
+  printf("%s: %s\n",name,mismatches ? "FAILED" : "ok");
+  return mismatches;
+}
+
+int main() {
+
+  static char long_pattern[LONG_PAIR_LENGTH+1], long_text[LONG_PAIR_LENGTH+1];
+  example_long_pair(long_pattern,long_text);
+  int mismatches = 0;
+
+  // Every alignment kind
+  wfa_edit_options_t options;
+  mismatches += example_run("default",NULL,long_pattern,long_text);
+  wfa_edit_options_default(&options);
+  options.biwfa = true;
+  mismatches += example_run("biwfa",&options,long_pattern,long_text);
+  wfa_edit_options_default(&options);
+  options.compact_backtrace = true;
+  mismatches += example_run("compact",&options,long_pattern,long_text);
+  wfa_edit_options_default(&options);
+  options.score_only = true;
+  mismatches += example_run("score_only",&options,long_pattern,long_text);
+
+  // Distance budget (pairs above it are unaligned, with or without the filter)
+  int filter;
+  for (filter=0;filter<2;++filter) {
+    wfa_edit_options_default(&options);
+    options.max_score = 2;
+    options.filter = filter;
+    const char* const name = filter ? "max_score filter" : "max_score";
+    wfa_edit_aligner_t* const aligner = wfa_edit_aligner_new(&options);
+    if (aligner == NULL) {
+      fprintf(stderr,"%s: aligner not created\n",name);
+      return EXIT_FAILURE;
+    }
+    int budget_mismatches =
+        example_check(aligner,name,"ACGTACGTAC","ACGAACGTAC",1,"3M1X6M",false) +
+        example_check(aligner,name,"GATTACA","GATTACATTT",WFA_EDIT_SCORE_UNALIGNED,NULL,false) +
+        example_check(aligner,name,long_pattern,long_text,WFA_EDIT_SCORE_UNALIGNED,NULL,false) +
+        example_check(aligner,name,"GATTACA","GATTACAT",1,"7M1I",false);
+    wfa_edit_aligner_free(aligner);
+    printf("%s: %s\n",name,budget_mismatches ? "FAILED" : "ok");
+    mismatches += budget_mismatches;
+  }
+
+  // Invalid options and pairs
+  wfa_edit_options_default(&options);
+  options.max_score = -1;
+  wfa_edit_aligner_t* const aligner = wfa_edit_aligner_new(NULL);
+  const bool rejected = (wfa_edit_aligner_new(&options) == NULL) &&
+      aligner != NULL && wfa_edit_aligner_align(aligner,"ACGT",-1,"ACGT",4) != 0 &&
+      wfa_edit_aligner_score(aligner) == WFA_EDIT_SCORE_UNALIGNED;
+  wfa_edit_aligner_free(aligner);
+  printf("invalid: %s\n",rejected ? "ok" : "FAILED");
+  mismatches += !rejected;
+
+  return mismatches ? EXIT_FAILURE : EXIT_SUCCESS;
+
+}
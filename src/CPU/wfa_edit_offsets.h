@@ -0,0 +1,1294 @@
+/*
+ *  Wavefront Alignments Algorithms
+ *  Copyright (c) 2024 by Diego García Aranda <diego.garcia1@bsc.es>
+ *
+ *  This file is part of Wavefront Alignments Algorithms.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * PROJECT: Wavefront Alignments Algorithms
+ * AUTHOR(S): Diego García Aranda <diego.garcia1@bsc.es>
+ */
+
+/*
+ * Wavefront code of one offset width
+ *   Included by wfa_edit.c once per width, with EWF_OFFSET_BITS
+ *   set to 8, 16 or 32. Functions get the suffix _i<bits> (e.g. edit_wavefronts_align_i16).
+ */
+
+#if EWF_OFFSET_BITS == 8
+#define ewf_offset_t ewf_offset8_t
+#define EWF_OFFSET_NULL (INT8_MIN/2)
+#define EWF_OFFSET_MAX INT8_MAX
+#define EWF_MM256(op) _mm256_##op##_epi8
+#define EWF_MM512(op) _mm512_##op##_epi8
+#elif EWF_OFFSET_BITS == 16
+#define ewf_offset_t ewf_offset16_t
+#define EWF_OFFSET_NULL (INT16_MIN/2)
+#define EWF_OFFSET_MAX INT16_MAX
+#define EWF_MM256(op) _mm256_##op##_epi16
+#define EWF_MM512(op) _mm512_##op##_epi16
+#elif EWF_OFFSET_BITS == 32
+#define ewf_offset_t ewf_offset32_t
+#define EWF_OFFSET_NULL (INT32_MIN/2)
+#define EWF_OFFSET_MAX INT32_MAX
+#define EWF_MM256(op) _mm256_##op##_epi32
+#define EWF_MM512(op) _mm512_##op##_epi32
+#else
+#error "EWF_OFFSET_BITS must be 8, 16 or 32"
+#endif
+#define EWF_MM256_LANES (256/EWF_OFFSET_BITS)
+#define EWF_MM512_LANES (512/EWF_OFFSET_BITS)
+#define EWF_OFFSETS(wavefront) ((ewf_offset_t*)(wavefront)->offsets)
+#define EWF_LANES EWF_MM256_LANES // Inter-pair lanes (INTER_PAIR_LANES of the width)
+
+// Width suffix
+#define EWF_FN(name) EWF_FN_BITS(name,EWF_OFFSET_BITS)
+#define EWF_FN_BITS(name,bits) EWF_FN_PASTE(name,bits)
+#define EWF_FN_PASTE(name,bits) name##_i##bits
+#define ewf_compute_kernel_t EWF_FN(ewf_compute_kernel_t)
+#define ewf_compute_offsets EWF_FN(ewf_compute_offsets)
+#define ewf_compute_offsets_peeled EWF_FN(ewf_compute_offsets_peeled)
+#define ewf_compute_offsets_scalar EWF_FN(ewf_compute_offsets_scalar)
+#define ewf_compute_offsets_avx2 EWF_FN(ewf_compute_offsets_avx2)
+#define ewf_compute_offsets_avx512 EWF_FN(ewf_compute_offsets_avx512)
+#define edit_wavefronts_set_sentinels EWF_FN(edit_wavefronts_set_sentinels)
+#define edit_wavefronts_allocate_wavefront EWF_FN(edit_wavefronts_allocate_wavefront)
+#define edit_wavefronts_rolling_reserve EWF_FN(edit_wavefronts_rolling_reserve)
+#define edit_wavefronts_backtrace EWF_FN(edit_wavefronts_backtrace)
+#define edit_wavefronts_backtrace_compact EWF_FN(edit_wavefronts_backtrace_compact)
+#define edit_wavefronts_extend_offsets EWF_FN(edit_wavefronts_extend_offsets)
+#define edit_wavefronts_extend_wavefront EWF_FN(edit_wavefronts_extend_wavefront)
+#define edit_wavefronts_select_compute_kernel EWF_FN(edit_wavefronts_select_compute_kernel)
+#define edit_wavefronts_compute_offsets EWF_FN(edit_wavefronts_compute_offsets)
+#define edit_wavefronts_compute_benchmark EWF_FN(edit_wavefronts_compute_benchmark)
+#define edit_wavefronts_compute_wavefront EWF_FN(edit_wavefronts_compute_wavefront)
+#define edit_wavefronts_compute_predecessors EWF_FN(edit_wavefronts_compute_predecessors)
+#define edit_wavefronts_distance_to_target EWF_FN(edit_wavefronts_distance_to_target)
+#define edit_wavefronts_reduce_wavefront EWF_FN(edit_wavefronts_reduce_wavefront)
+#define edit_wavefronts_compute_wavefronts EWF_FN(edit_wavefronts_compute_wavefronts)
+#define edit_wavefronts_align EWF_FN(edit_wavefronts_align)
+#define edit_wavefronts_align_score_only EWF_FN(edit_wavefronts_align_score_only)
+#define edit_wavefronts_align_compact EWF_FN(edit_wavefronts_align_compact)
+#define ewf_compute_lanes_kernel_t EWF_FN(ewf_compute_lanes_kernel_t)
+#define ewf_compute_lanes EWF_FN(ewf_compute_lanes)
+#define ewf_compute_lanes_scalar EWF_FN(ewf_compute_lanes_scalar)
+#define ewf_compute_lanes_avx2 EWF_FN(ewf_compute_lanes_avx2)
+#define ewf_compute_lanes_avx512 EWF_FN(ewf_compute_lanes_avx512)
+#define edit_wavefronts_set_lanes_sentinels EWF_FN(edit_wavefronts_set_lanes_sentinels)
+#define edit_wavefronts_allocate_lanes EWF_FN(edit_wavefronts_allocate_lanes)
+#define edit_wavefronts_extend_lane EWF_FN(edit_wavefronts_extend_lane)
+#define edit_wavefronts_backtrace_lane EWF_FN(edit_wavefronts_backtrace_lane)
+#define edit_wavefronts_align_lanes EWF_FN(edit_wavefronts_align_lanes)
+#define edit_bialign_extend_offsets EWF_FN(edit_bialign_extend_offsets)
+#define edit_bialign_compute_offsets EWF_FN(edit_bialign_compute_offsets)
+#define edit_bialign_overlap EWF_FN(edit_bialign_overlap)
+#define edit_bialign_breakpoint EWF_FN(edit_bialign_breakpoint)
+#define edit_bialign_align_subproblem EWF_FN(edit_bialign_align_subproblem)
+#define edit_bialign_align EWF_FN(edit_bialign_align)
+
+
+/*
+ * Set the sentinel offsets around diagonals lo..hi (never selected by the max)
+ */
+static void edit_wavefronts_set_sentinels(
+    ewf_offset_t* const offsets,
+    const int lo,
+    const int hi) {
+  offsets[lo-2] = EWF_OFFSET_NULL;
+  offsets[lo-1] = EWF_OFFSET_NULL;
+  offsets[hi+1] = EWF_OFFSET_NULL;
+  offsets[hi+2] = EWF_OFFSET_NULL;
+}
+
+static edit_wavefront_t* edit_wavefronts_allocate_wavefront(
+    edit_wavefronts_t* const edit_wavefronts,
+    const int distance,
+    const int lo_base,
+    const int hi_base) {
+  // Compute limits
+  const int wavefront_length = hi_base - lo_base + 1 + 2*WAVEFRONT_PADDING;
+  // Allocate wavefront
+  edit_wavefront_t* const wavefront = edit_wavefronts->wavefronts + distance;
+  // Configure offsets
+  wavefront->lo = lo_base;
+  wavefront->hi = hi_base;
+  // Allocate offsets (every offset is written before it is read)
+  ewf_offset_t* const offsets_mem = edit_wavefronts_allocate(edit_wavefronts,wavefront_length*sizeof(ewf_offset_t));
+  if (offsets_mem == NULL) return NULL;
+  wavefront->offsets_mem = offsets_mem;
+  wavefront->offsets = offsets_mem + WAVEFRONT_PADDING - lo_base; // Center at k=0
+  // Return
+  return wavefront;
+}
+
+/*
+ * Grow rolling wavefronts to fit distance (keeping the current offsets)
+ *   Buffers are sized for the widest offsets, so any width can use them
+ */
+static int edit_wavefronts_rolling_reserve(
+    edit_wavefronts_t* const wavefronts,
+    const int distance) {
+  if (distance <= wavefronts->rolling_max_distance) return EXIT_SUCCESS;
+  // Compute dimensions (centered at k=0)
+  const int old_max_distance = wavefronts->rolling_max_distance;
+  const int max_distance = MAX(distance,2*old_max_distance);
+  const int offset = ROLLING_CENTER(max_distance) - ROLLING_CENTER(old_max_distance);
+  // Reallocate all wavefronts
+  int i;
+  for (i=0;i<ROLLING_WAVEFRONTS;++i) {
+    ewf_offset_t* const mem = malloc(ROLLING_LENGTH(max_distance)*EWF_OFFSET_MAX_SIZE);
+    if (mem == NULL) {
+      PRINTF_ERROR("Allocation of rolling wavefronts failed\n");
+      wavefronts->allocation_failed = true;
+      return EXIT_FAILURE;
+    }
+    memcpy(mem+offset,wavefronts->rolling_mem[i],ROLLING_LENGTH(old_max_distance)*sizeof(ewf_offset_t));
+    free(wavefronts->rolling_mem[i]);
+    wavefronts->rolling_mem[i] = mem;
+  }
+  wavefronts->rolling_max_distance = max_distance;
+  return EXIT_SUCCESS;
+}
+
+/*
+ * Edit Wavefront Backtrace
+ *   Appends the operations backwards to the CIGAR, returns its new length
+ */
+static int edit_wavefronts_backtrace(
+    edit_wavefronts_t* const wavefronts,
+    char* const edit_cigar,
+    int edit_cigar_length,
+    const int target_k,
+    const int target_distance) {
+  // Parameters
+  EWF_STATS_TIMER_START(cycles_start);
+  int k = target_k, distance = target_distance;
+  ewf_offset_t offset = EWF_OFFSETS(&wavefronts->wavefronts[distance])[k];
+  while (distance > 0) {
+    EWF_STATS_ADD(wavefronts,backtrace_steps,1);
+    // Fetch
+    const edit_wavefront_t* const wavefront = &wavefronts->wavefronts[distance-1];
+    const ewf_offset_t* const offsets = wavefront->offsets;
+    // Traceback operation
+    if (wavefront->lo <= k+1 && k+1 <= wavefront->hi && offset == offsets[k+1]) {
+      edit_cigar_length = edit_cigar_append(edit_cigar,edit_cigar_length,CIGAR_OP_D,1);
+      ++k;
+      --distance;
+    } else if (wavefront->lo <= k-1 && k-1 <= wavefront->hi && offset == offsets[k-1] + 1) {
+      edit_cigar_length = edit_cigar_append(edit_cigar,edit_cigar_length,CIGAR_OP_I,1);
+      --k;
+      --offset;
+      --distance;
+    } else if (wavefront->lo <= k && k <= wavefront->hi && offset == offsets[k] + 1) {
+      edit_cigar_length = edit_cigar_append(edit_cigar,edit_cigar_length,CIGAR_OP_X,1);
+      --distance;
+      --offset;
+    } else {
+      edit_cigar_length = edit_cigar_append(edit_cigar,edit_cigar_length,CIGAR_OP_M,1);
+      --offset;
+    }
+  }
+  // Account for last offset of matches
+  EWF_STATS_ADD(wavefronts,backtrace_steps,offset);
+  edit_cigar_length = edit_cigar_append(edit_cigar,edit_cigar_length,CIGAR_OP_M,offset);
+  EWF_STATS_TIMER_STOP(wavefronts,backtrace,cycles_start);
+  // Return CIGAR length
+  return edit_cigar_length;
+}
+
+/*
+ * Edit Wavefront Compact Backtrace (forward CIGAR)
+ *   Walks the winning operations back to the origin, then re-extends the match runs
+ *   forward along that path (reaching the offsets of the compute step).
+ *   Returns the CIGAR length, -1 if the path cannot be allocated
+ */
+static int edit_wavefronts_backtrace_compact(
+    edit_wavefronts_t* const wavefronts,
+    const char* const pattern,
+    const int pattern_length,
+    const char* const text,
+    const int text_length,
+    char* const edit_cigar,
+    const int target_k,
+    const int target_distance) {
+  // Parameters
+  const ewf_packed_pair_t* const packed = wavefronts->packed;
+  EWF_STATS_TIMER_START(cycles_start);
+  uint8_t* const operations = edit_wavefronts_allocate(wavefronts,target_distance+1);
+  if (operations == NULL) return -1;
+  // Operations of the path (back to the origin)
+  int k = target_k, distance;
+  for (distance=target_distance;distance>0;--distance) {
+    const int op = PREDECESSOR_GET(wavefronts->wavefronts[distance].predecessors,k+distance);
+    operations[distance] = op;
+    if (op == CIGAR_OP_D) ++k;
+    else if (op == CIGAR_OP_I) --k;
+  }
+  // Re-extend the path forward
+  int edit_cigar_length = 0, offset = 0;
+  for (distance=0;distance<=target_distance;++distance) {
+    EWF_STATS_ADD(wavefronts,backtrace_steps,1);
+    if (distance > 0) {
+      const int op = operations[distance];
+      edit_cigar_length = edit_cigar_append(edit_cigar,edit_cigar_length,op,1);
+      if (op == CIGAR_OP_D) --k;
+      else if (op == CIGAR_OP_I) { ++k; ++offset; }
+      else ++offset;
+    }
+    const int v = EWAVEFRONT_V(k,offset);
+    const int h = EWAVEFRONT_H(k,offset);
+    if (v >= pattern_length || h >= text_length) continue; // Only at the target
+    const int max_length = MIN(pattern_length-v,text_length-h);
+    int length;
+    if (packed != NULL) {
+      length = ewf_match_forward_packed(
+          packed->pattern_packed,pattern+v-packed->pattern,
+          packed->text_packed,text+h-packed->text,max_length);
+    }
+    else {
+      length = ewf_match_forward(pattern+v,text+h,max_length);
+    }
+    edit_cigar_length = edit_cigar_append(edit_cigar,edit_cigar_length,CIGAR_OP_M,length);
+    offset += length;
+  }
+  EWF_STATS_TIMER_STOP(wavefronts,backtrace,cycles_start);
+  // Return CIGAR length
+  return edit_cigar_length;
+}
+
+/*
+ * Extend Wavefront Offsets
+ */
+static void edit_wavefronts_extend_offsets(
+    edit_wavefronts_t* const wavefronts,
+    ewf_offset_t* const offsets,
+    const int k_min,
+    const int k_max,
+    const char* const pattern,
+    const int pattern_length,
+    const char* const text,
+    const int text_length) {
+  const ewf_packed_pair_t* const packed = wavefronts->packed;
+  EWF_STATS_TIMER_START(cycles_start);
+  // Extend diagonally each wavefront point
+  int k;
+  for (k=k_min;k<=k_max;++k) {
+    const int v = EWAVEFRONT_V(k,offsets[k]);
+    const int h = EWAVEFRONT_H(k,offsets[k]);
+    if (v >= pattern_length || h >= text_length) continue; // Outside the sequences
+    const int max_length = MIN(pattern_length-v,text_length-h);
+    int length;
+    if (packed != NULL) {
+      length = ewf_match_forward_packed(
+          packed->pattern_packed,pattern+v-packed->pattern,
+          packed->text_packed,text+h-packed->text,max_length);
+    }
+    else {
+      length = ewf_match_forward(pattern+v,text+h,max_length);
+    }
+    offsets[k] += length;
+    EWF_STATS_ADD(wavefronts,extend_chars,length+(length<max_length)); // Matches and the mismatch
+  }
+  EWF_STATS_TIMER_STOP(wavefronts,extend,cycles_start);
+}
+
+/*
+ * Extend Wavefront
+ */
+static void edit_wavefronts_extend_wavefront(
+    edit_wavefronts_t* const wavefronts,
+    const char* const pattern,
+    const int pattern_length,
+    const char* const text,
+    const int text_length,
+    const int distance) {
+  edit_wavefront_t* const wavefront = &wavefronts->wavefronts[distance];
+  edit_wavefronts_extend_offsets(wavefronts,wavefront->offsets,wavefront->lo,wavefront->hi,
+      pattern,pattern_length,text,text_length);
+}
+
+/*
+ * Compute Kernels (next wavefront spans lo-1..hi+1)
+ *   next_offsets[k] = MAX(offsets[k]+1,offsets[k-1]+1,offsets[k+1])
+ *   All but the peeled kernel rely on the sentinels of offsets
+ */
+typedef void (*ewf_compute_kernel_t)(const ewf_offset_t*,ewf_offset_t*,int,int);
+
+static void ewf_compute_offsets_peeled(
+    const ewf_offset_t* const offsets,
+    ewf_offset_t* const next_offsets,
+    const int lo,
+    const int hi) {
+  // Loop peeling (k=lo-1)
+  next_offsets[lo-1] = offsets[lo];
+  // Loop peeling (k=lo)
+  const ewf_offset_t bottom_upper_del = ((lo+1) <= hi) ? offsets[lo+1] : -1;
+  next_offsets[lo] = MAX(offsets[lo]+1,bottom_upper_del);
+  // Compute next wavefront starting point
+  int k;
+  for (k=lo+1;k<=hi-1;++k) {
+    const ewf_offset_t max_ins_sub = MAX(offsets[k],offsets[k-1]) + 1;
+    next_offsets[k] = MAX(max_ins_sub,offsets[k+1]);
+  }
+  // Loop peeling (k=hi)
+  const ewf_offset_t top_lower_ins = (lo <= (hi-1)) ? offsets[hi-1] : -1;
+  next_offsets[hi] = MAX(offsets[hi],top_lower_ins) + 1;
+  // Loop peeling (k=hi+1)
+  next_offsets[hi+1] = offsets[hi] + 1;
+}
+
+static void ewf_compute_offsets_scalar(
+    const ewf_offset_t* const offsets,
+    ewf_offset_t* const next_offsets,
+    const int lo,
+    const int hi) {
+  int k;
+  for (k=lo-1;k<=hi+1;++k) {
+    const ewf_offset_t max_ins_sub = MAX(offsets[k],offsets[k-1]) + 1;
+    next_offsets[k] = MAX(max_ins_sub,offsets[k+1]);
+  }
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+__attribute__((target("avx2")))
+static void ewf_compute_offsets_avx2(
+    const ewf_offset_t* const offsets,
+    ewf_offset_t* const next_offsets,
+    const int lo,
+    const int hi) {
+  const __m256i ones = EWF_MM256(set1)(1);
+  int k;
+  for (k=lo-1;k+EWF_MM256_LANES-1<=hi+1;k+=EWF_MM256_LANES) {
+    const __m256i ins = _mm256_loadu_si256((const __m256i*)(offsets+k-1));
+    const __m256i sub = _mm256_loadu_si256((const __m256i*)(offsets+k));
+    const __m256i del = _mm256_loadu_si256((const __m256i*)(offsets+k+1));
+    const __m256i max_ins_sub = EWF_MM256(add)(EWF_MM256(max)(sub,ins),ones);
+    _mm256_storeu_si256((__m256i*)(next_offsets+k),EWF_MM256(max)(max_ins_sub,del));
+  }
+  for (;k<=hi+1;++k) {
+    const ewf_offset_t max_ins_sub = MAX(offsets[k],offsets[k-1]) + 1;
+    next_offsets[k] = MAX(max_ins_sub,offsets[k+1]);
+  }
+}
+
+__attribute__((target("avx512bw")))
+static void ewf_compute_offsets_avx512(
+    const ewf_offset_t* const offsets,
+    ewf_offset_t* const next_offsets,
+    const int lo,
+    const int hi) {
+  const __m512i ones = EWF_MM512(set1)(1);
+  int k;
+  for (k=lo-1;k+EWF_MM512_LANES-1<=hi+1;k+=EWF_MM512_LANES) {
+    const __m512i ins = _mm512_loadu_si512((const void*)(offsets+k-1));
+    const __m512i sub = _mm512_loadu_si512((const void*)(offsets+k));
+    const __m512i del = _mm512_loadu_si512((const void*)(offsets+k+1));
+    const __m512i max_ins_sub = EWF_MM512(add)(EWF_MM512(max)(sub,ins),ones);
+    _mm512_storeu_si512((void*)(next_offsets+k),EWF_MM512(max)(max_ins_sub,del));
+  }
+  for (;k<=hi+1;++k) {
+    const ewf_offset_t max_ins_sub = MAX(offsets[k],offsets[k-1]) + 1;
+    next_offsets[k] = MAX(max_ins_sub,offsets[k+1]);
+  }
+}
+#endif
+
+/*
+ * Inter-pair Compute Kernels (lane-interleaved offsets, offsets[k*EWF_LANES+lane])
+ *   Same recurrence with stride EWF_LANES, every lane of diagonals lo-1..hi+1 at once
+ */
+typedef void (*ewf_compute_lanes_kernel_t)(const ewf_offset_t*,ewf_offset_t*,int,int);
+
+static void ewf_compute_lanes_scalar(
+    const ewf_offset_t* const offsets,
+    ewf_offset_t* const next_offsets,
+    const int lo,
+    const int hi) {
+  int i;
+  for (i=(lo-1)*EWF_LANES;i<(hi+2)*EWF_LANES;++i) {
+    const ewf_offset_t max_ins_sub = MAX(offsets[i],offsets[i-EWF_LANES]) + 1;
+    next_offsets[i] = MAX(max_ins_sub,offsets[i+EWF_LANES]);
+  }
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+__attribute__((target("avx2")))
+static void ewf_compute_lanes_avx2(
+    const ewf_offset_t* const offsets,
+    ewf_offset_t* const next_offsets,
+    const int lo,
+    const int hi) {
+  const __m256i ones = EWF_MM256(set1)(1);
+  int k;
+  for (k=lo-1;k<=hi+1;++k) { // One vector per diagonal
+    const __m256i ins = _mm256_loadu_si256((const __m256i*)(offsets+(k-1)*EWF_LANES));
+    const __m256i sub = _mm256_loadu_si256((const __m256i*)(offsets+k*EWF_LANES));
+    const __m256i del = _mm256_loadu_si256((const __m256i*)(offsets+(k+1)*EWF_LANES));
+    const __m256i max_ins_sub = EWF_MM256(add)(EWF_MM256(max)(sub,ins),ones);
+    _mm256_storeu_si256((__m256i*)(next_offsets+k*EWF_LANES),EWF_MM256(max)(max_ins_sub,del));
+  }
+}
+
+__attribute__((target("avx512bw")))
+static void ewf_compute_lanes_avx512(
+    const ewf_offset_t* const offsets,
+    ewf_offset_t* const next_offsets,
+    const int lo,
+    const int hi) {
+  const __m512i ones = EWF_MM512(set1)(1);
+  int i;
+  for (i=(lo-1)*EWF_LANES;i+EWF_MM512_LANES<=(hi+2)*EWF_LANES;i+=EWF_MM512_LANES) { // Two diagonals
+    const __m512i ins = _mm512_loadu_si512((const void*)(offsets+i-EWF_LANES));
+    const __m512i sub = _mm512_loadu_si512((const void*)(offsets+i));
+    const __m512i del = _mm512_loadu_si512((const void*)(offsets+i+EWF_LANES));
+    const __m512i max_ins_sub = EWF_MM512(add)(EWF_MM512(max)(sub,ins),ones);
+    _mm512_storeu_si512((void*)(next_offsets+i),EWF_MM512(max)(max_ins_sub,del));
+  }
+  for (;i<(hi+2)*EWF_LANES;++i) {
+    const ewf_offset_t max_ins_sub = MAX(offsets[i],offsets[i-EWF_LANES]) + 1;
+    next_offsets[i] = MAX(max_ins_sub,offsets[i+EWF_LANES]);
+  }
+}
+#endif
+
+// Selected at startup (edit_wavefronts_select_compute_kernel)
+static ewf_compute_kernel_t ewf_compute_offsets = ewf_compute_offsets_scalar;
+static ewf_compute_lanes_kernel_t ewf_compute_lanes = ewf_compute_lanes_scalar;
+
+/*
+ * Select the widest compute kernel supported (or the requested one)
+ *   Returns the name of the selected kernel, NULL if unknown or unsupported
+ */
+static const char* edit_wavefronts_select_compute_kernel(
+    const char* const requested) {
+  const bool any = (requested == NULL || !strcmp(requested,"auto"));
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_cpu_init();
+  if ((any || !strcmp(requested,"avx512")) && __builtin_cpu_supports("avx512bw")) {
+    ewf_compute_offsets = ewf_compute_offsets_avx512;
+    ewf_compute_lanes = ewf_compute_lanes_avx512;
+    return "avx512";
+  }
+  if ((any || !strcmp(requested,"avx2")) && __builtin_cpu_supports("avx2")) {
+    ewf_compute_offsets = ewf_compute_offsets_avx2;
+    ewf_compute_lanes = ewf_compute_lanes_avx2;
+    return "avx2";
+  }
+#endif
+  if (any || !strcmp(requested,"scalar")) {
+    ewf_compute_offsets = ewf_compute_offsets_scalar;
+    ewf_compute_lanes = ewf_compute_lanes_scalar;
+    return "scalar";
+  }
+  if (!strcmp(requested,"peeled")) {
+    ewf_compute_offsets = ewf_compute_offsets_peeled;
+    ewf_compute_lanes = ewf_compute_lanes_scalar;
+    return "peeled";
+  }
+  return NULL;
+}
+
+/*
+ * Compute Wavefront Offsets (next wavefront spans lo-1..hi+1, with its sentinels)
+ */
+static void edit_wavefronts_compute_offsets(
+    const ewf_offset_t* const offsets,
+    ewf_offset_t* const next_offsets,
+    const int lo,
+    const int hi) {
+  ewf_compute_offsets(offsets,next_offsets,lo,hi);
+  edit_wavefronts_set_sentinels(next_offsets,lo-1,hi+1);
+}
+
+/*
+ * Compute kernels benchmark on a synthetic wavefront of the given width
+ */
+static void edit_wavefronts_compute_benchmark(
+    const int width) {
+  const char* const kernels[] = {"peeled","scalar","avx2","avx512"};
+  const int lo = -width/2, hi = lo + width - 1;
+  const long iterations = MAX(1,(1L<<30)/width);
+  ewf_offset_t* const offsets_mem = malloc((width+2*WAVEFRONT_PADDING)*sizeof(ewf_offset_t));
+  ewf_offset_t* const next_offsets_mem = malloc((width+2+2*WAVEFRONT_PADDING)*sizeof(ewf_offset_t));
+  ewf_offset_t* const offsets = offsets_mem + WAVEFRONT_PADDING - lo;
+  ewf_offset_t* const next_offsets = next_offsets_mem + WAVEFRONT_PADDING + 1 - lo;
+  int k, i;
+  srand(width);
+  for (k=lo;k<=hi;++k) offsets[k] = (MAX(k,0) + rand()%1024) % (EWF_OFFSET_MAX/2); // No overflow
+  edit_wavefronts_set_sentinels(offsets,lo,hi);
+  PRINTF("Compute benchmark (width %d, %d-bit offsets, %ld iterations)\n",width,EWF_OFFSET_BITS,iterations);
+  for (i=0;i<4;++i) {
+    if (edit_wavefronts_select_compute_kernel(kernels[i]) == NULL) continue;
+    const double tStart = wall_time();
+    long it;
+    for (it=0;it<iterations;++it) {
+      edit_wavefronts_compute_offsets(offsets,next_offsets,lo,hi);
+    }
+    const double tEnd = wall_time();
+    PRINTF("\t%s: %f Mcells/s (checksum %d)\n",kernels[i],
+        (double)iterations*(width+2)/(tEnd-tStart)*1.0e-6,next_offsets[lo]+next_offsets[hi]);
+  }
+  free(offsets_mem);
+  free(next_offsets_mem);
+}
+
+/*
+ * Edit Wavefront Compute
+ *   Returns false if the next wavefront cannot be allocated
+ */
+static bool edit_wavefronts_compute_wavefront(
+    edit_wavefronts_t* const wavefronts,
+    const int distance) {
+  // Fetch wavefronts
+  edit_wavefront_t* const wavefront = &wavefronts->wavefronts[distance-1];
+  const int hi = wavefront->hi;
+  const int lo = wavefront->lo;
+  edit_wavefront_t* const next_wavefront = edit_wavefronts_allocate_wavefront(wavefronts,distance,lo-1,hi+1);
+  if (next_wavefront == NULL) return false;
+  // Compute offsets
+  EWF_STATS_TIMER_START(cycles_start);
+  edit_wavefronts_compute_offsets(wavefront->offsets,next_wavefront->offsets,lo,hi);
+  EWF_STATS_TIMER_STOP(wavefronts,compute,cycles_start);
+  EWF_STATS_WAVEFRONT(wavefronts,hi-lo+3);
+  return true;
+}
+
+/*
+ * Winning operation of each diagonal of the next wavefront (lo-1..hi+1, 2 bits each)
+ *   Same preference as the backtrace (deletion, insertion, mismatch), relies on the sentinels of offsets
+ */
+static void edit_wavefronts_compute_predecessors(
+    const ewf_offset_t* const offsets,
+    const ewf_offset_t* const next_offsets,
+    uint8_t* const predecessors,
+    const int lo,
+    const int hi,
+    const int next_distance) {
+  int k;
+  for (k=lo-1;k<=hi+1;++k) {
+    const int op = (next_offsets[k] == offsets[k+1]) ? CIGAR_OP_D :
+                   (next_offsets[k] == offsets[k-1]+1) ? CIGAR_OP_I : CIGAR_OP_X;
+    PREDECESSOR_SET(predecessors,k+next_distance,op);
+  }
+}
+
+
+/*
+ * Distance left from a wavefront cell to the end of both sequences (INT32_MAX if outside them)
+ */
+static int edit_wavefronts_distance_to_target(
+    const int k,
+    const ewf_offset_t offset,
+    const int pattern_length,
+    const int text_length) {
+  const int left_v = pattern_length - EWAVEFRONT_V(k,offset);
+  const int left_h = text_length - EWAVEFRONT_H(k,offset);
+  if (left_v < 0 || left_h < 0) return INT32_MAX;
+  return MAX(left_v,left_h);
+}
+
+/*
+ * Adaptive Wavefront Reduction
+ *   Trims the diagonals at both ends whose distance left to the target exceeds
+ *   the best one by more than max_distance_threshold (down to min_wavefront_length)
+ */
+static void edit_wavefronts_reduce_wavefront(
+    edit_wavefront_t* const wavefront,
+    const int pattern_length,
+    const int text_length,
+    const ewf_reduction_t* const reduction) {
+  const ewf_offset_t* const offsets = wavefront->offsets;
+  int lo = wavefront->lo, hi = wavefront->hi;
+  if (hi - lo + 1 <= reduction->min_wavefront_length) return;
+  // Best distance left to the target
+  int k, min_distance = INT32_MAX;
+  for (k=lo;k<=hi;++k) {
+    min_distance = MIN(min_distance,
+        edit_wavefronts_distance_to_target(k,offsets[k],pattern_length,text_length));
+  }
+  if (min_distance == INT32_MAX) return;
+  const int max_distance = min_distance + reduction->max_distance_threshold;
+  // Trim both ends
+  while (hi - lo + 1 > reduction->min_wavefront_length &&
+      edit_wavefronts_distance_to_target(lo,offsets[lo],pattern_length,text_length) > max_distance) ++lo;
+  while (hi - lo + 1 > reduction->min_wavefront_length &&
+      edit_wavefronts_distance_to_target(hi,offsets[hi],pattern_length,text_length) > max_distance) --hi;
+  if (lo == wavefront->lo && hi == wavefront->hi) return;
+  wavefront->lo = lo;
+  wavefront->hi = hi;
+  edit_wavefronts_set_sentinels(wavefront->offsets,lo,hi);
+}
+
+/*
+ * Compute wavefronts for increasing distance until reaching the end of both sequences
+ *   Stops as soon as the distance exceeds max_score or an allocation fails
+ *   (returns EWF_SCORE_UNALIGNED).
+ *   Wavefronts are reduced after extension if reduction is not NULL.
+ */
+static int edit_wavefronts_compute_wavefronts(
+    edit_wavefronts_t* const wavefronts,
+    const char* const pattern,
+    const int pattern_length,
+    const char* const text,
+    const int text_length,
+    const int max_score,
+    const ewf_reduction_t* const reduction) {
+  // Parameters
+  const int max_distance = MIN(pattern_length+text_length,max_score);
+  const int target_k = EWAVEFRONT_DIAGONAL(text_length,pattern_length);
+  const ewf_offset_t target_offset = EWAVEFRONT_OFFSET(text_length,pattern_length);
+  // Init wavefronts
+  int distance;
+  if (edit_wavefronts_allocate_wavefront(wavefronts,0,0,0) == NULL) return EWF_SCORE_UNALIGNED;
+  EWF_OFFSETS(&wavefronts->wavefronts[0])[0] = 0;
+  edit_wavefronts_set_sentinels(wavefronts->wavefronts[0].offsets,0,0);
+  // Compute wavefronts for increasing distance
+  for (distance=0;distance<=max_distance;++distance) {
+    // Extend diagonally each wavefront point
+    edit_wavefronts_extend_wavefront(wavefronts,
+        pattern,pattern_length,
+        text,text_length,distance);
+    // Exit condition
+    edit_wavefront_t* const wavefront = &wavefronts->wavefronts[distance];
+    if (wavefront->lo <= target_k && target_k <= wavefront->hi &&
+        EWF_OFFSETS(wavefront)[target_k] == target_offset) return distance;
+    // Reduce wavefront
+    if (reduction != NULL) {
+      EWF_STATS_TIMER_START(cycles_start);
+      edit_wavefronts_reduce_wavefront(wavefront,pattern_length,text_length,reduction);
+      EWF_STATS_TIMER_STOP(wavefronts,reduce,cycles_start);
+    }
+    // Compute next wavefront starting point
+    if (distance < max_distance && !edit_wavefronts_compute_wavefront(wavefronts,distance+1)) break;
+  }
+  // Distance above the budget (or allocation failed)
+  return EWF_SCORE_UNALIGNED;
+}
+
+/*
+ * Edit distance alignment using wavefronts
+ */
+static void edit_wavefronts_align(
+    edit_wavefronts_t* const wavefronts,
+    const char* const pattern,
+    const int pattern_length,
+    const char* const text,
+    const int text_length,
+    int* const score) {
+  // Compute wavefronts
+  const int distance = edit_wavefronts_compute_wavefronts(wavefronts,
+      pattern,pattern_length,text,text_length,wavefronts->max_score,
+      wavefronts->reduction.enabled ? &wavefronts->reduction : NULL);
+
+  (*score) = distance;
+  if (distance == EWF_SCORE_UNALIGNED) {
+    wavefronts->edit_cigar_length = 0;
+    return;
+  }
+
+  // Backtrace wavefronts
+  const int target_k = EWAVEFRONT_DIAGONAL(text_length,pattern_length);
+  wavefronts->edit_cigar_length = edit_wavefronts_backtrace(wavefronts,wavefronts->edit_cigar,0,target_k,distance);
+  edit_cigar_reverse(wavefronts->edit_cigar,wavefronts->edit_cigar_length);
+}
+
+/*
+ * Edit distance (score only) using two rolling wavefronts
+ */
+static void edit_wavefronts_align_score_only(
+    edit_wavefronts_t* const wavefronts,
+    const char* const pattern,
+    const int pattern_length,
+    const char* const text,
+    const int text_length,
+    int* const score) {
+  // Parameters
+  const int max_distance = MIN(pattern_length+text_length,wavefronts->max_score);
+  const int target_k = EWAVEFRONT_DIAGONAL(text_length,pattern_length);
+  const int target_k_abs = ABS(target_k);
+  const ewf_offset_t target_offset = EWAVEFRONT_OFFSET(text_length,pattern_length);
+  wavefronts->edit_cigar_length = 0;
+  // Init wavefronts
+  int distance;
+  ewf_offset_t* offsets = (ewf_offset_t*)wavefronts->rolling_mem[0] + ROLLING_CENTER(wavefronts->rolling_max_distance);
+  offsets[0] = 0;
+  edit_wavefronts_set_sentinels(offsets,0,0);
+  // Compute wavefronts for increasing distance
+  for (distance=0;distance<=max_distance;++distance) {
+    // Extend diagonally each wavefront point
+    edit_wavefronts_extend_offsets(wavefronts,offsets,-distance,distance,
+        pattern,pattern_length,text,text_length);
+    // Exit condition
+    if (target_k_abs <= distance && offsets[target_k] == target_offset) {
+      (*score) = distance;
+      return;
+    }
+    // Compute next wavefront starting point (on the other rolling wavefront)
+    if (distance == max_distance || edit_wavefronts_rolling_reserve(wavefronts,distance+1)) break;
+    const int center = ROLLING_CENTER(wavefronts->rolling_max_distance);
+    offsets = (ewf_offset_t*)wavefronts->rolling_mem[distance%2] + center;
+    ewf_offset_t* const next_offsets = (ewf_offset_t*)wavefronts->rolling_mem[(distance+1)%2] + center;
+    EWF_STATS_TIMER_START(cycles_start);
+    edit_wavefronts_compute_offsets(offsets,next_offsets,-distance,distance);
+    EWF_STATS_TIMER_STOP(wavefronts,compute,cycles_start);
+    EWF_STATS_WAVEFRONT(wavefronts,2*distance+3);
+    offsets = next_offsets;
+  }
+
+  (*score) = EWF_SCORE_UNALIGNED;
+}
+
+/*
+ * Edit distance alignment keeping 2 bits per cell for the backtrace
+ *   Offsets live in two rolling wavefronts, every wavefront keeps the winning
+ *   operation of each diagonal (8x less than 16-bit offsets)
+ */
+static void edit_wavefronts_align_compact(
+    edit_wavefronts_t* const wavefronts,
+    const char* const pattern,
+    const int pattern_length,
+    const char* const text,
+    const int text_length,
+    int* const score) {
+  // Parameters
+  const int max_distance = MIN(pattern_length+text_length,wavefronts->max_score);
+  const int target_k = EWAVEFRONT_DIAGONAL(text_length,pattern_length);
+  const ewf_offset_t target_offset = EWAVEFRONT_OFFSET(text_length,pattern_length);
+  const ewf_reduction_t* const reduction = wavefronts->reduction.enabled ? &wavefronts->reduction : NULL;
+  wavefronts->edit_cigar_length = 0;
+  (*score) = EWF_SCORE_UNALIGNED;
+  // Init wavefronts
+  int distance;
+  ewf_offset_t* offsets = (ewf_offset_t*)wavefronts->rolling_mem[0] + ROLLING_CENTER(wavefronts->rolling_max_distance);
+  wavefronts->wavefronts[0].lo = 0;
+  wavefronts->wavefronts[0].hi = 0;
+  wavefronts->wavefronts[0].predecessors = NULL;
+  offsets[0] = 0;
+  edit_wavefronts_set_sentinels(offsets,0,0);
+  // Compute wavefronts for increasing distance
+  for (distance=0;distance<=max_distance;++distance) {
+    edit_wavefront_t* const wavefront = &wavefronts->wavefronts[distance];
+    wavefront->offsets = offsets; // Valid until the next wavefront
+    // Extend diagonally each wavefront point
+    edit_wavefronts_extend_offsets(wavefronts,offsets,wavefront->lo,wavefront->hi,
+        pattern,pattern_length,text,text_length);
+    // Exit condition
+    if (wavefront->lo <= target_k && target_k <= wavefront->hi && offsets[target_k] == target_offset) {
+      const int edit_cigar_length = edit_wavefronts_backtrace_compact(wavefronts,
+          pattern,pattern_length,text,text_length,wavefronts->edit_cigar,target_k,distance);
+      if (edit_cigar_length < 0) return;
+      wavefronts->edit_cigar_length = edit_cigar_length;
+      (*score) = distance;
+      return;
+    }
+    // Reduce wavefront
+    if (reduction != NULL) {
+      EWF_STATS_TIMER_START(cycles_start);
+      edit_wavefronts_reduce_wavefront(wavefront,pattern_length,text_length,reduction);
+      EWF_STATS_TIMER_STOP(wavefronts,reduce,cycles_start);
+    }
+    // Compute next wavefront starting point (on the other rolling wavefront)
+    if (distance == max_distance || edit_wavefronts_rolling_reserve(wavefronts,distance+1)) break;
+    const int center = ROLLING_CENTER(wavefronts->rolling_max_distance);
+    offsets = (ewf_offset_t*)wavefronts->rolling_mem[distance%2] + center;
+    ewf_offset_t* const next_offsets = (ewf_offset_t*)wavefronts->rolling_mem[(distance+1)%2] + center;
+    const int lo = wavefront->lo, hi = wavefront->hi;
+    edit_wavefront_t* const next_wavefront = &wavefronts->wavefronts[distance+1];
+    const int predecessors_length = PREDECESSORS_LENGTH(2*(distance+1)+1);
+    next_wavefront->lo = lo-1;
+    next_wavefront->hi = hi+1;
+    next_wavefront->predecessors = edit_wavefronts_allocate(wavefronts,predecessors_length);
+    if (next_wavefront->predecessors == NULL) break;
+    EWF_STATS_TIMER_START(cycles_start);
+    edit_wavefronts_compute_offsets(offsets,next_offsets,lo,hi);
+    edit_wavefronts_compute_predecessors(offsets,next_offsets,next_wavefront->predecessors,lo,hi,distance+1);
+    EWF_STATS_TIMER_STOP(wavefronts,compute,cycles_start);
+    EWF_STATS_WAVEFRONT(wavefronts,hi-lo+3);
+    offsets = next_offsets;
+  }
+}
+
+/*
+ * Inter-pair: Set the sentinel offsets of every lane around diagonals lo..hi
+ */
+static void edit_wavefronts_set_lanes_sentinels(
+    ewf_offset_t* const offsets,
+    const int lo,
+    const int hi) {
+  int lane;
+  for (lane=0;lane<EWF_LANES;++lane) {
+    offsets[(lo-2)*EWF_LANES+lane] = EWF_OFFSET_NULL;
+    offsets[(lo-1)*EWF_LANES+lane] = EWF_OFFSET_NULL;
+    offsets[(hi+1)*EWF_LANES+lane] = EWF_OFFSET_NULL;
+    offsets[(hi+2)*EWF_LANES+lane] = EWF_OFFSET_NULL;
+  }
+}
+
+/*
+ * Inter-pair: Allocate the wavefront of every lane at distance (diagonals -distance..distance)
+ *   Returns its offsets centered at k=0, NULL if the arena is full
+ */
+static ewf_offset_t* edit_wavefronts_allocate_lanes(
+    edit_wavefronts_t* const wavefronts,
+    const int distance) {
+  const int wavefront_length = 2*distance + 1 + 2*WAVEFRONT_PADDING;
+  ewf_offset_t* const offsets_mem = edit_wavefronts_allocate(wavefronts,wavefront_length*EWF_LANES*sizeof(ewf_offset_t));
+  if (offsets_mem == NULL) return NULL;
+  edit_wavefront_t* const wavefront = wavefronts->wavefronts + distance;
+  wavefront->lo = -distance;
+  wavefront->hi = distance;
+  wavefront->offsets_mem = offsets_mem;
+  wavefront->offsets = offsets_mem + (WAVEFRONT_PADDING+distance)*EWF_LANES;
+  return wavefront->offsets;
+}
+
+/*
+ * Inter-pair: Extend the wavefront of a lane (of the lanes being aligned)
+ */
+static void edit_wavefronts_extend_lane(
+    edit_wavefronts_t* const wavefronts,
+    ewf_offset_t* const offsets,
+    const int lane,
+    const int k_min,
+    const int k_max) {
+  const ewf_lanes_t* const lanes = wavefronts->lanes;
+  const char* const pattern = lanes->patterns[lane];
+  const int pattern_length = lanes->pattern_lengths[lane];
+  const char* const text = lanes->texts[lane];
+  const int text_length = lanes->text_lengths[lane];
+  const ewf_packed_pair_t* const packed = lanes->packed[lane];
+  EWF_STATS_TIMER_START(cycles_start);
+  // Extend diagonally each wavefront point of the lane
+  int k;
+  for (k=k_min;k<=k_max;++k) {
+    ewf_offset_t* const offset = offsets + k*EWF_LANES + lane;
+    const int v = EWAVEFRONT_V(k,*offset);
+    const int h = EWAVEFRONT_H(k,*offset);
+    if (v >= pattern_length || h >= text_length) continue; // Outside the sequences
+    const int max_length = MIN(pattern_length-v,text_length-h);
+    int length;
+    if (packed != NULL) {
+      length = ewf_match_forward_packed(
+          packed->pattern_packed,pattern+v-packed->pattern,
+          packed->text_packed,text+h-packed->text,max_length);
+    }
+    else {
+      length = ewf_match_forward(pattern+v,text+h,max_length);
+    }
+    (*offset) += length;
+    EWF_STATS_ADD(wavefronts,extend_chars,length+(length<max_length)); // Matches and the mismatch
+  }
+  EWF_STATS_TIMER_STOP(wavefronts,extend,cycles_start);
+}
+
+/*
+ * Inter-pair: Backtrace of a lane (same operations as edit_wavefronts_backtrace)
+ *   Appends the operations backwards to the CIGAR, returns its length
+ */
+static int edit_wavefronts_backtrace_lane(
+    edit_wavefronts_t* const wavefronts,
+    const int lane,
+    char* const edit_cigar,
+    const int target_k,
+    const int target_distance) {
+  // Parameters
+  EWF_STATS_TIMER_START(cycles_start);
+  int edit_cigar_length = 0;
+  int k = target_k, distance = target_distance;
+  ewf_offset_t offset = EWF_OFFSETS(&wavefronts->wavefronts[distance])[k*EWF_LANES+lane];
+  while (distance > 0) {
+    EWF_STATS_ADD(wavefronts,backtrace_steps,1);
+    // Fetch (every wavefront spans -distance..distance)
+    const ewf_offset_t* const offsets = EWF_OFFSETS(&wavefronts->wavefronts[distance-1]) + lane;
+    const int limit = distance-1;
+    // Traceback operation
+    if (k+1 <= limit && offset == offsets[(k+1)*EWF_LANES]) {
+      edit_cigar_length = edit_cigar_append(edit_cigar,edit_cigar_length,CIGAR_OP_D,1);
+      ++k;
+      --distance;
+    } else if (-limit <= k-1 && offset == offsets[(k-1)*EWF_LANES] + 1) {
+      edit_cigar_length = edit_cigar_append(edit_cigar,edit_cigar_length,CIGAR_OP_I,1);
+      --k;
+      --offset;
+      --distance;
+    } else if (-limit <= k && k <= limit && offset == offsets[k*EWF_LANES] + 1) {
+      edit_cigar_length = edit_cigar_append(edit_cigar,edit_cigar_length,CIGAR_OP_X,1);
+      --distance;
+      --offset;
+    } else {
+      edit_cigar_length = edit_cigar_append(edit_cigar,edit_cigar_length,CIGAR_OP_M,1);
+      --offset;
+    }
+  }
+  // Account for last offset of matches
+  EWF_STATS_ADD(wavefronts,backtrace_steps,offset);
+  edit_cigar_length = edit_cigar_append(edit_cigar,edit_cigar_length,CIGAR_OP_M,offset);
+  EWF_STATS_TIMER_STOP(wavefronts,backtrace,cycles_start);
+  // Return CIGAR length
+  return edit_cigar_length;
+}
+
+/*
+ * Inter-pair edit distance alignment (one pair per lane, up to EWF_LANES pairs)
+ *   Wavefronts of all lanes are computed at once up to the distance of the last
+ *   lane still aligning. Lanes reaching their target or budget drop out of the
+ *   extension (and are traced back unless score_only). Offsets of lanes that
+ *   dropped out keep growing by one per distance, so the offset width must fit
+ *   the longest pair plus the distance of any lane (edit_wavefronts_align_lanes).
+ *   Score only keeps two rolling wavefronts, otherwise every distance is kept.
+ */
+static void edit_wavefronts_align_lanes(
+    edit_wavefronts_t* const wavefronts,
+    const ewf_lanes_t* const lanes,
+    const bool score_only) {
+  // Parameters of each lane
+  int max_distances[EWF_LANES], target_ks[EWF_LANES];
+  ewf_offset_t target_offsets[EWF_LANES];
+  uint32_t active = 0; // Lanes still aligning (bit per lane)
+  int lane, max_distance = 0;
+  for (lane=0;lane<lanes->num_lanes;++lane) {
+    const int pattern_length = lanes->pattern_lengths[lane];
+    const int text_length = lanes->text_lengths[lane];
+    max_distances[lane] = MIN(pattern_length+text_length,wavefronts->max_score);
+    target_ks[lane] = EWAVEFRONT_DIAGONAL(text_length,pattern_length);
+    target_offsets[lane] = EWAVEFRONT_OFFSET(text_length,pattern_length);
+    max_distance = MAX(max_distance,max_distances[lane]);
+    active |= 1u << lane;
+    *(lanes->scores[lane]) = EWF_SCORE_UNALIGNED;
+    *(lanes->cigar_lengths[lane]) = 0;
+  }
+  // Init wavefronts
+  ewf_offset_t* rolling[2] = {NULL,NULL};
+  const int center = (WAVEFRONT_PADDING+max_distance)*EWF_LANES;
+  if (score_only) {
+    const size_t rolling_size = (2*max_distance+1+2*WAVEFRONT_PADDING)*EWF_LANES*sizeof(ewf_offset_t);
+    rolling[0] = edit_wavefronts_allocate(wavefronts,rolling_size);
+    rolling[1] = edit_wavefronts_allocate(wavefronts,rolling_size);
+    if (rolling[0] == NULL || rolling[1] == NULL) return;
+  }
+  ewf_offset_t* offsets = score_only ? rolling[0] + center : edit_wavefronts_allocate_lanes(wavefronts,0);
+  if (offsets == NULL) return;
+  for (lane=0;lane<EWF_LANES;++lane) {
+    offsets[lane] = 0;
+  }
+  edit_wavefronts_set_lanes_sentinels(offsets,0,0);
+  wavefronts->lanes = lanes;
+  // Compute wavefronts for increasing distance
+  int distance;
+  for (distance=0;active!=0;++distance) {
+    // Extend diagonally the lanes still aligning
+    for (lane=0;lane<lanes->num_lanes;++lane) {
+      if (!(active & (1u << lane))) continue;
+      edit_wavefronts_extend_lane(wavefronts,offsets,lane,-distance,distance);
+      // Exit condition (the lane drops out)
+      const int target_k = target_ks[lane];
+      if (ABS(target_k) <= distance && offsets[target_k*EWF_LANES+lane] == target_offsets[lane]) {
+        *(lanes->scores[lane]) = distance;
+        if (!score_only) {
+          char* const edit_cigar = lanes->cigars[lane];
+          const int edit_cigar_length = edit_wavefronts_backtrace_lane(wavefronts,lane,edit_cigar,target_k,distance);
+          edit_cigar_reverse(edit_cigar,edit_cigar_length);
+          *(lanes->cigar_lengths[lane]) = edit_cigar_length;
+        }
+        active &= ~(1u << lane);
+      }
+      else if (distance == max_distances[lane]) {
+        active &= ~(1u << lane); // Distance above the budget
+      }
+    }
+    if (active == 0) break;
+    // Compute next wavefront of every lane
+    ewf_offset_t* const next_offsets = score_only ?
+        rolling[(distance+1)%2] + center : edit_wavefronts_allocate_lanes(wavefronts,distance+1);
+    if (next_offsets == NULL) break;
+    EWF_STATS_TIMER_START(cycles_start);
+    ewf_compute_lanes(offsets,next_offsets,-distance,distance);
+    edit_wavefronts_set_lanes_sentinels(next_offsets,-distance-1,distance+1);
+    EWF_STATS_TIMER_STOP(wavefronts,compute,cycles_start);
+    EWF_STATS_WAVEFRONT(wavefronts,(2*distance+3)*EWF_LANES);
+    offsets = next_offsets;
+  }
+  wavefronts->lanes = NULL;
+}
+
+/*
+ * BiWFA: Extend Wavefront Offsets (forward or reverse, skipping null offsets)
+ */
+static void edit_bialign_extend_offsets(
+    edit_wavefronts_t* const wavefronts,
+    ewf_offset_t* const offsets,
+    const int lo,
+    const int hi,
+    const char* const pattern,
+    const int pattern_length,
+    const char* const text,
+    const int text_length,
+    const bool reverse) {
+  const ewf_packed_pair_t* const packed = wavefronts->packed;
+  EWF_STATS_TIMER_START(cycles_start);
+  int k;
+  for (k=lo;k<=hi;++k) {
+    if (offsets[k] < 0) continue; // Null
+    const int v = EWAVEFRONT_V(k,offsets[k]);
+    const int h = EWAVEFRONT_H(k,offsets[k]);
+    const int max_length = MIN(pattern_length-v,text_length-h);
+    int length;
+    if (packed != NULL && reverse) {
+      length = ewf_match_reverse_packed(
+          packed->pattern_packed,pattern+pattern_length-v-packed->pattern,
+          packed->text_packed,text+text_length-h-packed->text,max_length);
+    }
+    else if (packed != NULL) {
+      length = ewf_match_forward_packed(
+          packed->pattern_packed,pattern+v-packed->pattern,
+          packed->text_packed,text+h-packed->text,max_length);
+    }
+    else if (reverse) {
+      length = ewf_match_reverse(pattern+pattern_length-v,text+text_length-h,max_length);
+    }
+    else {
+      length = ewf_match_forward(pattern+v,text+h,max_length);
+    }
+    offsets[k] += length;
+    EWF_STATS_ADD(wavefronts,extend_chars,length+(length<max_length)); // Matches and the mismatch
+  }
+  EWF_STATS_TIMER_STOP(wavefronts,extend,cycles_start);
+}
+
+/*
+ * BiWFA: Compute Wavefront Offsets (next wavefront spans lo-1..hi+1)
+ *   Unlike edit_wavefronts_compute_offsets, operations leaving the
+ *   sequences are discarded (null offsets), so every offset is a valid cell
+ */
+static void edit_bialign_compute_offsets(
+    const ewf_offset_t* const offsets,
+    ewf_offset_t* const next_offsets,
+    const int lo,
+    const int hi,
+    const int pattern_length,
+    const int text_length) {
+  int k;
+  for (k=lo-1;k<=hi+1;++k) {
+    // Fetch candidates
+    ewf_offset_t del = (k+1 <= hi) ? offsets[k+1] : EWF_OFFSET_NULL; // Upper
+    ewf_offset_t sub = (lo <= k && k <= hi) ? offsets[k] + 1 : EWF_OFFSET_NULL; // Mid
+    ewf_offset_t ins = (lo <= k-1) ? offsets[k-1] + 1 : EWF_OFFSET_NULL; // Lower
+    // Discard null sources and cells outside the sequences
+    if (del < 0 || EWAVEFRONT_V(k,del) > pattern_length) del = EWF_OFFSET_NULL;
+    if (sub < 1 || sub > text_length || EWAVEFRONT_V(k,sub) > pattern_length) sub = EWF_OFFSET_NULL;
+    if (ins < 1 || ins > text_length) ins = EWF_OFFSET_NULL;
+    next_offsets[k] = MAX(MAX(del,sub),ins);
+  }
+}
+
+/*
+ * BiWFA: Find a cell where the forward and reverse wavefronts overlap
+ *   Reverse diagonals are taken on the reversed sequences (kr = text_length-pattern_length-k)
+ */
+static bool edit_bialign_overlap(
+    const ewf_offset_t* const forward_offsets,
+    const int forward_distance,
+    const ewf_offset_t* const reverse_offsets,
+    const int reverse_distance,
+    const int pattern_length,
+    const int text_length,
+    int* const breakpoint_h,
+    int* const breakpoint_v) {
+  const int k_reverse = EWAVEFRONT_DIAGONAL(text_length,pattern_length);
+  const int lo = MAX(-forward_distance,k_reverse-reverse_distance);
+  const int hi = MIN(forward_distance,k_reverse+reverse_distance);
+  int k;
+  for (k=lo;k<=hi;++k) {
+    const ewf_offset_t forward_offset = forward_offsets[k];
+    const ewf_offset_t reverse_offset = reverse_offsets[k_reverse-k];
+    if (forward_offset < 0 || reverse_offset < 0) continue; // Null
+    if (forward_offset + reverse_offset >= text_length) {
+      *breakpoint_h = EWAVEFRONT_H(k,forward_offset);
+      *breakpoint_v = EWAVEFRONT_V(k,forward_offset);
+      return true;
+    }
+  }
+  return false;
+}
+
+/*
+ * BiWFA: Breakpoint of an optimal alignment
+ *   Computes forward and reverse wavefronts (alternating) until they overlap.
+ *   The alignment splits at the breakpoint into a prefix of score
+ *   forward_distance and a suffix of score reverse_distance.
+ *   Fails if the score exceeds max_score.
+ */
+static int edit_bialign_breakpoint(
+    edit_wavefronts_t* const wavefronts,
+    const char* const pattern,
+    const int pattern_length,
+    const char* const text,
+    const int text_length,
+    const int max_score,
+    int* const breakpoint_h,
+    int* const breakpoint_v,
+    int* const forward_distance,
+    int* const reverse_distance) {
+  // Init wavefronts
+  int center = ROLLING_CENTER(wavefronts->rolling_max_distance);
+  int distance_f = 0, distance_r = 0;
+  ((ewf_offset_t*)wavefronts->rolling_mem[0])[center] = 0;
+  ((ewf_offset_t*)wavefronts->rolling_mem[2])[center] = 0;
+  edit_bialign_extend_offsets(wavefronts,(ewf_offset_t*)wavefronts->rolling_mem[0]+center,0,0,
+      pattern,pattern_length,text,text_length,false);
+  edit_bialign_extend_offsets(wavefronts,(ewf_offset_t*)wavefronts->rolling_mem[2]+center,0,0,
+      pattern,pattern_length,text,text_length,true);
+  // Compute wavefronts until they overlap
+  while (!edit_bialign_overlap(
+      (ewf_offset_t*)wavefronts->rolling_mem[distance_f%2]+center,distance_f,
+      (ewf_offset_t*)wavefronts->rolling_mem[2+distance_r%2]+center,distance_r,
+      pattern_length,text_length,breakpoint_h,breakpoint_v)) {
+    // Advance the wavefront with the lowest distance
+    if (distance_f + distance_r >= max_score) return EXIT_FAILURE;
+    const bool reverse = (distance_r < distance_f);
+    const int distance = reverse ? distance_r : distance_f;
+    if (edit_wavefronts_rolling_reserve(wavefronts,distance+1)) return EXIT_FAILURE;
+    center = ROLLING_CENTER(wavefronts->rolling_max_distance);
+    ewf_offset_t* const offsets = (ewf_offset_t*)wavefronts->rolling_mem[2*reverse+distance%2] + center;
+    ewf_offset_t* const next_offsets = (ewf_offset_t*)wavefronts->rolling_mem[2*reverse+(distance+1)%2] + center;
+    EWF_STATS_TIMER_START(cycles_start);
+    edit_bialign_compute_offsets(offsets,next_offsets,-distance,distance,pattern_length,text_length);
+    EWF_STATS_TIMER_STOP(wavefronts,compute,cycles_start);
+    EWF_STATS_WAVEFRONT(wavefronts,2*distance+3);
+    edit_bialign_extend_offsets(wavefronts,next_offsets,-distance-1,distance+1,
+        pattern,pattern_length,text,text_length,reverse);
+    if (reverse) ++distance_r; else ++distance_f;
+  }
+  *forward_distance = distance_f;
+  *reverse_distance = distance_r;
+  return EXIT_SUCCESS;
+}
+
+/*
+ * BiWFA: Align a sub-problem of known score, appending its (reversed) CIGAR
+ */
+static int edit_bialign_align_subproblem(
+    edit_wavefronts_t* const wavefronts,
+    const char* const pattern,
+    const int pattern_length,
+    const char* const text,
+    const int text_length,
+    const int score) {
+  // Base case: regular WFA (O(s^2) memory with s <= BIWFA_BASE_SCORE)
+  if (score <= BIWFA_BASE_SCORE) {
+    edit_wavefronts_clean(wavefronts);
+    const int distance = edit_wavefronts_compute_wavefronts(wavefronts,
+        pattern,pattern_length,text,text_length,score,NULL);
+    if (distance == EWF_SCORE_UNALIGNED) return EXIT_FAILURE;
+    const int target_k = EWAVEFRONT_DIAGONAL(text_length,pattern_length);
+    wavefronts->edit_cigar_length = edit_wavefronts_backtrace(wavefronts,
+        wavefronts->edit_cigar,wavefronts->edit_cigar_length,target_k,distance);
+    return EXIT_SUCCESS;
+  }
+  // Split at the breakpoint
+  int h, v, forward_distance, reverse_distance;
+  if (edit_bialign_breakpoint(wavefronts,pattern,pattern_length,text,text_length,
+      score,&h,&v,&forward_distance,&reverse_distance)) return EXIT_FAILURE;
+  // Suffix first (the CIGAR is built backwards)
+  if (edit_bialign_align_subproblem(wavefronts,
+      pattern+v,pattern_length-v,text+h,text_length-h,reverse_distance)) return EXIT_FAILURE;
+  return edit_bialign_align_subproblem(wavefronts,
+      pattern,v,text,h,forward_distance);
+}
+
+/*
+ * Edit distance alignment using bidirectional wavefronts (BiWFA)
+ */
+static void edit_bialign_align(
+    edit_wavefronts_t* const wavefronts,
+    const char* const pattern,
+    const int pattern_length,
+    const char* const text,
+    const int text_length,
+    int* const score) {
+  // Find the breakpoint of the whole alignment
+  int h, v, forward_distance, reverse_distance;
+  wavefronts->edit_cigar_length = 0;
+  if (edit_bialign_breakpoint(wavefronts,pattern,pattern_length,text,text_length,
+      wavefronts->max_score,&h,&v,&forward_distance,&reverse_distance)) {
+    (*score) = EWF_SCORE_UNALIGNED;
+    return;
+  }
+  (*score) = forward_distance + reverse_distance;
+  // Align both halves (suffix first, the CIGAR is built backwards)
+  if (edit_bialign_align_subproblem(wavefronts,
+          pattern+v,pattern_length-v,text+h,text_length-h,reverse_distance) ||
+      edit_bialign_align_subproblem(wavefronts,
+          pattern,v,text,h,forward_distance)) {
+    (*score) = EWF_SCORE_UNALIGNED;
+    wavefronts->edit_cigar_length = 0;
+    return;
+  }
+  edit_cigar_reverse(wavefronts->edit_cigar,wavefronts->edit_cigar_length);
+}
+
+
+#undef ewf_offset_t
+#undef EWF_OFFSET_NULL
+#undef EWF_OFFSET_MAX
+#undef EWF_MM256
+#undef EWF_MM512
+#undef EWF_MM256_LANES
+#undef EWF_MM512_LANES
+#undef EWF_OFFSETS
+#undef EWF_LANES
+#undef EWF_FN
+#undef EWF_FN_BITS
+#undef EWF_FN_PASTE
+#undef ewf_compute_kernel_t
+#undef ewf_compute_offsets
+#undef ewf_compute_offsets_peeled
+#undef ewf_compute_offsets_scalar
+#undef ewf_compute_offsets_avx2
+#undef ewf_compute_offsets_avx512
+#undef edit_wavefronts_set_sentinels
+#undef edit_wavefronts_allocate_wavefront
+#undef edit_wavefronts_rolling_reserve
+#undef edit_wavefronts_backtrace
+#undef edit_wavefronts_backtrace_compact
+#undef edit_wavefronts_extend_offsets
+#undef edit_wavefronts_extend_wavefront
+#undef edit_wavefronts_select_compute_kernel
+#undef edit_wavefronts_compute_offsets
+#undef edit_wavefronts_compute_benchmark
+#undef edit_wavefronts_compute_wavefront
+#undef edit_wavefronts_compute_predecessors
+#undef edit_wavefronts_distance_to_target
+#undef edit_wavefronts_reduce_wavefront
+#undef edit_wavefronts_compute_wavefronts
+#undef edit_wavefronts_align
+#undef edit_wavefronts_align_score_only
+#undef edit_wavefronts_align_compact
+#undef ewf_compute_lanes_kernel_t
+#undef ewf_compute_lanes
+#undef ewf_compute_lanes_scalar
+#undef ewf_compute_lanes_avx2
+#undef ewf_compute_lanes_avx512
+#undef edit_wavefronts_set_lanes_sentinels
+#undef edit_wavefronts_allocate_lanes
+#undef edit_wavefronts_extend_lane
+#undef edit_wavefronts_backtrace_lane
+#undef edit_wavefronts_align_lanes
+#undef edit_bialign_extend_offsets
+#undef edit_bialign_compute_offsets
+#undef edit_bialign_overlap
+#undef edit_bialign_breakpoint
+#undef edit_bialign_align_subproblem
+#undef edit_bialign_align
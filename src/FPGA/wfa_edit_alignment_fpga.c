@@ -30,6 +30,9 @@
 #include <sys/time.h>
 #include <time.h>
 
+#include "wfa_edit_common.h"
+#include "wfa_edit_io.h"
+
 double wall_time () {
    struct timespec ts;
    clock_gettime(CLOCK_MONOTONIC,&ts);
@@ -45,16 +48,11 @@ double wall_time () {
 #define EWAVEFRONT_DIAGONAL(h,v) ((h)-(v))
 #define EWAVEFRONT_OFFSET(h,v)   (h)
 
-#define MAX(a,b) (((a)>=(b))?(a):(b))
-#define ABS(a) (((a)>=0)?(a):-(a))
-
-#define PRINTF(format, ...) do { printf(format, ##__VA_ARGS__); } while(0)
-#define PRINTF_COND(condition,format, ...) do { if (condition) { printf(format, ##__VA_ARGS__); } } while(0)
-#define PRINTF_ERROR(format, ...) do { fprintf(stderr, format, ##__VA_ARGS__); } while(0);
+#define ALIGN_UP(size,alignment) ((((size)+(alignment)-1)/(alignment))*(alignment))
 
-#define LO_IDX(distance) (-distance)
+#define LO_IDX(distance) (-(distance))
 #define HI_IDX(distance) (distance)
-#define OFFSET_IDX(distance, k) (distance*(distance+1) + k)
+#define OFFSET_IDX(distance, k) ((distance)*((distance)+1) + (k))
 
 #ifndef FPGA_EMU
 #define FPGA(p) _Pragma(p)
@@ -62,40 +60,115 @@ double wall_time () {
 #define FPGA(...)
 #endif            
 
+// Accelerator instances of each task (the tasks of a batch run concurrently on them)
+#ifndef EWF_FPGA_INSTANCES
+#define EWF_FPGA_INSTANCES 1
+#endif
+#define FPGA_STR(x) FPGA_STR_(x)
+#define FPGA_STR_(x) #x
+#define FPGA_TASK(clauses) FPGA(FPGA_STR(oss task device(fpga) num_instances(EWF_FPGA_INSTANCES) clauses))
+
+// Maximum score supported by device-local wavefronts
+#ifndef EWF_MAX_SCORE
+#define EWF_MAX_SCORE 1024
+#endif
+
+// Offset width of device-local wavefronts (8, 16 or 32 bits, one per bitstream)
+#ifndef EWF_OFFSET_BITS
+#define EWF_OFFSET_BITS 16
+#endif
+
+// BiWFA sub-problems up to this score use regular WFA (must be >= 1)
+#ifndef EWF_BIWFA_BASE_SCORE
+#define EWF_BIWFA_BASE_SCORE 32
+#endif
+#define EWF_BIWFA_STACK_SIZE 64
+
+// Maximum score of the compact backtrace (2 bits per cell, about half the memory of the offsets of EWF_MAX_SCORE)
+#ifndef EWF_COMPACT_MAX_SCORE
+#define EWF_COMPACT_MAX_SCORE (2*EWF_MAX_SCORE)
+#endif
+#define EWF_DEVICE_MAX_SCORE(compact_backtrace) ((compact_backtrace) ? EWF_COMPACT_MAX_SCORE : EWF_MAX_SCORE)
+
+#define DEFAULT_BATCH_SIZE (16*EWF_FPGA_INSTANCES)
+#define DEFAULT_PIPELINE_BATCHES 3
+#define DEFAULT_REDUCTION_MIN_LENGTH 10
+#define DEFAULT_REDUCTION_MAX_DISTANCE 50
+#define DEFAULT_INPUT_THREADS 2
+
+#define PACKED_BASES_PER_WORD 32
+#define PACKED_WORDS(length) (1+((length)+PACKED_BASES_PER_WORD-1)/PACKED_BASES_PER_WORD+1) // Padding words before and after
+
+#if EWF_OFFSET_BITS == 8
+typedef int8_t ewf_offset_t;   // Edit Wavefront Offset
+#define EWF_OFFSET_NULL (INT8_MIN/2)
+#define EWF_OFFSET_MAX INT8_MAX
+#elif EWF_OFFSET_BITS == 16
 typedef int16_t ewf_offset_t;  // Edit Wavefront Offset
+#define EWF_OFFSET_NULL (INT16_MIN/2)
+#define EWF_OFFSET_MAX INT16_MAX
+#elif EWF_OFFSET_BITS == 32
+typedef int32_t ewf_offset_t;  // Edit Wavefront Offset
+#define EWF_OFFSET_NULL (INT32_MIN/2)
+#define EWF_OFFSET_MAX INT32_MAX
+#else
+#error "EWF_OFFSET_BITS must be 8, 16 or 32"
+#endif
 
 /*
- * Wavefront for FPGA device
+ * Adaptive Wavefront Reduction (regular WFA only)
  */
 typedef struct {
-  ewf_offset_t* offsets;
+  bool enabled;
+  int min_wavefront_length;    // Narrower wavefronts are not reduced
+  int max_distance_threshold;  // Drop diagonals this much further from the target than the best one
+} ewf_reduction_t;
+
+/*
+ * Wavefront results for FPGA device (wavefronts stay in device-local memory)
+ */
+typedef struct {
+  int max_score;               // Distance budget (pairs above it are not aligned)
 
   // CIGAR
+  int max_cigar_length;
   char* edit_cigar;
   int edit_cigar_length;
 
 } edit_wavefronts_fpga_t;
 
+/*
+ * Check that the offsets of a pair fit the device offset width
+ *   Offsets reach text_length plus the distance, which is at most
+ *   MAX(pattern_length,text_length) for optimal alignments and
+ *   pattern_length+text_length with reduction (both capped by max_score, the device budget)
+ */
+bool edit_wavefronts_offsets_fit(
+    const int pattern_length,
+    const int text_length,
+    const int max_score,
+    const bool reduction) {
+  const int64_t max_distance = reduction ?
+      (int64_t)pattern_length+text_length : MAX(pattern_length,text_length);
+  const int64_t max_offset = text_length + MIN(max_distance,max_score) + 1;
+  return max_offset <= EWF_OFFSET_MAX;
+}
+
 int edit_wavefronts_init(
     edit_wavefronts_fpga_t* const wavefronts,
     const int pattern_length,
     const int text_length,
+    const int max_score,
     const bool aligned,
     const size_t page_size) {
 
-  const int max_distance = pattern_length + text_length;
-  // Allocate wavefronts diagonals index
+  const int max_cigar_length = edit_wavefronts_max_cigar_length(pattern_length,text_length,max_score);
+  wavefronts->max_score = max_score;
+  wavefronts->max_cigar_length = max_cigar_length;
   if(aligned){
 
-    // Allocate wavefronts offsets aligned to page size
-    wavefronts->offsets= (ewf_offset_t*) aligned_alloc(page_size,max_distance*max_distance*sizeof(ewf_offset_t));
-    if(wavefronts->offsets == NULL){
-      PRINTF_ERROR("Aligned allocation of wavefronts offsets failed");
-      return EXIT_FAILURE;
-    }
-
     // Allocate CIGAR aligned to page size
-    wavefronts->edit_cigar = (char*) aligned_alloc(page_size,max_distance);
+    wavefronts->edit_cigar = (char*) aligned_alloc(page_size,ALIGN_UP(max_cigar_length+1,page_size));
     if(wavefronts->edit_cigar == NULL){
       PRINTF_ERROR("Aligned allocation of CIGAR failed");
       return EXIT_FAILURE;
@@ -104,16 +177,9 @@ int edit_wavefronts_init(
   }
   else{
 
-    // Allocate wavefronts offsets
-    wavefronts->offsets= calloc(max_distance*max_distance,sizeof(ewf_offset_t));
-    if(wavefronts->offsets == NULL){
-      PRINTF_ERROR("Allocation of wavefronts offsets failed");
-      return EXIT_FAILURE;
-    }
-
     // Allocate CIGAR
-    wavefronts->edit_cigar = malloc(max_distance);
-    if(wavefronts->offsets == NULL){
+    wavefronts->edit_cigar = malloc(max_cigar_length+1);
+    if(wavefronts->edit_cigar == NULL){
       PRINTF_ERROR("Allocation of CIGAR failed");
       return EXIT_FAILURE;
     }
@@ -126,96 +192,226 @@ int edit_wavefronts_init(
 
 void edit_wavefronts_clean(
     edit_wavefronts_fpga_t* const wavefronts) {
-  free(wavefronts->offsets);
   free(wavefronts->edit_cigar);
 }
 
+int edit_wavefronts_resize(
+    edit_wavefronts_fpga_t* const wavefronts,
+    const int pattern_length,
+    const int text_length,
+    const bool aligned,
+    const size_t page_size) {
+  // Keep current buffers if the pair fits
+  const int max_score = wavefronts->max_score;
+  if (edit_wavefronts_max_cigar_length(pattern_length,text_length,max_score) <= wavefronts->max_cigar_length) return EXIT_SUCCESS;
+  // Reallocate for the new dimensions
+  edit_wavefronts_clean(wavefronts);
+  return edit_wavefronts_init(wavefronts,pattern_length,text_length,max_score,aligned,page_size);
+}
+
 
 /*
  * Edit Wavefront Backtrace
+ *   Wavefront of distance d spans diagonals wavefronts_lo[d]..wavefronts_hi[d]
+ *   Appends the operations backwards to the CIGAR, returns its new length
  */
 int edit_wavefronts_backtrace(
     const ewf_offset_t* const offsets_wavefronts,
+    const int* const wavefronts_lo,
+    const int* const wavefronts_hi,
     char* const edit_cigar,
+    int edit_cigar_length,
     const int target_k,
     const int target_distance) {
   // Parameters
-  int edit_cigar_idx = 0;
   int k = target_k, distance = target_distance;
   ewf_offset_t offset = offsets_wavefronts[OFFSET_IDX(distance,k)];
   while (distance > 0) {
     // Fetch
     const ewf_offset_t* const offsets = offsets_wavefronts + OFFSET_IDX((distance-1),0);
-    const int lo = LO_IDX(distance);
-    const int hi = HI_IDX(distance);
+    const int lo = wavefronts_lo[distance-1];
+    const int hi = wavefronts_hi[distance-1];
     // Traceback operation
     if (lo <= k+1 && k+1 <= hi && offset == offsets[k+1]) {
-      edit_cigar[edit_cigar_idx++] = 'D';
+      edit_cigar_length = edit_cigar_append(edit_cigar,edit_cigar_length,CIGAR_OP_D,1);
       ++k;
       --distance;
     } else if (lo <= k-1 && k-1 <= hi && offset == offsets[k-1] + 1) {
-      edit_cigar[edit_cigar_idx++] = 'I';
+      edit_cigar_length = edit_cigar_append(edit_cigar,edit_cigar_length,CIGAR_OP_I,1);
       --k;
       --offset;
       --distance;
     } else if (lo <= k && k <= hi && offset == offsets[k] + 1) {
-      edit_cigar[edit_cigar_idx++] = 'X';
+      edit_cigar_length = edit_cigar_append(edit_cigar,edit_cigar_length,CIGAR_OP_X,1);
       --distance;
       --offset;
     } else {
-      edit_cigar[edit_cigar_idx++] = 'M';
+      edit_cigar_length = edit_cigar_append(edit_cigar,edit_cigar_length,CIGAR_OP_M,1);
       --offset;
     }
   }
   // Account for last offset of matches
-  while (offset > 0) {
-    edit_cigar[edit_cigar_idx++] = 'M';
-    --offset;
+  edit_cigar_length = edit_cigar_append(edit_cigar,edit_cigar_length,CIGAR_OP_M,offset);
+  // Return CIGAR length
+  return edit_cigar_length;
+}
+
+/*
+ * Edit Wavefront Compact Backtrace (forward CIGAR)
+ *   Cell (distance,k) keeps its winning operation at OFFSET_IDX(distance,k) of predecessors.
+ *   Walks them back to the origin, then re-extends the match runs forward along that path
+ *   (reaching the offsets of the compute step)
+ */
+int edit_wavefronts_backtrace_compact(
+    const uint8_t* const predecessors,
+    uint8_t* const operations,
+    const char* const pattern,
+    const int pattern_length,
+    const char* const text,
+    const int text_length,
+    char* const edit_cigar,
+    const int target_k,
+    const int target_distance) {
+  // Operations of the path (back to the origin)
+  int k = target_k, distance;
+  for (distance=target_distance;distance>0;--distance) {
+    const int op = PREDECESSOR_GET(predecessors,OFFSET_IDX(distance,k));
+    operations[distance] = op;
+    if (op == CIGAR_OP_D) ++k;
+    else if (op == CIGAR_OP_I) --k;
+  }
+  // Re-extend the path forward
+  int edit_cigar_length = 0, offset = 0;
+  for (distance=0;distance<=target_distance;++distance) {
+    if (distance > 0) {
+      const int op = operations[distance];
+      edit_cigar_length = edit_cigar_append(edit_cigar,edit_cigar_length,op,1);
+      if (op == CIGAR_OP_D) --k;
+      else if (op == CIGAR_OP_I) { ++k; ++offset; }
+      else ++offset;
+    }
+    int v = EWAVEFRONT_V(k,offset);
+    int h = EWAVEFRONT_H(k,offset);
+    int length = 0;
+    while (v<pattern_length && h<text_length && pattern[v++]==text[h++]) {
+      ++length;
+    }
+    edit_cigar_length = edit_cigar_append(edit_cigar,edit_cigar_length,CIGAR_OP_M,length);
+    offset += length;
   }
   // Return CIGAR length
-  return edit_cigar_idx;
+  return edit_cigar_length;
 }
 
 
+/*
+ * Extend Wavefront Offsets
+ */
+void edit_wavefronts_extend_offsets(
+    ewf_offset_t* const offsets,
+    const int k_min,
+    const int k_max,
+    const char* const pattern,
+    const int pattern_length,
+    const char* const text,
+    const int text_length) {
+  // Extend diagonally each wavefront point
+  int k;
+  for (k=k_min;k<=k_max;++k) {
+    int v = EWAVEFRONT_V(k,offsets[k]);
+    int h = EWAVEFRONT_H(k,offsets[k]);
+    while (v<pattern_length && h<text_length && pattern[v++]==text[h++]) {
+      ++(offsets[k]);
+    }
+  }
+}
+
 /*
  * Extend Wavefront
  */
 void edit_wavefronts_extend_wavefront(
     ewf_offset_t* const offsets_wavefronts,
+    const int* const wavefronts_lo,
+    const int* const wavefronts_hi,
     const char* const pattern,
     const int pattern_length,
     const char* const text,
     const int text_length,
     const int distance) {
-  // Parameters
-  ewf_offset_t* const offsets = offsets_wavefronts + OFFSET_IDX(distance,0);
-  const int k_min = LO_IDX(distance);
-  const int k_max = HI_IDX(distance);
+  edit_wavefronts_extend_offsets(offsets_wavefronts + OFFSET_IDX(distance,0),
+      wavefronts_lo[distance],wavefronts_hi[distance],
+      pattern,pattern_length,text,text_length);
+}
+
+/*
+ * Packed window of 32 bases starting at position (2 bits per base)
+ */
+uint64_t edit_wavefronts_packed_window(
+    const uint64_t* const words,
+    const int position) {
+  const uint64_t* const word = words + position/PACKED_BASES_PER_WORD;
+  const int shift = 2*(position%PACKED_BASES_PER_WORD);
+  return (word[0] >> shift) | ((word[1] << 1) << (63-shift));
+}
+
+/*
+ * Extend Wavefront Offsets on packed sequences (32 bases per comparison)
+ */
+void edit_wavefronts_extend_offsets_packed(
+    ewf_offset_t* const offsets,
+    const int k_min,
+    const int k_max,
+    const uint64_t* const pattern,
+    const int pattern_length,
+    const uint64_t* const text,
+    const int text_length) {
   // Extend diagonally each wavefront point
   int k;
   for (k=k_min;k<=k_max;++k) {
-    int v = EWAVEFRONT_V(k,offsets[k]);
-    int h = EWAVEFRONT_H(k,offsets[k]);
-    while (v<pattern_length && h<text_length && pattern[v++]==text[h++]) {
-      ++(offsets[k]);
+    const int v = EWAVEFRONT_V(k,offsets[k]);
+    const int h = EWAVEFRONT_H(k,offsets[k]);
+    if (v >= pattern_length || h >= text_length) continue; // Outside the sequences
+    const int max_length = MIN(pattern_length-v,text_length-h);
+    int length = 0;
+    while (length < max_length) {
+      const uint64_t mismatches =
+          edit_wavefronts_packed_window(pattern,v+length) ^
+          edit_wavefronts_packed_window(text,h+length);
+      if (mismatches) {
+        length += __builtin_ctzll(mismatches)/2;
+        break;
+      }
+      length += PACKED_BASES_PER_WORD;
     }
+    offsets[k] += MIN(length,max_length);
   }
 }
 
 /*
- * Edit Wavefront Compute
+ * Extend Wavefront (packed sequences)
  */
-void edit_wavefronts_compute_wavefront(
+void edit_wavefronts_extend_wavefront_packed(
     ewf_offset_t* const offsets_wavefronts,
+    const int* const wavefronts_lo,
+    const int* const wavefronts_hi,
+    const uint64_t* const pattern,
+    const int pattern_length,
+    const uint64_t* const text,
+    const int text_length,
     const int distance) {
-  const int distance_minus_one = distance-1;
-  // Fetch lo and hi
-  const int lo = LO_IDX(distance_minus_one);
-  const int hi = HI_IDX(distance_minus_one);
+  edit_wavefronts_extend_offsets_packed(offsets_wavefronts + OFFSET_IDX(distance,0),
+      wavefronts_lo[distance],wavefronts_hi[distance],
+      pattern,pattern_length,text,text_length);
+}
 
-  // Fetch offsets
-  ewf_offset_t* const offsets = offsets_wavefronts + OFFSET_IDX(distance_minus_one,0);
-  ewf_offset_t* const next_offsets = offsets_wavefronts + OFFSET_IDX(distance,0);
+/*
+ * Compute Wavefront Offsets (next wavefront spans lo-1..hi+1)
+ */
+void edit_wavefronts_compute_offsets(
+    const ewf_offset_t* const offsets,
+    ewf_offset_t* const next_offsets,
+    const int lo,
+    const int hi) {
 
   // Loop peeling (k=lo-1)
   next_offsets[lo-1] = offsets[lo];
@@ -239,137 +435,972 @@ void edit_wavefronts_compute_wavefront(
   next_offsets[hi+1] = offsets[hi] + 1;
 }
 
+/*
+ * Edit Wavefront Compute
+ */
+void edit_wavefronts_compute_wavefront(
+    ewf_offset_t* const offsets_wavefronts,
+    int* const wavefronts_lo,
+    int* const wavefronts_hi,
+    const int distance) {
+  const int distance_minus_one = distance-1;
+  edit_wavefronts_compute_offsets(
+      offsets_wavefronts + OFFSET_IDX(distance_minus_one,0),
+      offsets_wavefronts + OFFSET_IDX(distance,0),
+      wavefronts_lo[distance_minus_one],wavefronts_hi[distance_minus_one]);
+  wavefronts_lo[distance] = wavefronts_lo[distance_minus_one]-1;
+  wavefronts_hi[distance] = wavefronts_hi[distance_minus_one]+1;
+}
+
+/*
+ * Winning operation of each diagonal of the next wavefront (lo-1..hi+1, 2 bits each)
+ *   Same preference as the backtrace (deletion, insertion, mismatch)
+ */
+void edit_wavefronts_compute_predecessors(
+    const ewf_offset_t* const offsets,
+    const ewf_offset_t* const next_offsets,
+    uint8_t* const predecessors,
+    const int lo,
+    const int hi,
+    const int next_distance) {
+  int k;
+  for (k=lo-1;k<=hi+1;++k) {
+    const int op = (k+1 <= hi && next_offsets[k] == offsets[k+1]) ? CIGAR_OP_D :
+                   (lo <= k-1 && next_offsets[k] == offsets[k-1]+1) ? CIGAR_OP_I : CIGAR_OP_X;
+    PREDECESSOR_SET(predecessors,OFFSET_IDX(next_distance,k),op);
+  }
+}
+
+/*
+ * Distance left from a wavefront cell to the end of both sequences (INT32_MAX if outside them)
+ */
+int edit_wavefronts_distance_to_target(
+    const int k,
+    const ewf_offset_t offset,
+    const int pattern_length,
+    const int text_length) {
+  const int left_v = pattern_length - EWAVEFRONT_V(k,offset);
+  const int left_h = text_length - EWAVEFRONT_H(k,offset);
+  if (left_v < 0 || left_h < 0) return INT32_MAX;
+  return MAX(left_v,left_h);
+}
+
+/*
+ * Adaptive Wavefront Reduction
+ *   Trims the diagonals at both ends whose distance left to the target exceeds
+ *   the best one by more than max_distance_threshold (down to min_wavefront_length)
+ */
+void edit_wavefronts_reduce_offsets(
+    const ewf_offset_t* const offsets,
+    int* const wavefront_lo,
+    int* const wavefront_hi,
+    const int pattern_length,
+    const int text_length,
+    const ewf_reduction_t* const reduction) {
+  int lo = *wavefront_lo, hi = *wavefront_hi;
+  if (hi - lo + 1 <= reduction->min_wavefront_length) return;
+  // Best distance left to the target
+  int k, min_distance = INT32_MAX;
+  for (k=lo;k<=hi;++k) {
+    min_distance = MIN(min_distance,
+        edit_wavefronts_distance_to_target(k,offsets[k],pattern_length,text_length));
+  }
+  if (min_distance == INT32_MAX) return;
+  const int max_distance = min_distance + reduction->max_distance_threshold;
+  // Trim both ends
+  while (hi - lo + 1 > reduction->min_wavefront_length &&
+      edit_wavefronts_distance_to_target(lo,offsets[lo],pattern_length,text_length) > max_distance) ++lo;
+  while (hi - lo + 1 > reduction->min_wavefront_length &&
+      edit_wavefronts_distance_to_target(hi,offsets[hi],pattern_length,text_length) > max_distance) --hi;
+  (*wavefront_lo) = lo;
+  (*wavefront_hi) = hi;
+}
+
+void edit_wavefronts_reduce_wavefront(
+    const ewf_offset_t* const offsets_wavefronts,
+    int* const wavefronts_lo,
+    int* const wavefronts_hi,
+    const int distance,
+    const int pattern_length,
+    const int text_length,
+    const ewf_reduction_t* const reduction) {
+  edit_wavefronts_reduce_offsets(offsets_wavefronts + OFFSET_IDX(distance,0),
+      wavefronts_lo+distance,wavefronts_hi+distance,pattern_length,text_length,reduction);
+}
+
+
+/*
+ * Compute wavefronts until the end of both sequences is reached
+ *   Offsets hold distances 0..max_score. Returns the distance, EWF_SCORE_UNALIGNED if it exceeds max_score.
+ *   Wavefronts are reduced after extension if reduction is not NULL.
+ */
+int edit_wavefronts_compute_wavefronts(
+    ewf_offset_t* offsets_wavefronts,
+    int* wavefronts_lo,
+    int* wavefronts_hi,
+    const char* pattern,
+    const int pattern_length,
+    const char* text,
+    const int text_length,
+    const int max_score,
+    const ewf_reduction_t* reduction) {
+FPGA("HLS inline")
+  // Parameters
+  const int target_k = EWAVEFRONT_DIAGONAL(text_length,pattern_length);
+  const ewf_offset_t target_offset = EWAVEFRONT_OFFSET(text_length,pattern_length);
+
+  // Init wavefronts
+  int distance;
+  offsets_wavefronts[0] = 0;
+  wavefronts_lo[0] = 0;
+  wavefronts_hi[0] = 0;
+
+  // Compute wavefronts for increasing distance
+  for (distance=0;distance<=max_score;++distance) {
+
+    // Extend diagonally each wavefront point
+    edit_wavefronts_extend_wavefront(offsets_wavefronts,wavefronts_lo,wavefronts_hi,
+        pattern,pattern_length,
+        text,text_length,distance);
+    // Exit condition
+    if (wavefronts_lo[distance] <= target_k && target_k <= wavefronts_hi[distance] &&
+        offsets_wavefronts[OFFSET_IDX(distance,target_k)] == target_offset) return distance;
+
+    // Reduce wavefront
+    if (reduction != NULL) edit_wavefronts_reduce_wavefront(offsets_wavefronts,
+        wavefronts_lo,wavefronts_hi,distance,pattern_length,text_length,reduction);
+    
+    // Compute next wavefront starting point
+    if (distance < max_score) edit_wavefronts_compute_wavefront(
+        offsets_wavefronts,wavefronts_lo,wavefronts_hi,distance+1);
+  }
+  return EWF_SCORE_UNALIGNED;
+}
 
 /*
  * Edit distance alignment using wavefronts
+ *   Wavefronts live in device-local memory, only the score and the CIGAR cross the bus.
+ *   Returns EWF_SCORE_UNALIGNED (and no CIGAR) if the distance exceeds max_score or EWF_MAX_SCORE
  */
-FPGA("oss task device(fpga) in([pattern_length]pattern, [text_length]text) out([1]score, [1]edit_cigar_length, [max_distance]edit_cigar) inout([max_distance*max_distance]offsets_wavefronts)")
+FPGA_TASK(in([pattern_length]pattern, [text_length]text) out([1]score, [1]edit_cigar_length, [max_cigar_length]edit_cigar))
 void edit_wavefronts_align(
-    ewf_offset_t* offsets_wavefronts,
     char* edit_cigar,
     int* edit_cigar_length,
     const char* pattern,
     const int pattern_length,
     const char* text,
     const int text_length,
-    const int max_distance,
+    const int max_score,
+    const int max_cigar_length,
+    const bool reduction,
+    const int reduction_min_length,
+    const int reduction_max_distance,
+    int* score) {
+FPGA("HLS inline")
+  // Device-local wavefronts (distances 0..EWF_MAX_SCORE)
+  ewf_offset_t offsets_wavefronts[(EWF_MAX_SCORE+1)*(EWF_MAX_SCORE+1)];
+  int wavefronts_lo[EWF_MAX_SCORE+1];
+  int wavefronts_hi[EWF_MAX_SCORE+1];
+  const ewf_reduction_t wavefronts_reduction = {reduction,reduction_min_length,reduction_max_distance};
+
+  // Compute wavefronts
+  const int target_k = EWAVEFRONT_DIAGONAL(text_length,pattern_length);
+  const int distance = edit_wavefronts_compute_wavefronts(offsets_wavefronts,wavefronts_lo,wavefronts_hi,
+      pattern,pattern_length,text,text_length,MIN(max_score,EWF_MAX_SCORE),
+      reduction ? &wavefronts_reduction : NULL);
+  (*score) = distance;
+  if (distance == EWF_SCORE_UNALIGNED) {
+    (*edit_cigar_length) = 0;
+    return;
+  }
+
+  // Backtrace (forward order)
+  const int cigar_length = edit_wavefronts_backtrace(offsets_wavefronts,wavefronts_lo,wavefronts_hi,
+      edit_cigar,0,target_k,distance);
+  edit_cigar_reverse(edit_cigar,cigar_length);
+  (*edit_cigar_length) = cigar_length;
+
+}
+
+/*
+ * Edit distance alignment using wavefronts on packed sequences
+ *   Pattern and text are PACKED_WORDS(length) words (2 bits per base), 4x fewer bytes per burst
+ */
+FPGA_TASK(in([pattern_words]pattern_packed, [text_words]text_packed) out([1]score, [1]edit_cigar_length, [max_cigar_length]edit_cigar))
+void edit_wavefronts_align_packed(
+    char* edit_cigar,
+    int* edit_cigar_length,
+    const uint64_t* pattern_packed,
+    const int pattern_words,
+    const int pattern_length,
+    const uint64_t* text_packed,
+    const int text_words,
+    const int text_length,
+    const int max_score,
+    const int max_cigar_length,
+    const bool reduction,
+    const int reduction_min_length,
+    const int reduction_max_distance,
     int* score) {
 FPGA("HLS inline")
   // Parameters
+  const int max_distance = MIN(max_score,EWF_MAX_SCORE);
   const int target_k = EWAVEFRONT_DIAGONAL(text_length,pattern_length);
-  const int target_k_abs = ABS(target_k);
   const ewf_offset_t target_offset = EWAVEFRONT_OFFSET(text_length,pattern_length);
-
-  // Init wavefronts
+  const uint64_t* const pattern = pattern_packed + 1; // Skip front padding word
+  const uint64_t* const text = text_packed + 1;
+  const ewf_reduction_t wavefronts_reduction = {reduction,reduction_min_length,reduction_max_distance};
+
+  // Init device-local wavefronts (distances 0..EWF_MAX_SCORE)
+  ewf_offset_t offsets_wavefronts[(EWF_MAX_SCORE+1)*(EWF_MAX_SCORE+1)];
+  int wavefronts_lo[EWF_MAX_SCORE+1];
+  int wavefronts_hi[EWF_MAX_SCORE+1];
   int distance;
   offsets_wavefronts[0] = 0;
+  wavefronts_lo[0] = 0;
+  wavefronts_hi[0] = 0;
 
   // Compute wavefronts for increasing distance
-  for (distance=0;distance<max_distance;++distance) {
+  for (distance=0;distance<=max_distance;++distance) {
 
     // Extend diagonally each wavefront point
-    edit_wavefronts_extend_wavefront(offsets_wavefronts,
+    edit_wavefronts_extend_wavefront_packed(offsets_wavefronts,wavefronts_lo,wavefronts_hi,
         pattern,pattern_length,
         text,text_length,distance);
     // Exit condition
-    if (target_k_abs <= distance &&
+    if (wavefronts_lo[distance] <= target_k && target_k <= wavefronts_hi[distance] &&
         offsets_wavefronts[OFFSET_IDX(distance,target_k)] == target_offset) break;
-    
+
+    // Reduce wavefront
+    if (reduction) edit_wavefronts_reduce_wavefront(offsets_wavefronts,
+        wavefronts_lo,wavefronts_hi,distance,pattern_length,text_length,&wavefronts_reduction);
+
     // Compute next wavefront starting point
-    edit_wavefronts_compute_wavefront(
-        offsets_wavefronts,distance+1);
+    if (distance < max_distance) edit_wavefronts_compute_wavefront(
+        offsets_wavefronts,wavefronts_lo,wavefronts_hi,distance+1);
+  }
+  if (distance > max_distance) {
+    (*score) = EWF_SCORE_UNALIGNED;
+    (*edit_cigar_length) = 0;
+    return;
+  }
+  (*score) = distance;
+
+  // Backtrace (forward order)
+  const int cigar_length = edit_wavefronts_backtrace(offsets_wavefronts,wavefronts_lo,wavefronts_hi,
+      edit_cigar,0,target_k,distance);
+  edit_cigar_reverse(edit_cigar,cigar_length);
+  (*edit_cigar_length) = cigar_length;
+
+}
+
+/*
+ * Edit distance alignment keeping 2 bits per cell for the backtrace
+ *   Offsets live in two rolling wavefronts, device-local memory keeps only the winning
+ *   operation of each diagonal (8x less than 16-bit offsets, up to EWF_COMPACT_MAX_SCORE).
+ *   Returns EWF_SCORE_UNALIGNED (and no CIGAR) if the distance exceeds max_score or EWF_COMPACT_MAX_SCORE
+ */
+FPGA_TASK(in([pattern_length]pattern, [text_length]text) out([1]score, [1]edit_cigar_length, [max_cigar_length]edit_cigar))
+void edit_wavefronts_align_compact(
+    char* edit_cigar,
+    int* edit_cigar_length,
+    const char* pattern,
+    const int pattern_length,
+    const char* text,
+    const int text_length,
+    const int max_score,
+    const int max_cigar_length,
+    const bool reduction,
+    const int reduction_min_length,
+    const int reduction_max_distance,
+    int* score) {
+FPGA("HLS inline")
+  // Parameters
+  const int max_distance = MIN(max_score,EWF_COMPACT_MAX_SCORE);
+  const int target_k = EWAVEFRONT_DIAGONAL(text_length,pattern_length);
+  const ewf_offset_t target_offset = EWAVEFRONT_OFFSET(text_length,pattern_length);
+  const ewf_reduction_t wavefronts_reduction = {reduction,reduction_min_length,reduction_max_distance};
+
+  // Init device-local wavefronts (winning operations of distances 0..EWF_COMPACT_MAX_SCORE)
+  ewf_offset_t rolling_offsets[2][2*EWF_COMPACT_MAX_SCORE+1];
+  uint8_t predecessors[PREDECESSORS_LENGTH((EWF_COMPACT_MAX_SCORE+1)*(EWF_COMPACT_MAX_SCORE+1))];
+  uint8_t operations[EWF_COMPACT_MAX_SCORE+1];
+  ewf_offset_t* offsets = rolling_offsets[0] + EWF_COMPACT_MAX_SCORE;
+  int distance, lo = 0, hi = 0;
+  offsets[0] = 0;
+
+  // Compute wavefronts for increasing distance
+  for (distance=0;distance<=max_distance;++distance) {
+
+    // Extend diagonally each wavefront point
+    edit_wavefronts_extend_offsets(offsets,lo,hi,
+        pattern,pattern_length,text,text_length);
+    // Exit condition
+    if (lo <= target_k && target_k <= hi && offsets[target_k] == target_offset) break;
+    if (distance == max_distance) {
+      (*score) = EWF_SCORE_UNALIGNED;
+      (*edit_cigar_length) = 0;
+      return;
+    }
+
+    // Reduce wavefront
+    if (reduction) edit_wavefronts_reduce_offsets(offsets,&lo,&hi,
+        pattern_length,text_length,&wavefronts_reduction);
+
+    // Compute next wavefront starting point (on the other rolling wavefront)
+    ewf_offset_t* const next_offsets = rolling_offsets[(distance+1)%2] + EWF_COMPACT_MAX_SCORE;
+    edit_wavefronts_compute_offsets(offsets,next_offsets,lo,hi);
+    edit_wavefronts_compute_predecessors(offsets,next_offsets,predecessors,lo,hi,distance+1);
+    offsets = next_offsets;
+    --lo;
+    ++hi;
+  }
+  (*score) = distance;
+
+  // Backtrace (forward order)
+  (*edit_cigar_length) = edit_wavefronts_backtrace_compact(predecessors,operations,
+      pattern,pattern_length,text,text_length,edit_cigar,target_k,distance);
+
+}
+
+/*
+ * Edit distance (score only) using two rolling wavefronts in device-local memory
+ *   Returns EWF_SCORE_UNALIGNED if the distance exceeds max_score or EWF_MAX_SCORE
+ */
+FPGA_TASK(in([pattern_length]pattern, [text_length]text) out([1]score))
+void edit_wavefronts_align_score_only(
+    const char* pattern,
+    const int pattern_length,
+    const char* text,
+    const int text_length,
+    const int max_score,
+    int* score) {
+FPGA("HLS inline")
+  // Parameters
+  const int max_distance = MIN(max_score,EWF_MAX_SCORE);
+  const int target_k = EWAVEFRONT_DIAGONAL(text_length,pattern_length);
+  const int target_k_abs = ABS(target_k);
+  const ewf_offset_t target_offset = EWAVEFRONT_OFFSET(text_length,pattern_length);
+
+  // Init wavefronts
+  ewf_offset_t rolling_offsets[2][2*EWF_MAX_SCORE+1];
+  ewf_offset_t* offsets = rolling_offsets[0] + EWF_MAX_SCORE;
+  int distance;
+  offsets[0] = 0;
+
+  // Compute wavefronts for increasing distance
+  for (distance=0;distance<=max_distance;++distance) {
+
+    // Extend diagonally each wavefront point
+    edit_wavefronts_extend_offsets(offsets,LO_IDX(distance),HI_IDX(distance),
+        pattern,pattern_length,text,text_length);
+    // Exit condition
+    if (target_k_abs <= distance && offsets[target_k] == target_offset) break;
+    if (distance == max_distance) {
+      (*score) = EWF_SCORE_UNALIGNED;
+      return;
+    }
+
+    // Compute next wavefront starting point (on the other rolling wavefront)
+    ewf_offset_t* const next_offsets = rolling_offsets[(distance+1)%2] + EWF_MAX_SCORE;
+    edit_wavefronts_compute_offsets(offsets,next_offsets,LO_IDX(distance),HI_IDX(distance));
+    offsets = next_offsets;
+  }
+  (*score) = distance;
+
+}
+
+/*
+ * BiWFA: Extend Wavefront Offsets (forward or reverse, skipping null offsets)
+ */
+void edit_bialign_extend_offsets(
+    ewf_offset_t* offsets,
+    const int lo,
+    const int hi,
+    const char* pattern,
+    const int pattern_length,
+    const char* text,
+    const int text_length,
+    const bool reverse) {
+  int k;
+  for (k=lo;k<=hi;++k) {
+    if (offsets[k] < 0) continue; // Null
+    int v = EWAVEFRONT_V(k,offsets[k]);
+    int h = EWAVEFRONT_H(k,offsets[k]);
+    if (reverse) {
+      while (v<pattern_length && h<text_length &&
+             pattern[pattern_length-1-v]==text[text_length-1-h]) {
+        ++v; ++h;
+      }
+    }
+    else {
+      while (v<pattern_length && h<text_length && pattern[v]==text[h]) {
+        ++v; ++h;
+      }
+    }
+    offsets[k] = h;
+  }
+}
+
+/*
+ * BiWFA: Compute Wavefront Offsets (next wavefront spans lo-1..hi+1)
+ *   Operations leaving the sequences are discarded (null offsets)
+ */
+void edit_bialign_compute_offsets(
+    const ewf_offset_t* offsets,
+    ewf_offset_t* next_offsets,
+    const int lo,
+    const int hi,
+    const int pattern_length,
+    const int text_length) {
+  int k;
+  for (k=lo-1;k<=hi+1;++k) {
+    // Fetch candidates
+    ewf_offset_t del = (k+1 <= hi) ? offsets[k+1] : EWF_OFFSET_NULL; // Upper
+    ewf_offset_t sub = (lo <= k && k <= hi) ? offsets[k] + 1 : EWF_OFFSET_NULL; // Mid
+    ewf_offset_t ins = (lo <= k-1) ? offsets[k-1] + 1 : EWF_OFFSET_NULL; // Lower
+    // Discard null sources and cells outside the sequences
+    if (del < 0 || EWAVEFRONT_V(k,del) > pattern_length) del = EWF_OFFSET_NULL;
+    if (sub < 1 || sub > text_length || EWAVEFRONT_V(k,sub) > pattern_length) sub = EWF_OFFSET_NULL;
+    if (ins < 1 || ins > text_length) ins = EWF_OFFSET_NULL;
+    next_offsets[k] = MAX(MAX(del,sub),ins);
+  }
+}
+
+/*
+ * BiWFA: Find a cell where the forward and reverse wavefronts overlap
+ *   Reverse diagonals are taken on the reversed sequences (kr = text_length-pattern_length-k)
+ */
+bool edit_bialign_overlap(
+    const ewf_offset_t* forward_offsets,
+    const int forward_distance,
+    const ewf_offset_t* reverse_offsets,
+    const int reverse_distance,
+    const int pattern_length,
+    const int text_length,
+    int* breakpoint_h,
+    int* breakpoint_v) {
+  const int k_reverse = EWAVEFRONT_DIAGONAL(text_length,pattern_length);
+  const int lo = MAX(-forward_distance,k_reverse-reverse_distance);
+  const int hi = MIN(forward_distance,k_reverse+reverse_distance);
+  int k;
+  for (k=lo;k<=hi;++k) {
+    const ewf_offset_t forward_offset = forward_offsets[k];
+    const ewf_offset_t reverse_offset = reverse_offsets[k_reverse-k];
+    if (forward_offset < 0 || reverse_offset < 0) continue; // Null
+    if (forward_offset + reverse_offset >= text_length) {
+      *breakpoint_h = EWAVEFRONT_H(k,forward_offset);
+      *breakpoint_v = EWAVEFRONT_V(k,forward_offset);
+      return true;
+    }
+  }
+  return false;
+}
+
+/*
+ * BiWFA: Breakpoint of an optimal alignment (on device-local rolling wavefronts)
+ *   Returns false if the score exceeds max_score or a distance exceeds EWF_MAX_SCORE
+ */
+bool edit_bialign_breakpoint(
+    ewf_offset_t rolling_offsets[4][2*EWF_MAX_SCORE+1],
+    const char* pattern,
+    const int pattern_length,
+    const char* text,
+    const int text_length,
+    const int max_score,
+    int* breakpoint_h,
+    int* breakpoint_v,
+    int* forward_distance,
+    int* reverse_distance) {
+  // Init wavefronts
+  int distance_f = 0, distance_r = 0;
+  rolling_offsets[0][EWF_MAX_SCORE] = 0;
+  rolling_offsets[2][EWF_MAX_SCORE] = 0;
+  edit_bialign_extend_offsets(rolling_offsets[0]+EWF_MAX_SCORE,0,0,
+      pattern,pattern_length,text,text_length,false);
+  edit_bialign_extend_offsets(rolling_offsets[2]+EWF_MAX_SCORE,0,0,
+      pattern,pattern_length,text,text_length,true);
+  // Compute wavefronts until they overlap
+  while (!edit_bialign_overlap(
+      rolling_offsets[distance_f%2]+EWF_MAX_SCORE,distance_f,
+      rolling_offsets[2+distance_r%2]+EWF_MAX_SCORE,distance_r,
+      pattern_length,text_length,breakpoint_h,breakpoint_v)) {
+    // Advance the wavefront with the lowest distance
+    if (distance_f + distance_r >= max_score) return false;
+    const bool reverse = (distance_r < distance_f);
+    const int distance = reverse ? distance_r : distance_f;
+    if (distance == EWF_MAX_SCORE) return false;
+    ewf_offset_t* const offsets = rolling_offsets[2*reverse+distance%2] + EWF_MAX_SCORE;
+    ewf_offset_t* const next_offsets = rolling_offsets[2*reverse+(distance+1)%2] + EWF_MAX_SCORE;
+    edit_bialign_compute_offsets(offsets,next_offsets,-distance,distance,pattern_length,text_length);
+    edit_bialign_extend_offsets(next_offsets,-distance-1,distance+1,
+        pattern,pattern_length,text,text_length,reverse);
+    if (reverse) ++distance_r; else ++distance_f;
+  }
+  *forward_distance = distance_f;
+  *reverse_distance = distance_r;
+  return true;
+}
+
+/*
+ * BiWFA: Pending sub-problem (the device has no recursion, so they are kept on a stack)
+ */
+typedef struct {
+  int pattern_begin;
+  int pattern_length;
+  int text_begin;
+  int text_length;
+  int score;
+} edit_bialign_subproblem_t;
+
+/*
+ * Edit distance alignment using bidirectional wavefronts (BiWFA)
+ *   Only the sequences, the score and the CIGAR cross the bus; wavefronts
+ *   live in device-local memory. Returns EWF_SCORE_UNALIGNED if the score exceeds
+ *   max_score or a distance exceeds EWF_MAX_SCORE
+ */
+FPGA_TASK(in([pattern_length]pattern, [text_length]text) out([1]score, [1]edit_cigar_length, [max_cigar_length]edit_cigar))
+void edit_bialign_align(
+    char* edit_cigar,
+    int* edit_cigar_length,
+    const char* pattern,
+    const int pattern_length,
+    const char* text,
+    const int text_length,
+    const int max_score,
+    const int max_cigar_length,
+    int* score) {
+FPGA("HLS inline")
+  // Device-local memory
+  ewf_offset_t rolling_offsets[4][2*EWF_MAX_SCORE+1];
+  ewf_offset_t base_offsets[(EWF_BIWFA_BASE_SCORE+1)*(EWF_BIWFA_BASE_SCORE+1)];
+  int base_lo[EWF_BIWFA_BASE_SCORE+1];
+  int base_hi[EWF_BIWFA_BASE_SCORE+1];
+  edit_bialign_subproblem_t stack[EWF_BIWFA_STACK_SIZE];
+  int stack_size = 0, cigar_length = 0;
+
+  // Push the whole alignment
+  int h, v, forward_distance, reverse_distance;
+  if (!edit_bialign_breakpoint(rolling_offsets,pattern,pattern_length,text,text_length,
+      max_score,&h,&v,&forward_distance,&reverse_distance)) {
+    (*score) = EWF_SCORE_UNALIGNED;
+    (*edit_cigar_length) = 0;
+    return;
   }
-  (*score) = distance;
+  (*score) = forward_distance + reverse_distance;
+  stack[stack_size++] = (edit_bialign_subproblem_t){0,v,0,h,forward_distance};
+  stack[stack_size++] = (edit_bialign_subproblem_t){v,pattern_length-v,h,text_length-h,reverse_distance};
+
+  // Align sub-problems (suffix first, the CIGAR is built backwards)
+  while (stack_size > 0) {
+    const edit_bialign_subproblem_t sub = stack[--stack_size];
+    const char* const sub_pattern = pattern + sub.pattern_begin;
+    const char* const sub_text = text + sub.text_begin;
+    // Base case: regular WFA
+    if (sub.score <= EWF_BIWFA_BASE_SCORE) {
+      const int target_k = EWAVEFRONT_DIAGONAL(sub.text_length,sub.pattern_length);
+      const int distance = edit_wavefronts_compute_wavefronts(base_offsets,base_lo,base_hi,
+          sub_pattern,sub.pattern_length,sub_text,sub.text_length,
+          EWF_BIWFA_BASE_SCORE,NULL);
+      cigar_length = edit_wavefronts_backtrace(base_offsets,base_lo,base_hi,
+          edit_cigar,cigar_length,target_k,distance);
+      continue;
+    }
+    // Split at the breakpoint
+    if (stack_size+2 > EWF_BIWFA_STACK_SIZE ||
+        !edit_bialign_breakpoint(rolling_offsets,sub_pattern,sub.pattern_length,
+            sub_text,sub.text_length,sub.score,&h,&v,&forward_distance,&reverse_distance)) {
+      (*score) = EWF_SCORE_UNALIGNED;
+      (*edit_cigar_length) = 0;
+      return;
+    }
+    stack[stack_size++] = (edit_bialign_subproblem_t){
+        sub.pattern_begin,v,sub.text_begin,h,forward_distance};
+    stack[stack_size++] = (edit_bialign_subproblem_t){
+        sub.pattern_begin+v,sub.pattern_length-v,sub.text_begin+h,sub.text_length-h,reverse_distance};
+  }
+  edit_cigar_reverse(edit_cigar,cigar_length);
+  (*edit_cigar_length) = cigar_length;
 
-  // Backtrace
-  (*edit_cigar_length) = edit_wavefronts_backtrace(offsets_wavefronts,edit_cigar,target_k,distance);
+}
 
+/*
+ * Pack a DNA sequence (2 bits per base, A=0 C=1 G=2 T=3) into PACKED_WORDS(length) words
+ *   Returns false if it has other symbols (the pair is aligned on characters)
+ */
+bool sequence_pack(
+    uint64_t* const packed,
+    const char* const sequence,
+    const int length) {
+  memset(packed,0,PACKED_WORDS(length)*sizeof(uint64_t));
+  uint64_t* const words = packed + 1; // Skip front padding word
+  int i;
+  for (i=0;i<length;++i) {
+    uint64_t base;
+    switch (sequence[i]) {
+      case 'A': base = 0; break;
+      case 'C': base = 1; break;
+      case 'G': base = 2; break;
+      case 'T': base = 3; break;
+      default: return false;
+    }
+    words[i/PACKED_BASES_PER_WORD] |= base << (2*(i%PACKED_BASES_PER_WORD));
+  }
+  return true;
 }
 
-bool edit_wavefronts_check(
-  const char* const cigar,
-  const int cigar_length,
-  const int score, 
-  const char* const filename) {
-  
-  FILE* ref_file = fopen(filename, "r");
-  if (ref_file == NULL) {
-    PRINTF_ERROR("Error while opening check file %s\n", filename);
-    return false;
+/*
+ * Host sequence buffer aligned to page size
+ */
+int sequence_buffer_reserve(
+    char** const buffer,
+    size_t* const capacity,
+    const size_t length,
+    const size_t page_size) {
+  // Keep current buffer if the sequence fits
+  if (length <= *capacity && *buffer != NULL) return EXIT_SUCCESS;
+  free(*buffer);
+  // Size must be a multiple of the alignment
+  const size_t size = ALIGN_UP(MAX(length,1),page_size);
+  *buffer = (char*) aligned_alloc(page_size,size);
+  *capacity = size;
+  if (*buffer == NULL){
+    PRINTF_ERROR("Aligned allocation of sequence buffer failed");
+    return EXIT_FAILURE;
   }
+  return EXIT_SUCCESS;
+}
 
-  // Read reference score
-  int score_ref;
-  if (fscanf(ref_file, "%d", &score_ref) != 1) {
-    PRINTF_ERROR("Error while reading reference score in check file %s\n", filename);
-    return false;
-  }  
+/*
+ * Pair of a batch (own host buffers, so the tasks of a batch are independent)
+ *   Sequences point into the memory-mapped input unless they are copied to
+ *   the pair buffers (page-aligned transfers or a streamed input)
+ */
+typedef struct {
+  // Sequences
+  const char* pattern;
+  int pattern_length;
+  const char* text;
+  int text_length;
+  char* pattern_buffer;
+  size_t pattern_capacity;
+  char* text_buffer;
+  size_t text_capacity;
+  // Packed sequences (if packed is set)
+  char* pattern_packed;
+  size_t pattern_packed_capacity;
+  char* text_packed;
+  size_t text_packed_capacity;
+  bool packed;
+  // Results
+  edit_wavefronts_fpga_t wavefronts;
+  int score;
+} fpga_pair_t;
 
-  // Check score
-  if (score != score_ref) {
-    PRINTF_ERROR("Check has failed: reference score != result score\n");
-    PRINTF_ERROR("Reference score: %d\n", score_ref);
-    PRINTF_ERROR("Result score: %d\n", score);
-    return false;
+/*
+ * Batch of pairs aligned at once (one task per pair, a single taskwait per batch)
+ */
+typedef struct {
+  fpga_pair_t* pairs;
+  int num_pairs;
+  int max_pairs;
+  size_t input_position;
+  // Buffers configuration
+  bool aligned;
+  size_t alignment;
+  size_t page_size;
+  // Stage results (gathered by the output stage)
+  int num_escaped;
+  int num_filtered;
+  int num_too_wide;
+  double tCopy;
+  double tAlign;
+} fpga_batch_t;
+
+int fpga_batch_init(
+    fpga_batch_t* const batch,
+    const int batch_size,
+    const int pattern_length,
+    const int text_length,
+    const int max_score,
+    const bool aligned,
+    const size_t page_size) {
+  batch->pairs = calloc(batch_size,sizeof(fpga_pair_t));
+  if (batch->pairs == NULL) {
+    PRINTF_ERROR("Allocation of batch failed\n");
+    return EXIT_FAILURE;
+  }
+  batch->num_pairs = 0;
+  batch->max_pairs = batch_size;
+  batch->input_position = 0;
+  batch->aligned = aligned;
+  batch->alignment = aligned ? page_size : sizeof(uint64_t);
+  batch->page_size = page_size;
+  int i;
+  for (i=0;i<batch_size;++i) {
+    if (edit_wavefronts_init(&batch->pairs[i].wavefronts,pattern_length,text_length,max_score,aligned,page_size)) {
+      return EXIT_FAILURE;
+    }
   }
+  return EXIT_SUCCESS;
+}
 
-  fgetc(ref_file); // Skip newline
+void fpga_batch_free(
+    fpga_batch_t* const batch) {
+  int i;
+  for (i=0;i<batch->max_pairs;++i) {
+    fpga_pair_t* const pair = batch->pairs + i;
+    edit_wavefronts_clean(&pair->wavefronts);
+    free(pair->pattern_buffer);
+    free(pair->text_buffer);
+    free(pair->pattern_packed);
+    free(pair->text_packed);
+  }
+  free(batch->pairs);
+}
 
-  char ref_ch;
-  int i = 0;
-  while ((ref_ch = fgetc(ref_file)) != EOF && ref_ch != '\n' && i < cigar_length) {
-    if(ref_ch != cigar[i]){
-      PRINTF_ERROR("Check has failed: reference CIGAR != result CIGAR at position %d\n", i);
-      PRINTF_ERROR("Reference CIGAR: %c\n", ref_ch);
-      PRINTF_ERROR("Result CIGAR: %c\n", cigar[i]);
-      return false;
+/*
+ * Add a pair to the next free slot of the batch
+ *   Copies it if requested (otherwise it must outlive the batch)
+ *   Packs it if requested (non-ACGT pairs are escaped to characters)
+ */
+int fpga_batch_add(
+    fpga_batch_t* const batch,
+    const char* const pattern,
+    const int pattern_length,
+    const char* const text,
+    const int text_length,
+    const bool copy,
+    const bool pack,
+    const bool cigar) {
+  fpga_pair_t* const pair = batch->pairs + batch->num_pairs;
+  // Copy sequences
+  pair->pattern = pattern;
+  pair->text = text;
+  if (copy || batch->aligned) {
+    if (sequence_buffer_reserve(&pair->pattern_buffer,&pair->pattern_capacity,pattern_length,batch->alignment) ||
+        sequence_buffer_reserve(&pair->text_buffer,&pair->text_capacity,text_length,batch->alignment)) {
+      return EXIT_FAILURE;
+    }
+    memcpy(pair->pattern_buffer,pattern,pattern_length);
+    memcpy(pair->text_buffer,text,text_length);
+    pair->pattern = pair->pattern_buffer;
+    pair->text = pair->text_buffer;
+  }
+  pair->pattern_length = pattern_length;
+  pair->text_length = text_length;
+  // Fit CIGAR
+  if (cigar && edit_wavefronts_resize(&pair->wavefronts,pattern_length,text_length,batch->aligned,batch->page_size)) {
+    return EXIT_FAILURE;
+  }
+  // Pack sequences
+  pair->packed = false;
+  if (pack) {
+    const int pattern_words = PACKED_WORDS(pattern_length);
+    const int text_words = PACKED_WORDS(text_length);
+    if (sequence_buffer_reserve(&pair->pattern_packed,&pair->pattern_packed_capacity,pattern_words*sizeof(uint64_t),batch->alignment) ||
+        sequence_buffer_reserve(&pair->text_packed,&pair->text_packed_capacity,text_words*sizeof(uint64_t),batch->alignment)) {
+      return EXIT_FAILURE;
     }
+    pair->packed =
+        sequence_pack((uint64_t*)pair->pattern_packed,pattern,pattern_length) &&
+        sequence_pack((uint64_t*)pair->text_packed,text,text_length);
   }
+  ++(batch->num_pairs);
+  return EXIT_SUCCESS;
+}
 
-  // Check CIGAR length
-  if (ref_ch != EOF || i != cigar_length) {
-    PRINTF_ERROR("Check has failed: reference CIGAR length != result CIGAR length\n");
+/*
+ * Submit the alignment task of a pair (it runs on any free instance)
+ *   Pairs whose offsets do not fit the device width are not offloaded (returns false)
+ */
+bool fpga_pair_align(
+    fpga_pair_t* const pair,
+    const bool score_only,
+    const bool biwfa,
+    const bool compact_backtrace,
+    const int max_score,
+    const ewf_reduction_t* const reduction) {
+  edit_wavefronts_fpga_t* const wavefronts = &pair->wavefronts;
+  // Offsets wider than the device ones
+  const int device_max_score = MIN(max_score,EWF_DEVICE_MAX_SCORE(compact_backtrace && !score_only));
+  if (!edit_wavefronts_offsets_fit(pair->pattern_length,pair->text_length,device_max_score,reduction->enabled)) {
+    pair->score = EWF_SCORE_UNALIGNED;
+    wavefronts->edit_cigar_length = 0;
     return false;
   }
-
-  // Return
+  // The CIGAR transfer is bounded by the budget
+  const int max_cigar_length = edit_wavefronts_max_cigar_length(pair->pattern_length,pair->text_length,max_score);
+  if (score_only) {
+    wavefronts->edit_cigar_length = 0;
+    edit_wavefronts_align_score_only(pair->pattern,pair->pattern_length,pair->text,pair->text_length,max_score,&pair->score);
+  }
+  else if (pair->packed) {
+    edit_wavefronts_align_packed(wavefronts->edit_cigar,&wavefronts->edit_cigar_length,
+        (uint64_t*)pair->pattern_packed,PACKED_WORDS(pair->pattern_length),pair->pattern_length,
+        (uint64_t*)pair->text_packed,PACKED_WORDS(pair->text_length),pair->text_length,max_score,max_cigar_length,
+        reduction->enabled,reduction->min_wavefront_length,reduction->max_distance_threshold,&pair->score);
+  }
+  else if (biwfa) {
+    edit_bialign_align(wavefronts->edit_cigar,&wavefronts->edit_cigar_length,
+        pair->pattern,pair->pattern_length,pair->text,pair->text_length,max_score,max_cigar_length,&pair->score);
+  }
+  else if (compact_backtrace) {
+    edit_wavefronts_align_compact(wavefronts->edit_cigar,&wavefronts->edit_cigar_length,
+        pair->pattern,pair->pattern_length,pair->text,pair->text_length,max_score,max_cigar_length,
+        reduction->enabled,reduction->min_wavefront_length,reduction->max_distance_threshold,&pair->score);
+  }
+  else {
+    edit_wavefronts_align(wavefronts->edit_cigar,&wavefronts->edit_cigar_length,
+        pair->pattern,pair->pattern_length,pair->text,pair->text_length,max_score,max_cigar_length,
+        reduction->enabled,reduction->min_wavefront_length,reduction->max_distance_threshold,&pair->score);
+  }
   return true;
-
 }
 
-int edit_wavefronts_write_result(
-  const char* const cigar,
-  const int cigar_length,
-  const int score,
-  const char* const filename) {
-  
-  
-  FILE* result_file = fopen(filename, "w");
-  if (result_file == NULL) {
-    PRINTF_ERROR("Error while opening result file %s\n", filename);
-    return EXIT_FAILURE;
-  }
+/*
+ * Statistics of a repetition
+ *   Only the output stage updates them (its tasks run in batch order)
+ */
+typedef struct {
+  int num_alignments;
+  int num_escaped;
+  int num_unaligned;
+  int num_filtered;
+  int num_too_wide;
+  int check_counts[CHECK_STATUSES];
+  int num_reported;
+  long score_excess;
+  double tCopy;
+  double tAlign;
+  double tCheck;
+  double tWrite;
+  int status;
+} fpga_pipeline_stats_t;
 
-  fprintf(result_file, "%d\n", score);
-  fwrite(cigar, sizeof(char), cigar_length, result_file);
-  fclose(result_file);
+/*
+ * Pipeline align stage
+ *   Submits the tasks of the batch and waits only for them, so the host keeps
+ *   reading the next batch and writing the previous one meanwhile.
+ *   Pairs the filter proves above the device budget are not submitted
+ */
+FPGA("oss task inout(*batch)")
+void fpga_batch_align(
+    fpga_batch_t* const batch,
+    const bool score_only,
+    const bool biwfa,
+    const bool compact_backtrace,
+    const bool filter,
+    const int max_score,
+    const ewf_reduction_t* const reduction) {
+  const double tStart = wall_time();
+  const int device_max_score = MIN(max_score,EWF_DEVICE_MAX_SCORE(compact_backtrace && !score_only));
+  batch->num_filtered = 0;
+  batch->num_too_wide = 0;
+  int j;
+  for (j=0;j<batch->num_pairs;++j) {
+    fpga_pair_t* const pair = batch->pairs + j;
+    if (filter && edit_wavefronts_filter(pair->pattern,pair->pattern_length,
+        pair->text,pair->text_length,device_max_score)) {
+      pair->score = EWF_SCORE_UNALIGNED;
+      pair->wavefronts.edit_cigar_length = 0;
+      ++(batch->num_filtered);
+      continue;
+    }
+    batch->num_too_wide += !fpga_pair_align(pair,score_only,biwfa,compact_backtrace,max_score,reduction);
+  }
+  FPGA("oss taskwait")
+  batch->tAlign = wall_time()-tStart;
+}
 
-  return EXIT_SUCCESS;
+/*
+ * Pipeline output stage
+ *   Checks and writes the results of a batch (in input order) and gathers its statistics
+ */
+FPGA("oss task in(*batch) inout(*stats)")
+void fpga_batch_output(
+    const fpga_batch_t* const batch,
+    fpga_pipeline_stats_t* const stats,
+    const check_references_t* const references,
+    result_writer_t* const result_writer,
+    const bool score_only,
+    const bool reduction_enabled) {
+  // Skip after a failed write
+  if (stats->status != EXIT_SUCCESS) return;
+  stats->num_escaped += batch->num_escaped;
+  stats->num_filtered += batch->num_filtered;
+  stats->num_too_wide += batch->num_too_wide;
+  stats->tCopy += batch->tCopy;
+  stats->tAlign += batch->tAlign;
+  int j;
+  for (j=0;j<batch->num_pairs;++j) {
+    const fpga_pair_t* const pair = batch->pairs + j;
+    const int score = pair->score;
+    const int pair_index = (stats->num_alignments)++;
+    stats->num_unaligned += (score == EWF_SCORE_UNALIGNED);
+
+    // Check results (heuristic scores are only compared with the reference)
+    const double tStartCheck = wall_time();
+    if (references != NULL) {
+      const char* const cigar = pair->wavefronts.edit_cigar;
+      const int cigar_length = pair->wavefronts.edit_cigar_length;
+      const int status = check_references_verify(references,pair_index,pair->pattern,pair->pattern_length,
+          pair->text,pair->text_length,score_only ? NULL : cigar,cigar_length,score,reduction_enabled);
+      ++(stats->check_counts[status]);
+      if (status == CHECK_SUBOPTIMAL && score != EWF_SCORE_UNALIGNED) {
+        stats->score_excess += score - references->scores[pair_index];
+      }
+      if (status != CHECK_OK && status != CHECK_SUBOPTIMAL && (stats->num_reported)++ < CHECK_MAX_REPORTED) {
+        check_references_report(references,pair_index,status,pair->pattern,pair->pattern_length,
+            pair->text,pair->text_length,cigar,cigar_length,score,reduction_enabled);
+      }
+    }
+    const double tEndCheck = wall_time();
+    stats->tCheck += tEndCheck-tStartCheck;
 
+    // Write results
+    const double tStartWrite = wall_time();
+    if (result_writer != NULL){
+      if(result_writer_write(result_writer,pair->wavefronts.edit_cigar,pair->wavefronts.edit_cigar_length,score,
+          pair->pattern_length,pair->text_length)){
+        stats->status = EXIT_FAILURE;
+        return;
+      }
+    }
+    const double tEndWrite = wall_time();
+    stats->tWrite += tEndWrite-tStartWrite;
+  }
 }
 
 // Display usage information
 int usage(char* name){
   
   PRINTF_ERROR("Usage: %s\n", name);
+  PRINTF_ERROR("Wavefronts are kept in device-local memory, pairs with a distance above %d get score %d (unaligned) and no CIGAR\n", EWF_MAX_SCORE, EWF_SCORE_UNALIGNED);
+  PRINTF_ERROR("Offsets are %d-bit wide, pairs whose offsets do not fit are not offloaded (score %d, unaligned)\n", EWF_OFFSET_BITS, EWF_SCORE_UNALIGNED);
   PRINTF_ERROR("Environment variables: \n");
   PRINTF_ERROR("\tUSAGE: print usage information\n");
   PRINTF_ERROR("\tREPS: number of reps to do the algorithm, value must be between 0 and %d, default (0) \n", INT32_MAX);
   PRINTF_ERROR("\tALIGNED: explicitly aligned data to page boundary, 0 -> inactive, 1 -> active, default (1) \n");
   PRINTF_ERROR("\tDEBUG: print debug information, 0 -> inactive, 1 -> active, default (0) \n");
   PRINTF_ERROR("\tTIMES: print timing information, 0 -> inactive, 1 -> active, default (0) \n");
-  PRINTF_ERROR("\tCHECK: file to check the results\n");
-  PRINTF_ERROR("\tWRITE_RESULT: file to write the results\n");
+  PRINTF_ERROR("\tSCORE_ONLY: compute only the edit distance (no CIGAR) in device-local memory, score -1 if above %d, 0 -> inactive, 1 -> active, default (0) \n", EWF_MAX_SCORE);
+  PRINTF_ERROR("\tPACKED: send ACGT pairs to the device as 2-bit packed sequences (others and score only/BiWFA/compact backtrace as characters), 0 -> inactive, 1 -> active, default (0) \n");
+  PRINTF_ERROR("\tBIWFA: align with bidirectional WFA (full CIGAR, wavefronts in device-local memory), score -1 if above %d, 0 -> inactive, 1 -> active, default (0) \n", EWF_MAX_SCORE);
+  PRINTF_ERROR("\tCOMPACT_BACKTRACE: regular WFA keeps 2 bits per cell (winning operation) instead of every offset in device-local memory, score -1 if above %d, 0 -> inactive, 1 -> active, default (0) \n", EWF_COMPACT_MAX_SCORE);
+  PRINTF_ERROR("\tREDUCTION: adaptive wavefront reduction (regular WFA, may be suboptimal, CHECK reports the accuracy cost), 0 -> inactive, 1 -> active, default (0) \n");
+  PRINTF_ERROR("\tREDUCTION_MIN_LENGTH: wavefronts up to this width are not reduced, value must be between 1 and %d, default (%d) \n", INT32_MAX, DEFAULT_REDUCTION_MIN_LENGTH);
+  PRINTF_ERROR("\tREDUCTION_MAX_DISTANCE: diagonals this much further from the target than the best one are dropped, value must be between 0 and %d, default (%d) \n", INT32_MAX, DEFAULT_REDUCTION_MAX_DISTANCE);
+  PRINTF_ERROR("\tMAX_SCORE: distance budget, pairs above it stop early and get score %d (unaligned), value must be between 0 and %d, default (unbounded) \n", EWF_SCORE_UNALIGNED, INT32_MAX);
+  PRINTF_ERROR("\tFILTER: pairs whose q-gram lower bound is above MAX_SCORE (or the device maximum) get score %d (unaligned) on the host, without being sent to the device, 0 -> inactive, 1 -> active, default (0) \n", EWF_SCORE_UNALIGNED);
+  PRINTF_ERROR("\tCHECK: file with the reference results (run-length CIGARs, or former backwards CIGARs), loaded once and compared with every rep, mismatches are summarized\n");
+  PRINTF_ERROR("\tCHECK_STRICT: CIGARs compared byte for byte with the reference instead of replayed on their pair (equally optimal ones fail), 0 -> inactive, 1 -> active, default (0) \n");
+  PRINTF_ERROR("\tWRITE_RESULT: file to write the results of the first rep (buffered, written by a background thread)\n");
+  PRINTF_ERROR("\tRESULT_FORMAT: format of the results, text -> score and run-length CIGAR lines (e.g. 12M1X3M), paf -> PAF lines (text as query, NM and cg tags), binary -> score and CIGAR runs, default (text) \n");
+  PRINTF_ERROR("\tINPUT: file with the sequence pairs to align ('>pattern' and '<text' lines, may be gzip or BGZF compressed), aligned once per rep\n");
+  PRINTF_ERROR("\tINPUT_THREADS: threads inflating a BGZF input (other gzip inputs use one), value must be between 1 and %d, default (%d) \n", INFLATE_MAX_THREADS, DEFAULT_INPUT_THREADS);
+  PRINTF_ERROR("\tBATCH_SIZE: number of pairs aligned at once (one task per pair on %d instances, a single wait per batch), value must be between 1 and %d, default (%d) \n", EWF_FPGA_INSTANCES, INT32_MAX, DEFAULT_BATCH_SIZE);
+  PRINTF_ERROR("\tPIPELINE_BATCHES: batches in flight (reading, aligning and writing overlap from 3 on), value must be between 1 and %d, default (%d) \n", INT32_MAX, DEFAULT_PIPELINE_BATCHES);
 
   return EXIT_FAILURE;
 
@@ -416,13 +1447,16 @@ int main(int argc,char* argv[]) {
   const char* saligned = getenv("ALIGNED");
   bool aux_aligned = true;
   if (saligned != NULL) {
-    if (strcmp(saligned,"0")){
+    if (!strcmp(saligned,"0")){
       aux_aligned = false;
     }
-    else if(strcmp(saligned,"1")){
+    else if(!strcmp(saligned,"1")){
       aux_aligned = true;
     }
-    else return usage(name);
+    else{
+      PRINTF_ERROR("Invalid value for ALIGNED\n");
+      return usage(name);
+    }
   }
   const bool aligned = aux_aligned;
 
@@ -463,6 +1497,151 @@ int main(int argc,char* argv[]) {
   const bool times = aux_times;
 
 
+  // Bool SCORE_ONLY variable
+  const char* sscore_only = getenv("SCORE_ONLY");
+  bool aux_score_only = false;
+  if (sscore_only != NULL) {
+    if (!strcmp(sscore_only,"0")){
+      aux_score_only = false;
+    }
+    else if(!strcmp(sscore_only,"1")){
+      aux_score_only = true;
+    }
+    else{
+      PRINTF_ERROR("Invalid value for SCORE_ONLY\n");
+      return usage(name);
+    }
+  }
+  const bool score_only = aux_score_only;
+
+
+  // Bool BIWFA variable
+  const char* sbiwfa = getenv("BIWFA");
+  bool aux_biwfa = false;
+  if (sbiwfa != NULL) {
+    if (!strcmp(sbiwfa,"0")){
+      aux_biwfa = false;
+    }
+    else if(!strcmp(sbiwfa,"1")){
+      aux_biwfa = true;
+    }
+    else{
+      PRINTF_ERROR("Invalid value for BIWFA\n");
+      return usage(name);
+    }
+  }
+  const bool biwfa = aux_biwfa;
+
+
+  // Bool COMPACT_BACKTRACE variable
+  const char* scompact_backtrace = getenv("COMPACT_BACKTRACE");
+  bool aux_compact_backtrace = false;
+  if (scompact_backtrace != NULL) {
+    if (!strcmp(scompact_backtrace,"0")){
+      aux_compact_backtrace = false;
+    }
+    else if(!strcmp(scompact_backtrace,"1")){
+      aux_compact_backtrace = true;
+    }
+    else{
+      PRINTF_ERROR("Invalid value for COMPACT_BACKTRACE\n");
+      return usage(name);
+    }
+  }
+  const bool compact_backtrace = aux_compact_backtrace && !score_only && !biwfa;
+
+
+  // Bool PACKED variable
+  const char* spacked = getenv("PACKED");
+  bool aux_packed = false;
+  if (spacked != NULL) {
+    if (!strcmp(spacked,"0")){
+      aux_packed = false;
+    }
+    else if(!strcmp(spacked,"1")){
+      aux_packed = true;
+    }
+    else{
+      PRINTF_ERROR("Invalid value for PACKED\n");
+      return usage(name);
+    }
+  }
+  const bool packed = aux_packed;
+
+
+  // Bool REDUCTION variable
+  const char* sreduction = getenv("REDUCTION");
+  bool aux_reduction = false;
+  if (sreduction != NULL) {
+    if (!strcmp(sreduction,"0")){
+      aux_reduction = false;
+    }
+    else if(!strcmp(sreduction,"1")){
+      aux_reduction = true;
+    }
+    else return usage(name);
+  }
+
+
+  // Int REDUCTION_MIN_LENGTH variable
+  const char* sreduction_min_length = getenv("REDUCTION_MIN_LENGTH");
+  int aux_reduction_min_length = DEFAULT_REDUCTION_MIN_LENGTH;
+  if (sreduction_min_length != NULL) {
+    int aux = atoi(sreduction_min_length);
+    if (aux <= 0){
+      return usage(name);
+    }
+    aux_reduction_min_length = aux;
+  }
+
+
+  // Int REDUCTION_MAX_DISTANCE variable
+  const char* sreduction_max_distance = getenv("REDUCTION_MAX_DISTANCE");
+  int aux_reduction_max_distance = DEFAULT_REDUCTION_MAX_DISTANCE;
+  if (sreduction_max_distance != NULL) {
+    int aux = atoi(sreduction_max_distance);
+    if (aux < 0){
+      return usage(name);
+    }
+    aux_reduction_max_distance = aux;
+  }
+  const ewf_reduction_t reduction = {
+      .enabled = aux_reduction && !score_only && !biwfa,
+      .min_wavefront_length = aux_reduction_min_length,
+      .max_distance_threshold = aux_reduction_max_distance};
+
+
+  // Int MAX_SCORE variable
+  const char* smax_score = getenv("MAX_SCORE");
+  int aux_max_score = INT32_MAX; // Unbounded (up to EWF_MAX_SCORE on the device)
+  if (smax_score != NULL) {
+    int aux = atoi(smax_score);
+    if (aux < 0){
+      return usage(name);
+    }
+    aux_max_score = aux;
+  }
+  const int max_score = aux_max_score;
+
+
+  // Bool FILTER variable
+  const char* sfilter = getenv("FILTER");
+  bool aux_filter = false;
+  if (sfilter != NULL) {
+    if (!strcmp(sfilter,"0")){
+      aux_filter = false;
+    }
+    else if(!strcmp(sfilter,"1")){
+      aux_filter = true;
+    }
+    else{
+      PRINTF_ERROR("Invalid value for FILTER\n");
+      return usage(name);
+    }
+  }
+  const bool filter = aux_filter;
+
+
   // String CHECK variable
   const char* scheck = getenv("CHECK");
   if (scheck != NULL){
@@ -481,6 +1660,24 @@ int main(int argc,char* argv[]) {
   const bool check = (cfilename != NULL);
 
 
+  // Bool CHECK_STRICT variable
+  const char* scheck_strict = getenv("CHECK_STRICT");
+  bool aux_check_strict = false;
+  if (scheck_strict != NULL) {
+    if (!strcmp(scheck_strict,"0")){
+      aux_check_strict = false;
+    }
+    else if(!strcmp(scheck_strict,"1")){
+      aux_check_strict = true;
+    }
+    else{
+      PRINTF_ERROR("Invalid value for CHECK_STRICT\n");
+      return usage(name);
+    }
+  }
+  const bool check_strict = aux_check_strict;
+
+
   // String WRITE_RESULT variable
   const char* swrite_result = getenv("WRITE_RESULT");
   if (swrite_result != NULL){
@@ -494,52 +1691,118 @@ int main(int argc,char* argv[]) {
   const char* rfilename = swrite_result;
   const bool write_result = (rfilename != NULL);
 
+
+  // String RESULT_FORMAT variable
+  const char* sresult_format = getenv("RESULT_FORMAT");
+  result_format_t aux_result_format = RESULT_FORMAT_TEXT;
+  if (sresult_format != NULL) {
+    if (!strcmp(sresult_format,"text")) {
+      aux_result_format = RESULT_FORMAT_TEXT;
+    }
+    else if (!strcmp(sresult_format,"paf")) {
+      aux_result_format = RESULT_FORMAT_PAF;
+    }
+    else if (!strcmp(sresult_format,"binary")) {
+      aux_result_format = RESULT_FORMAT_BINARY;
+    }
+    else {
+      PRINTF_ERROR("Invalid value for RESULT_FORMAT\n");
+      return usage(name);
+    }
+  }
+  const result_format_t result_format = aux_result_format;
+
+
+  // String INPUT variable
+  const char* sinput = getenv("INPUT");
+  if (sinput != NULL){
+    if (access(sinput, F_OK) == 0){
+      if (access(sinput, R_OK) != 0){
+        PRINTF_ERROR("Input file %s is not readable\n", sinput);
+        return EXIT_FAILURE;
+      }
+    }
+    else{
+      PRINTF_ERROR("Input file %s does not exist\n", sinput);
+      return EXIT_FAILURE;
+    }
+  }
+  const char* ifilename = sinput;
+  const bool input = (ifilename != NULL);
+
+
+  // Int INPUT_THREADS variable
+  const char* sinput_threads = getenv("INPUT_THREADS");
+  int aux_input_threads = DEFAULT_INPUT_THREADS;
+  if (sinput_threads != NULL) {
+    int aux = atoi(sinput_threads);
+    if (aux <= 0 || aux > INFLATE_MAX_THREADS){
+      PRINTF_ERROR("Invalid value for INPUT_THREADS\n");
+      return usage(name);
+    }
+    aux_input_threads = aux;
+  }
+  const int input_threads = aux_input_threads;
+
+
+  // Int BATCH_SIZE variable
+  const char* sbatch_size = getenv("BATCH_SIZE");
+  int aux_batch_size = DEFAULT_BATCH_SIZE;
+  if (sbatch_size != NULL) {
+    int aux = atoi(sbatch_size);
+    if (aux <= 0){
+      PRINTF_ERROR("Invalid value for BATCH_SIZE\n");
+      return usage(name);
+    }
+    aux_batch_size = aux;
+  }
+  const int batch_size = aux_batch_size;
+
+
+  // Int PIPELINE_BATCHES variable
+  const char* spipeline_batches = getenv("PIPELINE_BATCHES");
+  int aux_pipeline_batches = DEFAULT_PIPELINE_BATCHES;
+  if (spipeline_batches != NULL) {
+    int aux = atoi(spipeline_batches);
+    if (aux <= 0){
+      PRINTF_ERROR("Invalid value for PIPELINE_BATCHES\n");
+      return usage(name);
+    }
+    aux_pipeline_batches = aux;
+  }
+  const int pipeline_batches = aux_pipeline_batches;
+
   
 
   // --------------------------------------------------------------------------------------------------------
 
 
-  // Buffers
-  char* pattern_mem_noalign =
+  // Default pair
+  const char* pattern =
       "TCTTTACTCGCGCGTTGGAGAAATACAATAGTTCTTTACTCGCGCGTTGGAGAAATACAATAGTTCTTTACTCGCGCGTTGGAGAAATACAATAGTTCTTTACTCGCGCGTTGGAGAAATACAATAGT";
-  char* text_mem_noalign    =
+  const char* text    =
       "TCTATACTGCGCGTTTGGAGAAATAAAATAGTTCTATACTGCGCGTTTGGAGAAATAAAATAGTTCTATACTGCGCGTTTGGAGAAATAAAATAGTTCTATACTGCGCGTTTGGAGAAATAAAATAGT";
+  const int pattern_length = strlen(pattern);
+  const int text_length = strlen(text);
 
-  // Buffers length
-  const uint32_t pattern_length = strlen(pattern_mem_noalign);
-  const uint32_t text_length = strlen(text_mem_noalign);
-  const uint32_t max_distance = pattern_length + text_length;
-  // Pattern & Text
-  char* pattern = NULL;
-  char* text = NULL;
-  
+  // Determine the page size (pair buffers are aligned to it)
   size_t page_size = 0;
   if (aligned){
-
-    // Determine the page size
     page_size = sysconf(_SC_PAGESIZE);
+  }
 
-    // Allocate memory aligned to page size for pattern string
-    pattern = (char*) aligned_alloc(page_size,max_distance*sizeof(char));
-    if (pattern == NULL) {
-      PRINTF_ERROR("Aligned allocation of pattern failed");
-      return EXIT_FAILURE;
-    }
-
-    // Allocate memory aligned to page size for text string 
-    text = (char*) aligned_alloc(page_size,max_distance*sizeof(char));
-    if (text == NULL) {
-      PRINTF_ERROR("Aligned allocation of text failed");
-      return EXIT_FAILURE;
-    }
-
-    memcpy(pattern, pattern_mem_noalign, pattern_length);
-    memcpy(text,text_mem_noalign, text_length);
-
+  // Files
+  sequence_reader_t reader;
+  if (input && sequence_reader_open(&reader,ifilename,input_threads)) {
+    return EXIT_FAILURE;
   }
-  else{
-    pattern = pattern_mem_noalign;
-    text = text_mem_noalign;
+  check_references_t references;
+  if (check && check_references_load(&references,cfilename,check_strict)) {
+    return EXIT_FAILURE;
+  }
+  result_writer_t result_writer;
+  if (write_result && result_writer_open(&result_writer,rfilename,result_format)) {
+    return EXIT_FAILURE;
   }
 
   //DEBUG(debug,"Edit wavefront data type size: %ld, position: %p\n",sizeof(edit_wavefront_t), pattern);
@@ -554,103 +1817,152 @@ int main(int argc,char* argv[]) {
   PRINTF("\tAligned: %d\n",aligned);
   PRINTF("\tDebug: %d\n",debug);
   PRINTF("\tTimes: %d\n",times);
-  PRINTF_COND(check,"\tCheck results from filename: %s\n",cfilename);
+  PRINTF("\tScore only: %d\n",score_only);
+  PRINTF("\tBiWFA: %d\n",biwfa);
+  PRINTF("\tCompact backtrace: %d\n",compact_backtrace);
+  PRINTF("\tPacked: %d\n",packed);
+  PRINTF("\tOffset width: %d bits\n",EWF_OFFSET_BITS);
+  PRINTF_COND(max_score != INT32_MAX,"\tMax score: %d\n",max_score);
+  PRINTF_COND(filter,"\tFilter: %d-gram lower bound\n",FILTER_QGRAM_LENGTH);
+  PRINTF_COND(reduction.enabled,"\tReduction: min length %d, max distance %d\n",
+      reduction.min_wavefront_length,reduction.max_distance_threshold);
+  PRINTF_COND(check,"\tCheck results from filename: %s (%d references)\n",cfilename,references.num_pairs);
+  PRINTF_COND(check,"\tCheck CIGARs: %s\n",check_strict ? "compared with the reference" : "replayed on their pair");
   PRINTF_COND(write_result,"\tWrite result to filename: %s\n",rfilename);
+  PRINTF_COND(write_result,"\tResult format: %s\n",
+      (result_format == RESULT_FORMAT_PAF) ? "paf" : (result_format == RESULT_FORMAT_BINARY) ? "binary" : "text");
+  PRINTF_COND(input,"\tInput sequences from filename: %s\n",ifilename);
+  PRINTF_COND(input,"\tInput memory-mapped: %d\n",input && reader.map != NULL);
+  PRINTF_COND(input && reader.compressed,"\tInput compressed: %s, %d inflate threads\n",reader.bgzf ? "BGZF" : "gzip",reader.num_threads);
+  PRINTF("\tBatch size: %d\n",batch_size);
+  PRINTF("\tPipeline batches: %d\n",pipeline_batches);
+  PRINTF("\tFPGA instances: %d\n",EWF_FPGA_INSTANCES);
 
   PRINTF("\n");
-  PRINTF("Pattern length: %d\n",pattern_length);
-  PRINTF("Text length: %d\n",text_length);
-  PRINTF("\n");
+  PRINTF_COND(!input,"Pattern length: %d\n",pattern_length);
+  PRINTF_COND(!input,"Text length: %d\n",text_length);
+  PRINTF_COND(!input,"\n");
 
   PRINTF("#######################################################################################\n");
   PRINTF("\n");
 
-  edit_wavefronts_fpga_t wavefronts;
+  fpga_batch_t* const batches = calloc(pipeline_batches,sizeof(fpga_batch_t));
+  if (batches == NULL) {
+    PRINTF_ERROR("Allocation of pipeline batches failed\n");
+    return EXIT_FAILURE;
+  }
 
-  // Initialize wavefronts
+  // Initialize wavefronts of every pair of the batches (resized on demand for input pairs)
   PRINTF("\nInitializing wavefronts\n");
   const double tStartInit = wall_time();
-  edit_wavefronts_init(&wavefronts,pattern_length,text_length,aligned,page_size);
+  int b;
+  for (b=0;b<pipeline_batches;++b) {
+    if (fpga_batch_init(batches+b,batch_size,pattern_length,text_length,max_score,aligned,page_size)) {
+      return EXIT_FAILURE;
+    }
+  }
   const double tEndInit = wall_time();
   PRINTF("Wavefronts initialized\n");
   PRINTF_COND(times,"Init time: %f\n", tEndInit-tStartInit);
 
-  // Warm up execution
-  /*PRINTF("\nWarming up...\n");
-  const double tStartWarm = wall_time();
-  edit_wavefronts_align(wavefronts.offsets,wavefronts.edit_cigar,&wavefronts.edit_cigar_length,pattern,pattern_length,text,text_length,max_distance,&wavefronts.edit_cigar_length);
-  #pragma oss taskwait
-  const double tEndWarm = wall_time();
-  PRINTF("Warm up finished\n");
-  PRINTF_COND(times,"Warm up time: %f\n", tEndWarm-tStartWarm);*/
-
   int i;
-  int score = 0;
+  const bool pack = packed && !score_only && !biwfa && !compact_backtrace;
+  bool check_failed = false;
   for (i=0;i<reps;++i) {
 
     PRINTF("\n---------------------------------------------------------------------------------------\n");
 
     PRINTF("\nRepetition: %d\n",i);
 
-    // Align Wavefronts
-    PRINTF("\nAligning...\n");
-    const double tStartAlign = wall_time();
-    edit_wavefronts_align(wavefronts.offsets,wavefronts.edit_cigar,&wavefronts.edit_cigar_length,pattern,pattern_length,text,text_length,max_distance,&score);
-    FPGA("oss taskwait")
-    const double tEndAlign = wall_time();
-    PRINTF("Alignment finished\n");
-    PRINTF_COND(times,"WFA execution time: %f\n",tEndAlign-tStartAlign);
+    if (input) sequence_reader_rewind(&reader);
+    for (b=0;b<pipeline_batches;++b) batches[b].input_position = 0;
 
-    // Check results
-    PRINTF_COND(check,"\nChecking results...\n");
-    const double tStartCheck = wall_time();
-    if (check){
-      if(edit_wavefronts_check(wavefronts.edit_cigar,wavefronts.edit_cigar_length,score,cfilename)) {
-        return EXIT_FAILURE;
+    // Align all pairs (a single one if there is no input file)
+    //   The host reads batch b while batch b-1 is aligned and batch b-2 is written
+    PRINTF("\nAligning...\n");
+    fpga_pipeline_stats_t stats = {0};
+    stats.status = EXIT_SUCCESS;
+    const double tStartBatch = wall_time();
+    for (b=0;;++b) {
+      fpga_batch_t* const batch = batches + (b % pipeline_batches);
+
+      // Wait until the batch buffers are written out
+      FPGA("oss taskwait on(*batch)")
+
+      // Release the input consumed by the batch (later batches were read after it)
+      if (input) sequence_reader_release(&reader,batch->input_position);
+
+      // Fetch batch (pairs are copied to their own buffers unless they are mapped)
+      const double tStartCopy = wall_time();
+      batch->num_pairs = 0;
+      batch->num_escaped = 0;
+      while (batch->num_pairs < batch->max_pairs) {
+        const char* pair_pattern = pattern;
+        const char* pair_text = text;
+        int pair_pattern_length = pattern_length;
+        int pair_text_length = text_length;
+        if (input) {
+          const int status = sequence_reader_read_pair(&reader,
+              &pair_pattern,&pair_pattern_length,&pair_text,&pair_text_length);
+          if (status < 0) return EXIT_FAILURE;
+          if (status == 0) break;
+        }
+        else if (b > 0 || batch->num_pairs > 0) break;
+        if (fpga_batch_add(batch,pair_pattern,pair_pattern_length,pair_text,pair_text_length,
+            !input || reader.map == NULL,pack,!score_only)) {
+          return EXIT_FAILURE;
+        }
+        batch->num_escaped += (pack && !batch->pairs[batch->num_pairs-1].packed);
       }
-    }
-    PRINTF_COND(check,"Check finished\n");
-    const double tEndCheck = wall_time();
-    PRINTF_COND(check && times,"Check results time: %f\n", tEndCheck-tStartCheck);
+      batch->input_position = input ? reader.map_position : 0;
+      batch->tCopy = wall_time()-tStartCopy;
+      if (batch->num_pairs == 0) break;
 
-    // Write results
-    PRINTF_COND(write_result && !i,"\nWriting results...\n");
-    const double tStartWrite = wall_time();
-    if (write_result && !i){
-      if(edit_wavefronts_write_result(wavefronts.edit_cigar,wavefronts.edit_cigar_length,score,rfilename)){
-        return EXIT_FAILURE;
-      }
+      // Align Wavefronts (independent tasks spread over the instances, one wait per batch)
+      fpga_batch_align(batch,score_only,biwfa,compact_backtrace,filter,max_score,&reduction);
+
+      // Check and write results (after the previous batches)
+      fpga_batch_output(batch,&stats,check ? &references : NULL,(write_result && !i) ? &result_writer : NULL,score_only,reduction.enabled);
     }
-    PRINTF_COND(write_result && !i,"Results written\n");
-    const double tEndWrite = wall_time();
-    PRINTF_COND(write_result && !i && times,"Write results time: %f\n", tEndWrite-tStartWrite);
+    FPGA("oss taskwait")
+    const double tEndBatch = wall_time();
+    if (stats.status != EXIT_SUCCESS) return EXIT_FAILURE;
+    PRINTF("Alignment finished\n");
+    PRINTF_COND(input,"Alignments: %d\n",stats.num_alignments);
+    PRINTF_COND(input && pack,"Escaped alignments (non-ACGT): %d\n",stats.num_escaped);
+    PRINTF_COND(input,"Unaligned alignments (above max score): %d\n",stats.num_unaligned-stats.num_too_wide);
+    PRINTF_COND(input,"Unaligned alignments (offsets above %d bits): %d\n",EWF_OFFSET_BITS,stats.num_too_wide);
+    PRINTF_COND(input && filter,"Filtered alignments (q-gram bound above max score): %d\n",stats.num_filtered);
+    PRINTF_COND(check && reduction.enabled,"Suboptimal alignments (reduction): %d (%.2f%%), score excess %ld (%.4f per alignment)\n",
+        stats.check_counts[CHECK_SUBOPTIMAL],100.0*stats.check_counts[CHECK_SUBOPTIMAL]/MAX(stats.num_alignments,1),
+        stats.score_excess,(double)stats.score_excess/MAX(stats.num_alignments,1));
+    const int num_mismatches = stats.num_alignments - stats.check_counts[CHECK_OK] - stats.check_counts[CHECK_SUBOPTIMAL];
+    PRINTF_COND(check,"Check mismatches: %d (scores %d, CIGARs %d, below reference %d, without reference %d)\n",
+        num_mismatches,stats.check_counts[CHECK_SCORE],stats.check_counts[CHECK_CIGAR],stats.check_counts[CHECK_BELOW],stats.check_counts[CHECK_MISSING]);
+    check_failed |= check && num_mismatches > 0;
+    PRINTF_COND(input && times,"Copy time: %f\n",stats.tCopy);
+    PRINTF_COND(times,"WFA execution time: %f\n",stats.tAlign);
+    PRINTF_COND(check && times,"Check results time: %f\n",stats.tCheck);
+    PRINTF_COND(write_result && !i && times,"Write results time: %f\n",stats.tWrite);
+    PRINTF_COND(input && times,"Total time: %f\n",tEndBatch-tStartBatch);
+    PRINTF_COND(input && times,"Throughput: %f alignments/s\n",stats.num_alignments/(tEndBatch-tStartBatch));
   }
 
-  // Clean Wavefronts Offsets
-  PRINTF("\nCleaning wavefronts offsets...\n");
+  // Clean Wavefronts and pair buffers
+  PRINTF("\nCleaning wavefronts...\n");
   const double tStartClean = wall_time();
-  edit_wavefronts_clean(&wavefronts);
+  for (b=0;b<pipeline_batches;++b) {
+    fpga_batch_free(batches+b);
+  }
+  free(batches);
   const double tEndClean = wall_time();
   PRINTF("Cleaning finished\n");
   PRINTF_COND(times,"Clean time: %f\n", tEndClean-tStartClean);
 
-  if(aligned){
-    PRINTF("\nFreeing memory space used for pattern and text...\n");
-    const double tStartClean = wall_time();
-    free(pattern);
-    free(text);
-    const double tEndClean = wall_time();
-    PRINTF("Free finished\n");
-    PRINTF_COND(times,"Free time: %f\n", tEndClean-tStartClean);
-  }
-
-}
-
-
-
-
-
-
-
-
+  // Close files
+  if (input) sequence_reader_close(&reader);
+  if (check) check_references_free(&references);
+  if (write_result && result_writer_close(&result_writer)) return EXIT_FAILURE;
+  if (check_failed) return EXIT_FAILURE;
 
+}
\ No newline at end of file
@@ -0,0 +1,472 @@
+/*
+ *  Wavefront Alignments Algorithms
+ *  Copyright (c) 2024 by Diego García Aranda <diego.garcia1@bsc.es>
+ *
+ *  This file is part of Wavefront Alignments Algorithms.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * PROJECT: Wavefront Alignments Algorithms
+ * AUTHOR(S): Diego García Aranda <diego.garcia1@bsc.es>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <stdbool.h>
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#define MAX(a,b) (((a)>=(b))?(a):(b))
+#define MIN(a,b) (((a)<=(b))?(a):(b))
+
+#define PRINTF(format, ...) do { printf(format, ##__VA_ARGS__); } while(0)
+#define PRINTF_COND(condition,format, ...) do { if (condition) { printf(format, ##__VA_ARGS__); } } while(0)
+#define PRINTF_ERROR(format, ...) do { fprintf(stderr, format, ##__VA_ARGS__); } while(0);
+
+#define BENCH_MAX_LIST 32
+#define BENCH_MAX_ENV 8
+#define BENCH_PATH_LENGTH 4096
+
+#define DEFAULT_LENGTHS "100,1000,10000"
+#define DEFAULT_ERROR_RATES "0.01,0.05,0.10"
+#define DEFAULT_INDEL_RATIO "0.5"
+#define DEFAULT_BASES 1000000
+#define DEFAULT_REPS 3
+#define DEFAULT_SEED "1"
+
+/*
+ * Comma-separated list (items point into its own copy of the string)
+ */
+typedef struct {
+  char* buffer;
+  char* items[BENCH_MAX_LIST];
+  int num_items;
+} bench_list_t;
+
+int bench_list_parse(
+    bench_list_t* const list,
+    const char* const string) {
+  list->buffer = strdup(string);
+  list->num_items = 0;
+  if (list->buffer == NULL) return EXIT_FAILURE;
+  char* item = strtok(list->buffer,",");
+  while (item != NULL) {
+    if (list->num_items == BENCH_MAX_LIST) {
+      PRINTF_ERROR("Lists hold up to %d items\n",BENCH_MAX_LIST);
+      return EXIT_FAILURE;
+    }
+    list->items[list->num_items++] = item;
+    item = strtok(NULL,",");
+  }
+  return (list->num_items > 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/*
+ * Environment of a run (variables set in the child only)
+ */
+typedef struct {
+  const char* names[BENCH_MAX_ENV];
+  const char* values[BENCH_MAX_ENV];
+  int num_variables;
+} bench_env_t;
+
+void bench_env_set(
+    bench_env_t* const env,
+    const char* const name,
+    const char* const value) {
+  env->names[env->num_variables] = name;
+  env->values[env->num_variables] = value;
+  ++(env->num_variables);
+}
+
+/*
+ * Run a program with its output in a log file
+ *   Returns its exit status (-1 if it could not be run), peak memory in KB
+ */
+int bench_run(
+    const char* const path,
+    const bench_env_t* const env,
+    const char* const log_filename,
+    long* const peak_memory) {
+  const pid_t pid = fork();
+  if (pid < 0) {
+    PRINTF_ERROR("Error while running %s\n",path);
+    return -1;
+  }
+  if (pid == 0) {
+    const int log_fd = open(log_filename,O_WRONLY|O_CREAT|O_TRUNC,0644);
+    if (log_fd < 0) _exit(127);
+    dup2(log_fd,STDOUT_FILENO);
+    dup2(log_fd,STDERR_FILENO);
+    close(log_fd);
+    int i;
+    for (i=0;i<env->num_variables;++i) {
+      setenv(env->names[i],env->values[i],1);
+    }
+    execl(path,path,(char*)NULL);
+    _exit(127);
+  }
+  int status;
+  struct rusage usage;
+  if (wait4(pid,&status,0,&usage) < 0) {
+    PRINTF_ERROR("Error while waiting for %s\n",path);
+    return -1;
+  }
+  *peak_memory = usage.ru_maxrss;
+  return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+/*
+ * Measures of a run (from the TIMES output of the aligners, best repetition)
+ */
+typedef struct {
+  long cells;
+  int alignments;
+  double throughput;
+  double align_time;
+} bench_measures_t;
+
+int bench_parse_log(
+    const char* const log_filename,
+    bench_measures_t* const measures) {
+  FILE* const log_file = fopen(log_filename,"r");
+  if (log_file == NULL) {
+    PRINTF_ERROR("Error while opening log file %s\n",log_filename);
+    return EXIT_FAILURE;
+  }
+  measures->alignments = 0;
+  measures->throughput = 0.0;
+  measures->align_time = 0.0;
+  char line[256];
+  while (fgets(line,sizeof(line),log_file) != NULL) {
+    long cells;
+    int alignments;
+    double value;
+    if (sscanf(line,"Cells: %ld",&cells) == 1) {
+      measures->cells = cells;
+    }
+    else if (sscanf(line,"Alignments: %d",&alignments) == 1) {
+      measures->alignments = alignments;
+    }
+    else if (sscanf(line,"Throughput: %lf",&value) == 1) {
+      measures->throughput = MAX(measures->throughput,value);
+    }
+    else if (sscanf(line,"WFA execution time: %lf",&value) == 1) {
+      measures->align_time = (measures->align_time == 0.0) ? value : MIN(measures->align_time,value);
+    }
+  }
+  fclose(log_file);
+  return EXIT_SUCCESS;
+}
+
+/*
+ * Compare the scores of two result files (score and CIGAR lines)
+ *   Returns the number of pairs with different scores (-1 if the files can not be read)
+ */
+int bench_compare_results(
+    const char* const reference_filename,
+    const char* const result_filename) {
+  FILE* const reference_file = fopen(reference_filename,"r");
+  FILE* const result_file = fopen(result_filename,"r");
+  if (reference_file == NULL || result_file == NULL) {
+    if (reference_file != NULL) fclose(reference_file);
+    if (result_file != NULL) fclose(result_file);
+    return -1;
+  }
+  char* reference_line = NULL;
+  char* result_line = NULL;
+  size_t reference_capacity = 0, result_capacity = 0;
+  int mismatches = 0;
+  long line = 0;
+  while (true) {
+    const ssize_t reference_length = getline(&reference_line,&reference_capacity,reference_file);
+    const ssize_t result_length = getline(&result_line,&result_capacity,result_file);
+    if (reference_length < 0 || result_length < 0) {
+      mismatches += (reference_length != result_length); // Different number of pairs
+      break;
+    }
+    if ((line++ % 2) == 0) {
+      mismatches += (atoi(reference_line) != atoi(result_line));
+    }
+  }
+  free(reference_line);
+  free(result_line);
+  fclose(reference_file);
+  fclose(result_file);
+  return mismatches;
+}
+
+// Display usage information
+int usage(char* name){
+
+  PRINTF_ERROR("Usage: %s\n", name);
+  PRINTF_ERROR("Aligns generated pairs with every binary over a length x error rate grid, prints CSV (alignments/s, GCUPS, peak memory)\n");
+  PRINTF_ERROR("Environment variables: \n");
+  PRINTF_ERROR("\tUSAGE: print usage information\n");
+  PRINTF_ERROR("\tGENERATOR: path of the pair generator\n");
+  PRINTF_ERROR("\tBINARIES: binaries to run, comma-separated name=path items (scores are compared with the first one, unaligned pairs above a binary max score count as mismatches)\n");
+  PRINTF_ERROR("\tLENGTHS: comma-separated pattern lengths, default (%s) \n", DEFAULT_LENGTHS);
+  PRINTF_ERROR("\tERROR_RATES: comma-separated error rates, default (%s) \n", DEFAULT_ERROR_RATES);
+  PRINTF_ERROR("\tINDEL_RATIO: fraction of errors that are indels, default (%s) \n", DEFAULT_INDEL_RATIO);
+  PRINTF_ERROR("\tBASES: pattern bases of each input (pairs = BASES/length), value must be between 1 and %d, default (%d) \n", INT32_MAX, DEFAULT_BASES);
+  PRINTF_ERROR("\tREPS: repetitions of each run (the best one is reported), value must be between 1 and %d, default (%d) \n", INT32_MAX, DEFAULT_REPS);
+  PRINTF_ERROR("\tSEED: seed of the generator, default (%s) \n", DEFAULT_SEED);
+  PRINTF_ERROR("\tWORK_DIR: directory for the inputs, results and logs, default (.) \n");
+  PRINTF_ERROR("\tCSV: file to write the CSV report (also printed)\n");
+  PRINTF_ERROR("\tJSON: file to write the JSON report\n");
+
+  return EXIT_FAILURE;
+
+}
+
+
+int main(int argc,char* argv[]) {
+
+  // Get program name
+  char* name = argv[0];
+
+  if(argc != 1){
+    return usage(name);
+  }
+
+
+  // --------------------------------------------------------------------------------------------------------
+  // Environment variables
+
+
+  // USAGE variable
+  const char* susage = getenv("USAGE");
+  if (susage != NULL){
+    return usage(name);
+  }
+
+
+  // String GENERATOR variable
+  const char* sgenerator = getenv("GENERATOR");
+  if (sgenerator == NULL || access(sgenerator, X_OK) != 0){
+    PRINTF_ERROR("Generator is not defined or not executable\n");
+    return usage(name);
+  }
+  const char* generator = sgenerator;
+
+
+  // List BINARIES variable (name=path items)
+  const char* sbinaries = getenv("BINARIES");
+  bench_list_t binaries;
+  if (sbinaries == NULL || bench_list_parse(&binaries,sbinaries)){
+    PRINTF_ERROR("Invalid value for BINARIES\n");
+    return usage(name);
+  }
+  const char* binary_paths[BENCH_MAX_LIST];
+  int b;
+  for (b=0;b<binaries.num_items;++b) {
+    char* const separator = strchr(binaries.items[b],'=');
+    if (separator == NULL || access(separator+1, X_OK) != 0) {
+      PRINTF_ERROR("Binary %s is not name=path or not executable\n",binaries.items[b]);
+      return usage(name);
+    }
+    *separator = '\0';
+    binary_paths[b] = separator+1;
+  }
+
+
+  // List LENGTHS variable
+  const char* slengths = getenv("LENGTHS");
+  bench_list_t lengths;
+  if (bench_list_parse(&lengths,(slengths != NULL) ? slengths : DEFAULT_LENGTHS)){
+    PRINTF_ERROR("Invalid value for LENGTHS\n");
+    return usage(name);
+  }
+  int l;
+  for (l=0;l<lengths.num_items;++l) {
+    if (atoi(lengths.items[l]) <= 0) {
+      PRINTF_ERROR("Invalid value for LENGTHS\n");
+      return usage(name);
+    }
+  }
+
+
+  // List ERROR_RATES variable
+  const char* serror_rates = getenv("ERROR_RATES");
+  bench_list_t error_rates;
+  if (bench_list_parse(&error_rates,(serror_rates != NULL) ? serror_rates : DEFAULT_ERROR_RATES)){
+    PRINTF_ERROR("Invalid value for ERROR_RATES\n");
+    return usage(name);
+  }
+
+
+  // String INDEL_RATIO variable (checked by the generator)
+  const char* sindel_ratio = getenv("INDEL_RATIO");
+  const char* indel_ratio = (sindel_ratio != NULL) ? sindel_ratio : DEFAULT_INDEL_RATIO;
+
+
+  // Int BASES variable
+  const char* sbases = getenv("BASES");
+  int aux_bases = DEFAULT_BASES;
+  if (sbases != NULL) {
+    int aux = atoi(sbases);
+    if (aux <= 0){
+      PRINTF_ERROR("Invalid value for BASES\n");
+      return usage(name);
+    }
+    aux_bases = aux;
+  }
+  const int bases = aux_bases;
+
+
+  // Int REPS variable
+  const char* sreps = getenv("REPS");
+  int aux_reps = DEFAULT_REPS;
+  if (sreps != NULL) {
+    int aux = atoi(sreps);
+    if (aux <= 0){
+      PRINTF_ERROR("Invalid value for REPS\n");
+      return usage(name);
+    }
+    aux_reps = aux;
+  }
+  char reps[16];
+  snprintf(reps,sizeof(reps),"%d",aux_reps);
+
+
+  // String SEED variable (checked by the generator)
+  const char* sseed = getenv("SEED");
+  const char* seed = (sseed != NULL) ? sseed : DEFAULT_SEED;
+
+
+  // String WORK_DIR variable
+  const char* swork_dir = getenv("WORK_DIR");
+  const char* work_dir = (swork_dir != NULL) ? swork_dir : ".";
+  if (access(work_dir, W_OK) != 0){
+    PRINTF_ERROR("Work directory %s is not writable\n", work_dir);
+    return EXIT_FAILURE;
+  }
+
+
+  // String CSV and JSON variables
+  const char* csv_filename = getenv("CSV");
+  const char* json_filename = getenv("JSON");
+
+  // --------------------------------------------------------------------------------------------------------
+
+
+  FILE* csv_file = NULL;
+  if (csv_filename != NULL) {
+    csv_file = fopen(csv_filename,"w");
+    if (csv_file == NULL) {
+      PRINTF_ERROR("Error while opening CSV file %s\n",csv_filename);
+      return EXIT_FAILURE;
+    }
+  }
+  FILE* json_file = NULL;
+  if (json_filename != NULL) {
+    json_file = fopen(json_filename,"w");
+    if (json_file == NULL) {
+      PRINTF_ERROR("Error while opening JSON file %s\n",json_filename);
+      return EXIT_FAILURE;
+    }
+    fputs("[",json_file);
+  }
+
+  const char* const header = "binary,length,error_rate,pairs,alignments_per_second,align_time,gcups,peak_memory_kb,mismatches\n";
+  PRINTF("%s",header);
+  fflush(stdout);
+  if (csv_file != NULL) fputs(header,csv_file);
+
+  int status = EXIT_SUCCESS, num_records = 0, e;
+  for (l=0;l<lengths.num_items;++l) {
+    for (e=0;e<error_rates.num_items;++e) {
+      const char* const length = lengths.items[l];
+      const char* const error_rate = error_rates.items[e];
+      char pairs[16];
+      snprintf(pairs,sizeof(pairs),"%d",MAX(1,bases/atoi(length)));
+
+      // Generate input
+      char input_filename[BENCH_PATH_LENGTH], log_filename[BENCH_PATH_LENGTH];
+      snprintf(input_filename,sizeof(input_filename),"%s/bench_L%s_E%s.seq",work_dir,length,error_rate);
+      snprintf(log_filename,sizeof(log_filename),"%s/bench_L%s_E%s.log",work_dir,length,error_rate);
+      bench_env_t env = {.num_variables = 0};
+      bench_env_set(&env,"OUTPUT",input_filename);
+      bench_env_set(&env,"PAIRS",pairs);
+      bench_env_set(&env,"LENGTH",length);
+      bench_env_set(&env,"ERROR_RATE",error_rate);
+      bench_env_set(&env,"INDEL_RATIO",indel_ratio);
+      bench_env_set(&env,"SEED",seed);
+      long peak_memory;
+      bench_measures_t input_measures = {.cells = 0};
+      if (bench_run(generator,&env,log_filename,&peak_memory) != 0 ||
+          bench_parse_log(log_filename,&input_measures)) {
+        PRINTF_ERROR("Generation of %s has failed (see %s)\n",input_filename,log_filename);
+        status = EXIT_FAILURE;
+        continue;
+      }
+
+      // Align it with every binary
+      char reference_filename[BENCH_PATH_LENGTH];
+      for (b=0;b<binaries.num_items;++b) {
+        char result_filename[BENCH_PATH_LENGTH];
+        snprintf(result_filename,sizeof(result_filename),"%s/bench_%s_L%s_E%s.out",work_dir,binaries.items[b],length,error_rate);
+        snprintf(log_filename,sizeof(log_filename),"%s/bench_%s_L%s_E%s.log",work_dir,binaries.items[b],length,error_rate);
+        if (b == 0) strcpy(reference_filename,result_filename);
+        env.num_variables = 0;
+        bench_env_set(&env,"INPUT",input_filename);
+        bench_env_set(&env,"WRITE_RESULT",result_filename);
+        bench_env_set(&env,"REPS",reps);
+        bench_env_set(&env,"TIMES","1");
+        bench_measures_t measures = input_measures;
+        if (bench_run(binary_paths[b],&env,log_filename,&peak_memory) != 0 ||
+            bench_parse_log(log_filename,&measures)) {
+          PRINTF_ERROR("Run of %s on %s has failed (see %s)\n",binaries.items[b],input_filename,log_filename);
+          status = EXIT_FAILURE;
+          continue;
+        }
+        const int mismatches = (b == 0) ? 0 : bench_compare_results(reference_filename,result_filename);
+        const double gcups = (measures.align_time > 0.0) ? measures.cells/measures.align_time*1.0e-9 : 0.0;
+
+        // Report
+        char record[1024];
+        snprintf(record,sizeof(record),"%s,%s,%s,%d,%.2f,%.6f,%.4f,%ld,%d\n",
+            binaries.items[b],length,error_rate,measures.alignments,measures.throughput,measures.align_time,gcups,peak_memory,mismatches);
+        PRINTF("%s",record);
+        fflush(stdout);
+        if (csv_file != NULL) fputs(record,csv_file);
+        if (json_file != NULL) {
+          fprintf(json_file,"%s\n  {\"binary\": \"%s\", \"length\": %s, \"error_rate\": %s, \"pairs\": %d, "
+              "\"alignments_per_second\": %.2f, \"align_time\": %.6f, \"gcups\": %.4f, \"peak_memory_kb\": %ld, \"mismatches\": %d}",
+              (num_records > 0) ? "," : "",binaries.items[b],length,error_rate,measures.alignments,
+              measures.throughput,measures.align_time,gcups,peak_memory,mismatches);
+        }
+        ++num_records;
+      }
+    }
+  }
+
+  // Close files
+  if (csv_file != NULL) fclose(csv_file);
+  if (json_file != NULL) {
+    fputs("\n]\n",json_file);
+    fclose(json_file);
+  }
+  free(binaries.buffer);
+  free(lengths.buffer);
+  free(error_rates.buffer);
+
+  return status;
+
+}
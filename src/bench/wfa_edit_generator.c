@@ -0,0 +1,259 @@
+/*
+ *  Wavefront Alignments Algorithms
+ *  Copyright (c) 2024 by Diego García Aranda <diego.garcia1@bsc.es>
+ *
+ *  This file is part of Wavefront Alignments Algorithms.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * PROJECT: Wavefront Alignments Algorithms
+ * AUTHOR(S): Diego García Aranda <diego.garcia1@bsc.es>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <stdbool.h>
+
+#define PRINTF(format, ...) do { printf(format, ##__VA_ARGS__); } while(0)
+#define PRINTF_ERROR(format, ...) do { fprintf(stderr, format, ##__VA_ARGS__); } while(0);
+
+#define DEFAULT_PAIRS 1000
+#define DEFAULT_LENGTH 1000
+#define DEFAULT_ERROR_RATE 0.05
+#define DEFAULT_INDEL_RATIO 0.5
+#define DEFAULT_SEED 1
+
+/*
+ * Deterministic pseudo-random generator (splitmix64)
+ *   Same seed, same pairs on every platform (unlike rand())
+ */
+typedef struct {
+  uint64_t state;
+} generator_random_t;
+
+uint64_t generator_random_next(
+    generator_random_t* const random) {
+  uint64_t z = (random->state += 0x9E3779B97F4A7C15ull);
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+  return z ^ (z >> 31);
+}
+
+// Uniform in [0,1)
+double generator_random_uniform(
+    generator_random_t* const random) {
+  return (generator_random_next(random) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+char generator_random_base(
+    generator_random_t* const random) {
+  return "ACGT"[generator_random_next(random) & 3];
+}
+
+/*
+ * Generate a pair
+ *   Random pattern, the text applies an error to each base with probability error_rate
+ *   (an indel with probability indel_ratio, half insertions and half deletions, else a mismatch)
+ *   Returns the text length (the text buffer holds up to 2*length bases)
+ */
+int generator_generate_pair(
+    generator_random_t* const random,
+    char* const pattern,
+    const int length,
+    char* const text,
+    const double error_rate,
+    const double indel_ratio) {
+  int i, text_length = 0;
+  for (i=0;i<length;++i) {
+    pattern[i] = generator_random_base(random);
+  }
+  for (i=0;i<length;++i) {
+    if (generator_random_uniform(random) >= error_rate) {
+      text[text_length++] = pattern[i];
+    }
+    else if (generator_random_uniform(random) >= indel_ratio) {
+      // Mismatch (always a different base)
+      char base;
+      do {
+        base = generator_random_base(random);
+      } while (base == pattern[i]);
+      text[text_length++] = base;
+    }
+    else if (generator_random_next(random) & 1) {
+      // Insertion (before the base)
+      text[text_length++] = generator_random_base(random);
+      text[text_length++] = pattern[i];
+    }
+    // Deletion (base skipped)
+  }
+  return text_length;
+}
+
+// Display usage information
+int usage(char* name){
+
+  PRINTF_ERROR("Usage: %s\n", name);
+  PRINTF_ERROR("Writes random pairs in the INPUT format of the aligners ('>pattern' and '<text' lines), same seed same pairs\n");
+  PRINTF_ERROR("Environment variables: \n");
+  PRINTF_ERROR("\tUSAGE: print usage information\n");
+  PRINTF_ERROR("\tOUTPUT: file to write the pairs\n");
+  PRINTF_ERROR("\tPAIRS: number of pairs, value must be between 1 and %d, default (%d) \n", INT32_MAX, DEFAULT_PAIRS);
+  PRINTF_ERROR("\tLENGTH: pattern length, value must be between 1 and %d, default (%d) \n", INT32_MAX/2, DEFAULT_LENGTH);
+  PRINTF_ERROR("\tERROR_RATE: probability of an error at each pattern base, value must be between 0 and 1, default (%.2f) \n", DEFAULT_ERROR_RATE);
+  PRINTF_ERROR("\tINDEL_RATIO: fraction of errors that are indels (the rest are mismatches), value must be between 0 and 1, default (%.2f) \n", DEFAULT_INDEL_RATIO);
+  PRINTF_ERROR("\tSEED: seed of the generator, default (%d) \n", DEFAULT_SEED);
+
+  return EXIT_FAILURE;
+
+}
+
+
+int main(int argc,char* argv[]) {
+
+  // Get program name
+  char* name = argv[0];
+
+  if(argc != 1){
+    return usage(name);
+  }
+
+
+  // --------------------------------------------------------------------------------------------------------
+  // Environment variables
+
+
+  // USAGE variable
+  const char* susage = getenv("USAGE");
+  if (susage != NULL){
+    return usage(name);
+  }
+
+
+  // String OUTPUT variable
+  const char* soutput = getenv("OUTPUT");
+  if (soutput == NULL){
+    PRINTF_ERROR("OUTPUT is not defined\n");
+    return usage(name);
+  }
+  const char* ofilename = soutput;
+
+
+  // Int PAIRS variable
+  const char* spairs = getenv("PAIRS");
+  int aux_pairs = DEFAULT_PAIRS;
+  if (spairs != NULL) {
+    int aux = atoi(spairs);
+    if (aux <= 0){
+      PRINTF_ERROR("Invalid value for PAIRS\n");
+      return usage(name);
+    }
+    aux_pairs = aux;
+  }
+  const int pairs = aux_pairs;
+
+
+  // Int LENGTH variable
+  const char* slength = getenv("LENGTH");
+  int aux_length = DEFAULT_LENGTH;
+  if (slength != NULL) {
+    int aux = atoi(slength);
+    if (aux <= 0 || aux > INT32_MAX/2){
+      PRINTF_ERROR("Invalid value for LENGTH\n");
+      return usage(name);
+    }
+    aux_length = aux;
+  }
+  const int length = aux_length;
+
+
+  // Double ERROR_RATE variable
+  const char* serror_rate = getenv("ERROR_RATE");
+  double aux_error_rate = DEFAULT_ERROR_RATE;
+  if (serror_rate != NULL) {
+    double aux = atof(serror_rate);
+    if (aux < 0.0 || aux > 1.0){
+      PRINTF_ERROR("Invalid value for ERROR_RATE\n");
+      return usage(name);
+    }
+    aux_error_rate = aux;
+  }
+  const double error_rate = aux_error_rate;
+
+
+  // Double INDEL_RATIO variable
+  const char* sindel_ratio = getenv("INDEL_RATIO");
+  double aux_indel_ratio = DEFAULT_INDEL_RATIO;
+  if (sindel_ratio != NULL) {
+    double aux = atof(sindel_ratio);
+    if (aux < 0.0 || aux > 1.0){
+      PRINTF_ERROR("Invalid value for INDEL_RATIO\n");
+      return usage(name);
+    }
+    aux_indel_ratio = aux;
+  }
+  const double indel_ratio = aux_indel_ratio;
+
+
+  // Int SEED variable
+  const char* sseed = getenv("SEED");
+  uint64_t aux_seed = DEFAULT_SEED;
+  if (sseed != NULL) {
+    aux_seed = strtoull(sseed,NULL,10);
+  }
+  const uint64_t seed = aux_seed;
+
+  // --------------------------------------------------------------------------------------------------------
+
+
+  char* const pattern = malloc(length);
+  char* const text = malloc(2*(size_t)length);
+  if (pattern == NULL || text == NULL) {
+    PRINTF_ERROR("Allocation of sequences failed\n");
+    return EXIT_FAILURE;
+  }
+  FILE* const output_file = fopen(ofilename, "w");
+  if (output_file == NULL) {
+    PRINTF_ERROR("Error while opening output file %s\n", ofilename);
+    return EXIT_FAILURE;
+  }
+
+  // Generate pairs (cells of the full DP matrices are counted for GCUPS)
+  generator_random_t random = {.state = seed};
+  long cells = 0;
+  int i;
+  for (i=0;i<pairs;++i) {
+    const int text_length = generator_generate_pair(&random,pattern,length,text,error_rate,indel_ratio);
+    cells += (long)length * text_length;
+    fputc('>',output_file);
+    fwrite(pattern,sizeof(char),length,output_file);
+    fputs("\n<",output_file);
+    fwrite(text,sizeof(char),text_length,output_file);
+    fputc('\n',output_file);
+  }
+  if (fclose(output_file) == EOF) {
+    PRINTF_ERROR("Error while writing output file %s\n", ofilename);
+    return EXIT_FAILURE;
+  }
+  free(pattern);
+  free(text);
+
+  PRINTF("Pairs: %d\n",pairs);
+  PRINTF("Cells: %ld\n",cells);
+
+  return EXIT_SUCCESS;
+
+}
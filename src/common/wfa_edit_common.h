@@ -0,0 +1,207 @@
+/*
+ *  Wavefront Alignments Algorithms
+ *  Copyright (c) 2024 by Diego García Aranda <diego.garcia1@bsc.es>
+ *
+ *  This file is part of Wavefront Alignments Algorithms.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * PROJECT: Wavefront Alignments Algorithms
+ * AUTHOR(S): Diego García Aranda <diego.garcia1@bsc.es>
+ */
+
+/*
+ * Definitions shared by the aligners of every device
+ *   Run-length CIGAR format (written by the aligners, read by CHECK and
+ *   the result writer), its helpers and the q-gram filter
+ */
+#ifndef WFA_EDIT_COMMON_H
+#define WFA_EDIT_COMMON_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#define MAX(a,b) (((a)>=(b))?(a):(b))
+#define MIN(a,b) (((a)<=(b))?(a):(b))
+#define ABS(a) (((a)>=0)?(a):-(a))
+
+#define PRINTF(format, ...) do { printf(format, ##__VA_ARGS__); } while(0)
+#define PRINTF_COND(condition,format, ...) do { if (condition) { printf(format, ##__VA_ARGS__); } } while(0)
+#define PRINTF_ERROR(format, ...) do { fprintf(stderr, format, ##__VA_ARGS__); } while(0);
+
+#define EWF_SCORE_UNALIGNED (-1) // Score of pairs above the distance budget (MAX_SCORE, or EWF_MAX_SCORE on the FPGA)
+#define FILTER_QGRAM_LENGTH 4
+#define FILTER_QGRAMS (1 << (2*FILTER_QGRAM_LENGTH))
+
+/*
+ * Run-length CIGAR (one byte per run of up to CIGAR_RUN_MAX_LENGTH operations)
+ *   Operation in the low 2 bits, length-1 in the high 6 bits
+ */
+#define CIGAR_OPS "MXID"
+#define CIGAR_OP_M 0 // Match
+#define CIGAR_OP_X 1 // Mismatch
+#define CIGAR_OP_I 2 // Insertion (text only)
+#define CIGAR_OP_D 3 // Deletion (pattern only)
+#define CIGAR_RUN_MAX_LENGTH 64
+#define CIGAR_RUN(op,length) ((char)((op) | (((length)-1) << 2)))
+#define CIGAR_RUN_OP(run) (((unsigned char)(run)) & 3)
+#define CIGAR_RUN_LENGTH(run) ((((unsigned char)(run)) >> 2) + 1)
+
+/*
+ * Compact backtrace: winning operation (CIGAR_OP_X/I/D) of every cell, 2 bits each
+ */
+#define PREDECESSORS_LENGTH(cells) (((cells)+3)/4)
+#define PREDECESSOR_GET(predecessors,idx) (((predecessors)[(idx)/4] >> (2*((idx)%4))) & 3)
+#define PREDECESSOR_SET(predecessors,idx,op) ((predecessors)[(idx)/4] = \
+    (uint8_t)(((predecessors)[(idx)/4] & ~(3 << (2*((idx)%4)))) | ((op) << (2*((idx)%4)))))
+
+/*
+ * Append operations to a CIGAR (merged into its last run)
+ *   Returns the new CIGAR length
+ */
+static inline int edit_cigar_append(
+    char* const edit_cigar,
+    int edit_cigar_length,
+    const int op,
+    int count) {
+  // Merge into the last run
+  if (edit_cigar_length > 0 && CIGAR_RUN_OP(edit_cigar[edit_cigar_length-1]) == op) {
+    const int last_length = CIGAR_RUN_LENGTH(edit_cigar[edit_cigar_length-1]);
+    const int merged = MIN(count,CIGAR_RUN_MAX_LENGTH-last_length);
+    edit_cigar[edit_cigar_length-1] = CIGAR_RUN(op,last_length+merged);
+    count -= merged;
+  }
+  // New runs
+  while (count > 0) {
+    const int length = MIN(count,CIGAR_RUN_MAX_LENGTH);
+    edit_cigar[edit_cigar_length++] = CIGAR_RUN(op,length);
+    count -= length;
+  }
+  return edit_cigar_length;
+}
+
+/*
+ * Reverse a CIGAR built backwards (forward order)
+ */
+static inline void edit_cigar_reverse(
+    char* const edit_cigar,
+    const int edit_cigar_length) {
+  int i;
+  for (i=0;i<edit_cigar_length/2;++i) {
+    const char run = edit_cigar[i];
+    edit_cigar[i] = edit_cigar[edit_cigar_length-1-i];
+    edit_cigar[edit_cigar_length-1-i] = run;
+  }
+}
+
+/*
+ * Next run of a CIGAR (consecutive runs of the same operation merged)
+ *   Returns its length, 0 past the end
+ */
+static inline int edit_cigar_next_run(
+    const char* const edit_cigar,
+    const int edit_cigar_length,
+    int* const idx,
+    char* const op) {
+  if (*idx >= edit_cigar_length) return 0;
+  const int run_op = CIGAR_RUN_OP(edit_cigar[*idx]);
+  int length = 0;
+  while (*idx < edit_cigar_length && CIGAR_RUN_OP(edit_cigar[*idx]) == run_op) {
+    length += CIGAR_RUN_LENGTH(edit_cigar[*idx]);
+    ++(*idx);
+  }
+  (*op) = CIGAR_OPS[run_op];
+  return length;
+}
+
+/*
+ * Append a CIGAR as run-length text, e.g. 12M1X3M (returns the position after it)
+ *   A text run takes at most 11 bytes (digits and operation) per CIGAR byte
+ */
+static inline char* edit_cigar_put_text(
+    char* buffer,
+    const char* const edit_cigar,
+    const int edit_cigar_length) {
+  int idx = 0, length;
+  char op;
+  while ((length = edit_cigar_next_run(edit_cigar,edit_cigar_length,&idx,&op)) > 0) {
+    char digits[10];
+    int num_digits = 0;
+    do {
+      digits[num_digits++] = '0' + (length % 10);
+      length /= 10;
+    } while (length > 0);
+    while (num_digits > 0) *(buffer++) = digits[--num_digits];
+    *(buffer++) = op;
+  }
+  return buffer;
+}
+
+/*
+ * Longest run-length CIGAR of a pair within a distance budget (bytes)
+ *   (pattern_length + insertions = text_length + deletions operations,
+ *   at most 2*distance+1 runs, one more byte every CIGAR_RUN_MAX_LENGTH operations)
+ */
+static inline int edit_wavefronts_max_cigar_length(
+    const int pattern_length,
+    const int text_length,
+    const int max_score) {
+  const int max_distance = MIN(pattern_length+text_length,max_score);
+  const int max_operations = MIN(pattern_length+text_length,MIN(pattern_length,text_length)+max_distance);
+  return MIN(max_operations,2*max_distance+1+max_operations/CIGAR_RUN_MAX_LENGTH);
+}
+
+/*
+ * Q-gram Filter (lower bound of the edit distance)
+ *   Each edit destroys at most q q-grams of a sequence, so a pair within max_score shares
+ *   at least MAX(pattern_length,text_length)-q+1-q*max_score of them. Characters map to
+ *   2 bits ((c>>1)&3, distinct for ACGT), others collide, which only adds shared q-grams.
+ *   Returns true if the pair is proven above max_score
+ */
+static inline bool edit_wavefronts_filter(
+    const char* const pattern,
+    const int pattern_length,
+    const char* const text,
+    const int text_length,
+    const int max_score) {
+  // Length difference
+  if (ABS(pattern_length-text_length) > max_score) return true;
+  const int64_t min_shared = (int64_t)MAX(pattern_length,text_length) - FILTER_QGRAM_LENGTH + 1 -
+      (int64_t)FILTER_QGRAM_LENGTH*max_score;
+  if (min_shared <= 0) return false;
+  // Q-grams of the pattern
+  int counts[FILTER_QGRAMS];
+  memset(counts,0,sizeof(counts));
+  uint32_t qgram = 0;
+  int i;
+  for (i=0;i<pattern_length;++i) {
+    qgram = ((qgram << 2) | ((pattern[i] >> 1) & 3)) & (FILTER_QGRAMS-1);
+    if (i >= FILTER_QGRAM_LENGTH-1) ++counts[qgram];
+  }
+  // Q-grams of the text shared with the pattern (stop at the bound)
+  int64_t shared = 0;
+  qgram = 0;
+  for (i=0;i<text_length && shared<min_shared;++i) {
+    qgram = ((qgram << 2) | ((text[i] >> 1) & 3)) & (FILTER_QGRAMS-1);
+    if (i >= FILTER_QGRAM_LENGTH-1 && counts[qgram] > 0) {
+      --counts[qgram];
+      ++shared;
+    }
+  }
+  return shared < min_shared;
+}
+
+#endif // WFA_EDIT_COMMON_H
@@ -0,0 +1,1133 @@
+/*
+ *  Wavefront Alignments Algorithms
+ *  Copyright (c) 2024 by Diego García Aranda <diego.garcia1@bsc.es>
+ *
+ *  This file is part of Wavefront Alignments Algorithms.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * PROJECT: Wavefront Alignments Algorithms
+ * AUTHOR(S): Diego García Aranda <diego.garcia1@bsc.es>
+ */
+
+#define _GNU_SOURCE // fopencookie (compressed input)
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <stdbool.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <zlib.h>
+
+#include "wfa_edit_common.h"
+#include "wfa_edit_io.h"
+
+#define INFLATE_RING_BLOCKS 32 // Inflated blocks buffered ahead of the reader
+#define INFLATE_BLOCK_LENGTH (1<<16) // Bytes (a BGZF block inflates to at most 64KiB)
+#define BGZF_HEADER_LENGTH 12
+#define BGZF_BLOCK_MAX_LENGTH (1<<16)
+#define RESULT_BUFFER_LENGTH (1<<22) // Bytes (two buffers, one is filled while the other is written)
+#define RESULT_MAX_FIELDS_LENGTH 256 // Bytes of a result besides its CIGAR
+#define RESULT_BINARY_MAGIC "EWF1"
+
+/*
+ * Compressed input (gzip)
+ *   Helper threads inflate the file ahead of the reader into a ring of blocks
+ *   that it consumes in order, so the uncompressed input is never held whole.
+ *   BGZF blocks are independent and inflated in parallel (one per thread),
+ *   other gzip files (or a piped input) are inflated by a single helper thread
+ */
+typedef enum {
+  INFLATE_BLOCK_FREE,
+  INFLATE_BLOCK_CLAIMED,       // Being read and inflated by a helper thread
+  INFLATE_BLOCK_READY,
+} inflate_block_state_t;
+
+typedef struct {
+  inflate_block_state_t state;
+  unsigned char* compressed;   // Compressed block (BGZF)
+  unsigned char* data;         // Inflated data
+  size_t length;
+} inflate_block_t;
+
+typedef struct {
+  FILE* file;                  // Compressed file
+  bool bgzf;
+  // Stream state (single helper thread, not BGZF)
+  z_stream stream;
+  unsigned char* stream_buffer;
+  // Helper threads
+  pthread_t threads[INFLATE_MAX_THREADS];
+  int num_threads;
+  int num_started;
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;         // A block was claimed, filled or released
+  // Ring of blocks (block i in slot i%INFLATE_RING_BLOCKS)
+  inflate_block_t blocks[INFLATE_RING_BLOCKS];
+  uint64_t next_block;         // Next block to read from the file
+  uint64_t current_block;      // Block being consumed
+  size_t current_position;
+  int64_t position;            // Inflated bytes consumed
+  bool end;                    // The whole file is read
+  bool error;
+  bool stop;
+} sequence_inflater_t;
+
+/*
+ * Read the next BGZF block (gzip member with its size in a 'BC' extra subfield)
+ *   Returns 1 if a block was read, 0 at the end of the file, -1 if malformed
+ */
+int sequence_inflater_read_bgzf(
+    FILE* const file,
+    unsigned char* const block,
+    size_t* const length) {
+  const size_t header_length = fread(block,1,BGZF_HEADER_LENGTH,file);
+  if (header_length == 0 && feof(file)) return 0;
+  if (header_length != BGZF_HEADER_LENGTH || block[0] != 0x1f || block[1] != 0x8b || block[2] != 8 || !(block[3] & 4)) return -1;
+  const size_t extra_length = block[10] | (block[11] << 8);
+  if (BGZF_HEADER_LENGTH+extra_length > BGZF_BLOCK_MAX_LENGTH ||
+      fread(block+BGZF_HEADER_LENGTH,1,extra_length,file) != extra_length) return -1;
+  // Find the block size subfield
+  size_t block_length = 0, i = BGZF_HEADER_LENGTH;
+  while (i+4 <= BGZF_HEADER_LENGTH+extra_length) {
+    const size_t subfield_length = block[i+2] | (block[i+3] << 8);
+    if (block[i] == 'B' && block[i+1] == 'C' && subfield_length == 2 && i+6 <= BGZF_HEADER_LENGTH+extra_length) {
+      block_length = (block[i+4] | (block[i+5] << 8)) + 1;
+    }
+    i += 4 + subfield_length;
+  }
+  // Read the rest of the block (compressed data, CRC32 and inflated size)
+  const size_t data_start = BGZF_HEADER_LENGTH+extra_length;
+  if (block_length < data_start+8 || block_length > BGZF_BLOCK_MAX_LENGTH ||
+      fread(block+data_start,1,block_length-data_start,file) != block_length-data_start) return -1;
+  *length = block_length;
+  return 1;
+}
+
+/*
+ * Inflate a BGZF block (the stream is reset, so each thread reuses its own)
+ *   Returns 1 if inflated, -1 if corrupt
+ */
+int sequence_inflater_inflate_bgzf(
+    z_stream* const stream,
+    inflate_block_t* const block,
+    const size_t length) {
+  const unsigned char* const compressed = block->compressed;
+  const size_t data_start = BGZF_HEADER_LENGTH + (compressed[10] | (compressed[11] << 8));
+  const unsigned char* const trailer = compressed + length - 8;
+  const uint32_t crc = trailer[0] | (trailer[1] << 8) | (trailer[2] << 16) | ((uint32_t)trailer[3] << 24);
+  const uint32_t inflated_length = trailer[4] | (trailer[5] << 8) | (trailer[6] << 16) | ((uint32_t)trailer[7] << 24);
+  if (inflated_length > INFLATE_BLOCK_LENGTH || inflateReset(stream) != Z_OK) return -1;
+  stream->next_in = (unsigned char*) compressed + data_start;
+  stream->avail_in = length - data_start - 8;
+  stream->next_out = block->data;
+  stream->avail_out = INFLATE_BLOCK_LENGTH;
+  const int status = inflate(stream,Z_FINISH);
+  block->length = INFLATE_BLOCK_LENGTH - stream->avail_out;
+  if (status != Z_STREAM_END || block->length != inflated_length ||
+      crc32(0,block->data,block->length) != crc) return -1;
+  return 1;
+}
+
+/*
+ * Inflate the next chunk of a gzip stream (concatenated members go on)
+ *   Returns 1 if some data was inflated, 0 at the end of the file, -1 if corrupt or truncated
+ */
+int sequence_inflater_inflate_stream(
+    sequence_inflater_t* const inflater,
+    inflate_block_t* const block) {
+  z_stream* const stream = &inflater->stream;
+  stream->next_out = block->data;
+  stream->avail_out = INFLATE_BLOCK_LENGTH;
+  while (stream->avail_out > 0) {
+    if (stream->avail_in == 0) {
+      const size_t length = fread(inflater->stream_buffer,1,INFLATE_BLOCK_LENGTH,inflater->file);
+      if (length == 0) {
+        // Members must be complete
+        if (ferror(inflater->file) || stream->total_in > 0) return -1;
+        break;
+      }
+      stream->next_in = inflater->stream_buffer;
+      stream->avail_in = length;
+    }
+    const int status = inflate(stream,Z_NO_FLUSH);
+    if (status == Z_STREAM_END) {
+      if (inflateReset(stream) != Z_OK) return -1;
+    }
+    else if (status != Z_OK && !(status == Z_BUF_ERROR && stream->avail_in == 0)) {
+      return -1;
+    }
+  }
+  block->length = INFLATE_BLOCK_LENGTH - stream->avail_out;
+  return (block->length > 0) ? 1 : 0;
+}
+
+/*
+ * Helper thread
+ *   Claims the next block while the ring has a free slot for it, reads it (in
+ *   file order, with the lock held) and inflates it (without the lock)
+ */
+void* sequence_inflater_thread(
+    void* const arg) {
+  sequence_inflater_t* const inflater = (sequence_inflater_t*) arg;
+  z_stream stream;
+  memset(&stream,0,sizeof(stream));
+  const bool stream_ready = !inflater->bgzf || inflateInit2(&stream,-MAX_WBITS) == Z_OK;
+  pthread_mutex_lock(&inflater->mutex);
+  inflater->error |= !stream_ready;
+  while (true) {
+    // Wait for the slot of the next block
+    inflate_block_t* block = inflater->blocks + (inflater->next_block % INFLATE_RING_BLOCKS);
+    while (!inflater->stop && !inflater->end && !inflater->error && block->state != INFLATE_BLOCK_FREE) {
+      pthread_cond_wait(&inflater->cond,&inflater->mutex);
+      block = inflater->blocks + (inflater->next_block % INFLATE_RING_BLOCKS);
+    }
+    if (inflater->stop || inflater->end || inflater->error) break;
+    block->state = INFLATE_BLOCK_CLAIMED;
+    ++(inflater->next_block);
+    // Read the block
+    size_t length = 0;
+    int status = 1;
+    if (inflater->bgzf) {
+      status = sequence_inflater_read_bgzf(inflater->file,block->compressed,&length);
+      if (status <= 0) {
+        block->state = INFLATE_BLOCK_FREE;
+        --(inflater->next_block);
+        inflater->end = (status == 0);
+        inflater->error = (status < 0);
+        pthread_cond_broadcast(&inflater->cond);
+        break;
+      }
+    }
+    // Inflate it
+    pthread_mutex_unlock(&inflater->mutex);
+    status = inflater->bgzf ?
+        sequence_inflater_inflate_bgzf(&stream,block,length) :
+        sequence_inflater_inflate_stream(inflater,block);
+    pthread_mutex_lock(&inflater->mutex);
+    if (status > 0) {
+      block->state = INFLATE_BLOCK_READY;
+    }
+    else {
+      // End of a stream (the last block claimed) or corrupt input
+      block->state = INFLATE_BLOCK_FREE;
+      --(inflater->next_block);
+      inflater->end = (status == 0);
+      inflater->error = (status < 0);
+    }
+    pthread_cond_broadcast(&inflater->cond);
+  }
+  if (inflater->error) pthread_cond_broadcast(&inflater->cond);
+  pthread_mutex_unlock(&inflater->mutex);
+  if (inflater->bgzf && stream_ready) inflateEnd(&stream);
+  return NULL;
+}
+
+/*
+ * Start (or restart) inflating the file from its current position
+ */
+int sequence_inflater_start(
+    sequence_inflater_t* const inflater) {
+  int i;
+  for (i=0;i<INFLATE_RING_BLOCKS;++i) {
+    inflater->blocks[i].state = INFLATE_BLOCK_FREE;
+  }
+  inflater->next_block = 0;
+  inflater->current_block = 0;
+  inflater->current_position = 0;
+  inflater->position = 0;
+  inflater->end = false;
+  inflater->error = false;
+  inflater->stop = false;
+  if (!inflater->bgzf) {
+    inflater->stream.avail_in = 0;
+    if (inflateReset(&inflater->stream) != Z_OK) return EXIT_FAILURE;
+  }
+  // Only BGZF blocks can be inflated in parallel
+  const int num_threads = inflater->bgzf ? inflater->num_threads : 1;
+  for (inflater->num_started=0;inflater->num_started<num_threads;++(inflater->num_started)) {
+    if (pthread_create(inflater->threads+inflater->num_started,NULL,sequence_inflater_thread,inflater) != 0) {
+      PRINTF_ERROR("Creation of inflate threads failed\n");
+      return EXIT_FAILURE;
+    }
+  }
+  return EXIT_SUCCESS;
+}
+
+void sequence_inflater_stop(
+    sequence_inflater_t* const inflater) {
+  pthread_mutex_lock(&inflater->mutex);
+  inflater->stop = true;
+  pthread_cond_broadcast(&inflater->cond);
+  pthread_mutex_unlock(&inflater->mutex);
+  int i;
+  for (i=0;i<inflater->num_started;++i) {
+    pthread_join(inflater->threads[i],NULL);
+  }
+  inflater->num_started = 0;
+}
+
+/*
+ * Stream functions (the reader gets the inflated file as a FILE*)
+ */
+ssize_t sequence_inflater_read(
+    void* const cookie,
+    char* const buffer,
+    const size_t size) {
+  sequence_inflater_t* const inflater = (sequence_inflater_t*) cookie;
+  size_t copied = 0;
+  pthread_mutex_lock(&inflater->mutex);
+  while (copied < size) {
+    // Wait for the current block
+    inflate_block_t* const block = inflater->blocks + (inflater->current_block % INFLATE_RING_BLOCKS);
+    while (block->state != INFLATE_BLOCK_READY && !inflater->error &&
+        !(inflater->end && inflater->current_block == inflater->next_block)) {
+      pthread_cond_wait(&inflater->cond,&inflater->mutex);
+    }
+    if (block->state != INFLATE_BLOCK_READY) {
+      if (inflater->error && copied == 0) {
+        pthread_mutex_unlock(&inflater->mutex);
+        PRINTF_ERROR("Error while inflating input file (corrupt or truncated gzip data)\n");
+        return -1;
+      }
+      break;
+    }
+    // Copy from it (not refilled until it is released)
+    pthread_mutex_unlock(&inflater->mutex);
+    const size_t length = MIN(size-copied,block->length-inflater->current_position);
+    memcpy(buffer+copied,block->data+inflater->current_position,length);
+    copied += length;
+    inflater->current_position += length;
+    pthread_mutex_lock(&inflater->mutex);
+    // Release it
+    if (inflater->current_position == block->length) {
+      block->state = INFLATE_BLOCK_FREE;
+      ++(inflater->current_block);
+      inflater->current_position = 0;
+      pthread_cond_broadcast(&inflater->cond);
+    }
+  }
+  pthread_mutex_unlock(&inflater->mutex);
+  inflater->position += copied;
+  return copied;
+}
+
+/*
+ * Only rewinding is supported (reps read the input again)
+ */
+int sequence_inflater_seek(
+    void* const cookie,
+    off64_t* const offset,
+    const int whence) {
+  sequence_inflater_t* const inflater = (sequence_inflater_t*) cookie;
+  if (whence == SEEK_CUR && *offset == 0) {
+    *offset = inflater->position;
+    return 0;
+  }
+  if (whence != SEEK_SET || *offset != 0) return -1;
+  sequence_inflater_stop(inflater);
+  if (fseek(inflater->file,0,SEEK_SET) != 0) return -1;
+  return sequence_inflater_start(inflater) ? -1 : 0;
+}
+
+int sequence_inflater_close(
+    void* const cookie) {
+  sequence_inflater_t* const inflater = (sequence_inflater_t*) cookie;
+  sequence_inflater_stop(inflater);
+  int i;
+  for (i=0;i<INFLATE_RING_BLOCKS;++i) {
+    free(inflater->blocks[i].compressed);
+    free(inflater->blocks[i].data);
+  }
+  if (!inflater->bgzf) inflateEnd(&inflater->stream);
+  free(inflater->stream_buffer);
+  pthread_mutex_destroy(&inflater->mutex);
+  pthread_cond_destroy(&inflater->cond);
+  const int status = fclose(inflater->file);
+  free(inflater);
+  return status;
+}
+
+/*
+ * Open a gzip file as a stream of its inflated data
+ *   Returns the file unchanged if it is not gzip (first byte), NULL on error
+ *   BGZF is detected on regular files (its first header is read and the file rewound)
+ */
+FILE* sequence_inflater_open(
+    FILE* const file,
+    const int num_threads,
+    bool* const compressed,
+    bool* const bgzf) {
+  *compressed = false;
+  *bgzf = false;
+  const int first = getc(file);
+  if (first == EOF) return file;
+  ungetc(first,file);
+  if (first != 0x1f) return file;
+  *compressed = true;
+  // Detect BGZF
+  struct stat file_stat;
+  if (fstat(fileno(file),&file_stat) == 0 && S_ISREG(file_stat.st_mode)) {
+    unsigned char header[BGZF_HEADER_LENGTH+6];
+    *bgzf = fread(header,1,sizeof(header),file) == sizeof(header) &&
+        header[1] == 0x8b && (header[3] & 4) && header[12] == 'B' && header[13] == 'C';
+    if (fseek(file,0,SEEK_SET) != 0) {
+      PRINTF_ERROR("Error while rewinding input file\n");
+      return NULL;
+    }
+  }
+  // Allocate the ring
+  sequence_inflater_t* const inflater = calloc(1,sizeof(sequence_inflater_t));
+  if (inflater == NULL) {
+    PRINTF_ERROR("Allocation of inflater failed\n");
+    return NULL;
+  }
+  inflater->file = file;
+  inflater->bgzf = *bgzf;
+  inflater->num_threads = num_threads;
+  pthread_mutex_init(&inflater->mutex,NULL);
+  pthread_cond_init(&inflater->cond,NULL);
+  bool allocated = true;
+  int i;
+  for (i=0;i<INFLATE_RING_BLOCKS;++i) {
+    inflater->blocks[i].data = malloc(INFLATE_BLOCK_LENGTH);
+    if (inflater->bgzf) inflater->blocks[i].compressed = malloc(BGZF_BLOCK_MAX_LENGTH);
+    allocated &= inflater->blocks[i].data != NULL && (!inflater->bgzf || inflater->blocks[i].compressed != NULL);
+  }
+  if (!inflater->bgzf) {
+    inflater->stream_buffer = malloc(INFLATE_BLOCK_LENGTH);
+    allocated &= inflater->stream_buffer != NULL && inflateInit2(&inflater->stream,MAX_WBITS+16) == Z_OK;
+  }
+  cookie_io_functions_t functions = {
+      .read = sequence_inflater_read,
+      .write = NULL,
+      .seek = sequence_inflater_seek,
+      .close = sequence_inflater_close };
+  FILE* const stream = allocated ? fopencookie(inflater,"r",functions) : NULL;
+  if (stream == NULL) {
+    PRINTF_ERROR("Allocation of inflater failed\n");
+    return NULL;
+  }
+  if (sequence_inflater_start(inflater)) {
+    fclose(stream);
+    return NULL;
+  }
+  return stream;
+}
+
+/*
+ * Map a regular file (readable padding around it, as for the batch sequences)
+ *   Returns false if it cannot be mapped (it is read by lines)
+ */
+bool sequence_reader_map(
+    sequence_reader_t* const reader) {
+  struct stat file_stat;
+  const int fd = fileno(reader->file);
+  if (fstat(fd,&file_stat) != 0 || !S_ISREG(file_stat.st_mode) || file_stat.st_size == 0) return false;
+  // Reserve the padding pages and the file pages
+  const size_t page_size = reader->page_size;
+  const size_t length = file_stat.st_size;
+  const size_t mem_length = page_size + ((length + page_size - 1) / page_size) * page_size + page_size;
+  char* const mem = mmap(NULL,mem_length,PROT_READ,MAP_PRIVATE|MAP_ANONYMOUS,-1,0);
+  if (mem == MAP_FAILED) return false;
+  // Map the file over the reservation (after the front padding page)
+  if (mmap(mem+page_size,length,PROT_READ,MAP_PRIVATE|MAP_FIXED,fd,0) == MAP_FAILED) {
+    munmap(mem,mem_length);
+    return false;
+  }
+  madvise(mem+page_size,length,MADV_SEQUENTIAL);
+  reader->map_mem = mem;
+  reader->map_mem_length = mem_length;
+  reader->map = mem + page_size;
+  reader->map_length = length;
+  reader->map_position = 0;
+  reader->map_released = 0;
+  return true;
+}
+
+int sequence_reader_open(
+    sequence_reader_t* const reader,
+    const char* const filename,
+    const int num_threads) {
+  FILE* const file = fopen(filename, "r");
+  if (file == NULL) {
+    PRINTF_ERROR("Error while opening input file %s\n", filename);
+    return EXIT_FAILURE;
+  }
+  reader->file = sequence_inflater_open(file,num_threads,&reader->compressed,&reader->bgzf);
+  if (reader->file == NULL) return EXIT_FAILURE;
+  reader->num_threads = reader->bgzf ? num_threads : 1;
+  reader->page_size = sysconf(_SC_PAGESIZE);
+  reader->map_mem = NULL;
+  reader->map = NULL;
+  if (!reader->compressed) sequence_reader_map(reader);
+  reader->pattern_line = NULL;
+  reader->pattern_line_size = 0;
+  reader->text_line = NULL;
+  reader->text_line_size = 0;
+  reader->num_pairs = 0;
+  return EXIT_SUCCESS;
+}
+
+/*
+ * Release the mapped pages before a file position (pairs before it are no longer used)
+ *   Keeps the resident memory flat however large the file is (pages are read again if needed)
+ */
+void sequence_reader_release(
+    sequence_reader_t* const reader,
+    const size_t position) {
+  if (reader->map == NULL) return;
+  const size_t released = (position / reader->page_size) * reader->page_size;
+  if (released <= reader->map_released) return;
+  madvise((char*)reader->map+reader->map_released,released-reader->map_released,MADV_DONTNEED);
+  reader->map_released = released;
+}
+
+void sequence_reader_rewind(
+    sequence_reader_t* const reader) {
+  if (reader->map != NULL) {
+    reader->map_position = 0;
+    reader->map_released = 0;
+  }
+  else {
+    rewind(reader->file);
+  }
+  reader->num_pairs = 0;
+}
+
+void sequence_reader_close(
+    sequence_reader_t* const reader) {
+  if (reader->map != NULL) munmap(reader->map_mem,reader->map_mem_length);
+  fclose(reader->file);
+  free(reader->pattern_line);
+  free(reader->text_line);
+}
+
+int sequence_reader_read_line(
+    FILE* const file,
+    char** const line,
+    size_t* const line_size,
+    const char tag) {
+  // Read next line
+  ssize_t length = getline(line,line_size,file);
+  if (length == -1) return ferror(file) ? -2 : -1;
+  // Strip end of line
+  while (length > 0 && ((*line)[length-1] == '\n' || (*line)[length-1] == '\r')) {
+    (*line)[--length] = '\0';
+  }
+  // Check tag
+  if (length == 0 || (*line)[0] != tag || length-1 > INT32_MAX) return -2;
+  return (int) length - 1;
+}
+
+/*
+ * Next line of the mapped file (without its end of line)
+ *   Returns its length (without the tag), -1 at the end of the file, -2 if malformed
+ */
+int sequence_reader_map_line(
+    sequence_reader_t* const reader,
+    const char** const line,
+    const char tag) {
+  if (reader->map_position >= reader->map_length) return -1;
+  // Find end of line
+  const char* const start = reader->map + reader->map_position;
+  const size_t left = reader->map_length - reader->map_position;
+  const char* const end = memchr(start,'\n',left);
+  size_t length = (end != NULL) ? (size_t)(end - start) : left;
+  reader->map_position += length + (end != NULL);
+  // Strip end of line
+  while (length > 0 && start[length-1] == '\r') --length;
+  // Check tag
+  if (length == 0 || start[0] != tag || length-1 > INT32_MAX) return -2;
+  *line = start;
+  return (int) length - 1;
+}
+
+/*
+ * Read next pair
+ *   Returns 1 if a pair was read, 0 at the end of input, -1 on error
+ *   Mapped pairs stay valid until the reader is closed, the others until the next pair
+ */
+int sequence_reader_read_pair(
+    sequence_reader_t* const reader,
+    const char** const pattern,
+    int* const pattern_length,
+    const char** const text,
+    int* const text_length) {
+  int plength, tlength;
+  const char* pattern_line;
+  const char* text_line;
+  if (reader->map != NULL) {
+    // Slice pattern and text
+    plength = sequence_reader_map_line(reader,&pattern_line,'>');
+    if (plength == -1) return 0;
+    tlength = sequence_reader_map_line(reader,&text_line,'<');
+  }
+  else {
+    // Read pattern
+    plength = sequence_reader_read_line(reader->file,
+        &reader->pattern_line,&reader->pattern_line_size,'>');
+    if (plength == -1) return 0;
+    // Read text
+    tlength = sequence_reader_read_line(reader->file,
+        &reader->text_line,&reader->text_line_size,'<');
+    pattern_line = reader->pattern_line;
+    text_line = reader->text_line;
+  }
+  if (plength < 0 || tlength < 0) {
+    PRINTF_ERROR("Malformed input pair %d (expected '>pattern' and '<text' lines)\n",reader->num_pairs);
+    return -1;
+  }
+  // Return pair (skip tags)
+  *pattern = pattern_line + 1;
+  *pattern_length = plength;
+  *text = text_line + 1;
+  *text_length = tlength;
+  ++(reader->num_pairs);
+  return 1;
+}
+
+void* result_writer_thread(
+    void* const arg) {
+  result_writer_t* const writer = (result_writer_t*) arg;
+  pthread_mutex_lock(&writer->mutex);
+  while (true) {
+    while (!writer->stop && writer->pending_length == 0) {
+      pthread_cond_wait(&writer->cond,&writer->mutex);
+    }
+    if (writer->pending_length == 0) break;
+    // Write the pending buffer (it is not touched until it is written)
+    pthread_mutex_unlock(&writer->mutex);
+    const bool written = fwrite(writer->pending,1,writer->pending_length,writer->file) == writer->pending_length;
+    pthread_mutex_lock(&writer->mutex);
+    writer->error |= !written;
+    writer->pending_length = 0;
+    pthread_cond_broadcast(&writer->cond);
+  }
+  pthread_mutex_unlock(&writer->mutex);
+  return NULL;
+}
+
+/*
+ * Hand the filled buffer over to the writer thread (after the previous one is written)
+ */
+int result_writer_flush(
+    result_writer_t* const writer) {
+  if (writer->length == 0) return EXIT_SUCCESS;
+  pthread_mutex_lock(&writer->mutex);
+  while (writer->pending_length > 0) {
+    pthread_cond_wait(&writer->cond,&writer->mutex);
+  }
+  const bool error = writer->error;
+  // Swap buffers
+  char* const pending = writer->pending;
+  const size_t pending_capacity = writer->pending_capacity;
+  writer->pending = writer->buffer;
+  writer->pending_length = writer->length;
+  writer->pending_capacity = writer->capacity;
+  writer->buffer = pending;
+  writer->capacity = pending_capacity;
+  writer->length = 0;
+  pthread_cond_broadcast(&writer->cond);
+  pthread_mutex_unlock(&writer->mutex);
+  if (error) {
+    PRINTF_ERROR("Error while writing result file\n");
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
+
+/*
+ * Make room for a record of up to length bytes
+ */
+int result_writer_reserve(
+    result_writer_t* const writer,
+    const size_t length) {
+  if (writer->length+length <= writer->capacity) return EXIT_SUCCESS;
+  if (result_writer_flush(writer)) return EXIT_FAILURE;
+  if (length <= writer->capacity) return EXIT_SUCCESS;
+  // Records longer than a buffer grow it
+  char* const buffer = realloc(writer->buffer,length);
+  if (buffer == NULL) {
+    PRINTF_ERROR("Allocation of result buffer failed\n");
+    return EXIT_FAILURE;
+  }
+  writer->buffer = buffer;
+  writer->capacity = length;
+  return EXIT_SUCCESS;
+}
+
+int result_writer_open(
+    result_writer_t* const writer,
+    const char* const filename,
+    const result_format_t format) {
+  writer->file = fopen(filename, "w");
+  if (writer->file == NULL) {
+    PRINTF_ERROR("Error while opening result file %s\n", filename);
+    return EXIT_FAILURE;
+  }
+  writer->format = format;
+  writer->num_results = 0;
+  writer->buffer = malloc(RESULT_BUFFER_LENGTH);
+  writer->length = 0;
+  writer->capacity = RESULT_BUFFER_LENGTH;
+  writer->pending = malloc(RESULT_BUFFER_LENGTH);
+  writer->pending_length = 0;
+  writer->pending_capacity = RESULT_BUFFER_LENGTH;
+  writer->stop = false;
+  writer->error = false;
+  if (writer->buffer == NULL || writer->pending == NULL) {
+    PRINTF_ERROR("Allocation of result buffers failed\n");
+    return EXIT_FAILURE;
+  }
+  pthread_mutex_init(&writer->mutex,NULL);
+  pthread_cond_init(&writer->cond,NULL);
+  if (pthread_create(&writer->thread,NULL,result_writer_thread,writer) != 0) {
+    PRINTF_ERROR("Creation of result writer thread failed\n");
+    return EXIT_FAILURE;
+  }
+  // Binary header
+  if (format == RESULT_FORMAT_BINARY) {
+    memcpy(writer->buffer,RESULT_BINARY_MAGIC,4);
+    writer->length = 4;
+  }
+  return EXIT_SUCCESS;
+}
+
+/*
+ * Flush the results, stop the writer thread and close the file
+ */
+int result_writer_close(
+    result_writer_t* const writer) {
+  int status = result_writer_flush(writer);
+  pthread_mutex_lock(&writer->mutex);
+  writer->stop = true;
+  pthread_cond_broadcast(&writer->cond);
+  pthread_mutex_unlock(&writer->mutex);
+  pthread_join(writer->thread,NULL);
+  const bool closed = (fclose(writer->file) == 0);
+  if (writer->error || !closed) {
+    if (status == EXIT_SUCCESS) PRINTF_ERROR("Error while writing result file\n");
+    status = EXIT_FAILURE;
+  }
+  pthread_mutex_destroy(&writer->mutex);
+  pthread_cond_destroy(&writer->cond);
+  free(writer->buffer);
+  free(writer->pending);
+  return status;
+}
+
+/*
+ * Append a decimal integer (returns the position after it)
+ */
+char* result_writer_put_int(
+    char* buffer,
+    const long value) {
+  char digits[24];
+  unsigned long magnitude = (value < 0) ? -(unsigned long)value : (unsigned long)value;
+  int num_digits = 0;
+  do {
+    digits[num_digits++] = '0' + (magnitude % 10);
+    magnitude /= 10;
+  } while (magnitude > 0);
+  if (value < 0) *(buffer++) = '-';
+  while (num_digits > 0) *(buffer++) = digits[--num_digits];
+  return buffer;
+}
+
+char* result_writer_put_uint32(
+    char* const buffer,
+    const uint32_t value) {
+  buffer[0] = (char)(value & 0xff);
+  buffer[1] = (char)((value >> 8) & 0xff);
+  buffer[2] = (char)((value >> 16) & 0xff);
+  buffer[3] = (char)((value >> 24) & 0xff);
+  return buffer + 4;
+}
+
+/*
+ * Write the result of the next pair
+ */
+int result_writer_write(
+    result_writer_t* const writer,
+    const char* const cigar,
+    const int cigar_length,
+    const int score,
+    const int pattern_length,
+    const int text_length) {
+  // A text CIGAR run takes at most 11 bytes (digits and operation) per CIGAR byte
+  const size_t max_length = RESULT_MAX_FIELDS_LENGTH + 11*(size_t)cigar_length;
+  if (result_writer_reserve(writer,max_length)) return EXIT_FAILURE;
+  char* buffer = writer->buffer + writer->length;
+  switch (writer->format) {
+    case RESULT_FORMAT_TEXT:
+      buffer = result_writer_put_int(buffer,score);
+      *(buffer++) = '\n';
+      buffer = edit_cigar_put_text(buffer,cigar,cigar_length);
+      *(buffer++) = '\n';
+      break;
+    case RESULT_FORMAT_PAF: {
+      // Matching bases and alignment length
+      const bool aligned = (score != EWF_SCORE_UNALIGNED);
+      long num_matches = 0, alignment_length = 0;
+      int i;
+      for (i=0;i<cigar_length;++i) {
+        num_matches += (CIGAR_RUN_OP(cigar[i]) == CIGAR_OP_M) ? CIGAR_RUN_LENGTH(cigar[i]) : 0;
+        alignment_length += CIGAR_RUN_LENGTH(cigar[i]);
+      }
+      buffer = result_writer_put_int(buffer,writer->num_results);
+      *(buffer++) = '\t';
+      buffer = result_writer_put_int(buffer,text_length);
+      *(buffer++) = '\t';
+      *(buffer++) = '0';
+      *(buffer++) = '\t';
+      buffer = result_writer_put_int(buffer,aligned ? text_length : 0);
+      *(buffer++) = '\t';
+      *(buffer++) = '+';
+      *(buffer++) = '\t';
+      buffer = result_writer_put_int(buffer,writer->num_results);
+      *(buffer++) = '\t';
+      buffer = result_writer_put_int(buffer,pattern_length);
+      *(buffer++) = '\t';
+      *(buffer++) = '0';
+      *(buffer++) = '\t';
+      buffer = result_writer_put_int(buffer,aligned ? pattern_length : 0);
+      *(buffer++) = '\t';
+      buffer = result_writer_put_int(buffer,num_matches);
+      *(buffer++) = '\t';
+      buffer = result_writer_put_int(buffer,alignment_length);
+      *(buffer++) = '\t';
+      buffer = result_writer_put_int(buffer,aligned ? 255 : 0);
+      memcpy(buffer,"\tNM:i:",6);
+      buffer = result_writer_put_int(buffer+6,score);
+      if (cigar_length > 0) {
+        memcpy(buffer,"\tcg:Z:",6);
+        buffer = edit_cigar_put_text(buffer+6,cigar,cigar_length);
+      }
+      *(buffer++) = '\n';
+      break;
+    }
+    case RESULT_FORMAT_BINARY:
+      buffer = result_writer_put_uint32(buffer,(uint32_t)score);
+      buffer = result_writer_put_uint32(buffer,(uint32_t)cigar_length);
+      if (cigar_length > 0) memcpy(buffer,cigar,cigar_length);
+      buffer += cigar_length;
+      break;
+  }
+  writer->length = buffer - writer->buffer;
+  ++(writer->num_results);
+  return EXIT_SUCCESS;
+}
+
+/*
+ * Parse a reference score (the mapping has no terminator, so it stops at end)
+ *   Returns the position after it, NULL if there is none or it is out of range
+ */
+const char* check_reference_parse_score(
+    const char* position,
+    const char* const end,
+    int* const score) {
+  while (position < end && (*position == ' ' || *position == '\t')) ++position;
+  const bool negative = (position < end && *position == '-');
+  if (position < end && (*position == '-' || *position == '+')) ++position;
+  const char* const digits = position;
+  int64_t value = 0;
+  while (position < end && *position >= '0' && *position <= '9') {
+    value = 10*value + (*(position++)-'0');
+    if (value > INT32_MAX) return NULL;
+  }
+  if (position == digits) return NULL;
+  value = negative ? -value : value;
+  if (value < EWF_SCORE_UNALIGNED) return NULL;
+  *score = value;
+  return position;
+}
+
+int check_references_load(
+    check_references_t* const references,
+    const char* const filename,
+    const bool strict) {
+  references->strict = strict;
+  references->map = NULL;
+  references->map_length = 0;
+  references->num_pairs = 0;
+  references->scores = NULL;
+  references->cigars = NULL;
+  references->cigar_lengths = NULL;
+  // Map the file
+  const int fd = open(filename,O_RDONLY);
+  struct stat file_stat;
+  if (fd < 0 || fstat(fd,&file_stat) != 0) {
+    PRINTF_ERROR("Error while opening check file %s\n", filename);
+    if (fd >= 0) close(fd);
+    return EXIT_FAILURE;
+  }
+  const size_t length = file_stat.st_size;
+  if (length > 0) {
+    char* const map = mmap(NULL,length,PROT_READ,MAP_PRIVATE,fd,0);
+    if (map == MAP_FAILED) {
+      PRINTF_ERROR("Error while mapping check file %s\n", filename);
+      close(fd);
+      return EXIT_FAILURE;
+    }
+    madvise(map,length,MADV_SEQUENTIAL);
+    references->map = map;
+    references->map_length = length;
+  }
+  close(fd);
+  // Count the pairs (a score line and a CIGAR line each)
+  size_t num_lines = 0, position = 0;
+  while (position < length) {
+    const char* const end = memchr(references->map+position,'\n',length-position);
+    position = (end != NULL) ? (size_t)(end-references->map)+1 : length;
+    ++num_lines;
+  }
+  const int max_pairs = (num_lines+1)/2;
+  references->scores = malloc(MAX(max_pairs,1)*sizeof(int));
+  references->cigars = malloc(MAX(max_pairs,1)*sizeof(const char*));
+  references->cigar_lengths = malloc(MAX(max_pairs,1)*sizeof(int));
+  if (references->scores == NULL || references->cigars == NULL || references->cigar_lengths == NULL) {
+    PRINTF_ERROR("Allocation of check references failed\n");
+    return EXIT_FAILURE;
+  }
+  // Index them
+  position = 0;
+  while (position < length) {
+    const int pair = references->num_pairs;
+    // Score
+    if (check_reference_parse_score(references->map+position,references->map+length,&references->scores[pair]) == NULL) {
+      PRINTF_ERROR("Error while reading reference score %d in check file\n", pair);
+      return EXIT_FAILURE;
+    }
+    const char* end = memchr(references->map+position,'\n',length-position);
+    position = (end != NULL) ? (size_t)(end-references->map)+1 : length;
+    // CIGAR (empty if missing)
+    end = (position < length) ? memchr(references->map+position,'\n',length-position) : NULL;
+    size_t cigar_length = ((end != NULL) ? (size_t)(end-references->map) : length) - position;
+    references->cigars[pair] = references->map + position;
+    position += cigar_length + (end != NULL);
+    while (cigar_length > 0 && references->cigars[pair][cigar_length-1] == '\r') --cigar_length;
+    references->cigar_lengths[pair] = cigar_length;
+    ++(references->num_pairs);
+  }
+  return EXIT_SUCCESS;
+}
+
+void check_references_free(
+    check_references_t* const references) {
+  if (references->map != NULL) munmap(references->map,references->map_length);
+  free(references->scores);
+  free(references->cigars);
+  free(references->cigar_lengths);
+}
+
+/*
+ * Next run of a reference CIGAR (run-length "12M1X", or one operation per
+ * character backwards as formerly written, consecutive runs merged)
+ *   Returns its length, 0 past the end
+ */
+int check_reference_next_run(
+    const char* const cigar,
+    const int cigar_length,
+    int* const idx,
+    char* const op) {
+  const bool run_length = (cigar_length > 0 && cigar[0] >= '0' && cigar[0] <= '9');
+  int length = 0;
+  while (*idx < cigar_length) {
+    int run, next_idx;
+    char run_op;
+    if (run_length) {
+      run = 0;
+      next_idx = *idx;
+      while (next_idx < cigar_length && cigar[next_idx] >= '0' && cigar[next_idx] <= '9') {
+        run = 10*run + (cigar[next_idx++]-'0');
+      }
+      if (next_idx == cigar_length) break;
+      run_op = cigar[next_idx++];
+    }
+    else {
+      run = 1;
+      next_idx = *idx + 1;
+      run_op = cigar[cigar_length-1-*idx];
+    }
+    if (length > 0 && run_op != *op) break;
+    *op = run_op;
+    length += run;
+    *idx = next_idx;
+  }
+  if (length == 0) *idx = cigar_length;
+  return length;
+}
+
+/*
+ * Compare a CIGAR with its reference
+ *   Returns the first different run, -1 if they are equal
+ */
+int check_cigar_compare(
+    const char* const reference,
+    const int reference_length,
+    const char* const cigar,
+    const int cigar_length) {
+  int idx = 0, ref_idx = 0, run = 0;
+  while (true) {
+    char op = 0, ref_op = 0;
+    const int length = edit_cigar_next_run(cigar,cigar_length,&idx,&op);
+    const int ref_length = check_reference_next_run(reference,reference_length,&ref_idx,&ref_op);
+    if (length != ref_length || op != ref_op) return run;
+    if (length == 0) return -1;
+    ++run;
+  }
+}
+
+/*
+ * Replay a CIGAR on its pair (M on equal characters, X on different ones,
+ * I consuming the text only and D the pattern only, spanning both sequences)
+ *   Returns its edit cost, -1 if it is not an alignment of the pair
+ *   (invalid_run is set to its first wrong run, the number of runs if short or long)
+ */
+int check_cigar_replay(
+    const char* const pattern,
+    const int pattern_length,
+    const char* const text,
+    const int text_length,
+    const char* const cigar,
+    const int cigar_length,
+    int* const invalid_run) {
+  int idx = 0, run = 0, length, v = 0, h = 0, cost = 0;
+  char op;
+  *invalid_run = -1;
+  while ((length = edit_cigar_next_run(cigar,cigar_length,&idx,&op)) > 0) {
+    const bool pattern_op = (op != 'I'), text_op = (op != 'D');
+    if ((pattern_op && length > pattern_length-v) || (text_op && length > text_length-h)) {
+      *invalid_run = run;
+      return -1;
+    }
+    int i;
+    for (i=0;(op == 'M' || op == 'X') && i<length;++i) {
+      if ((pattern[v+i] == text[h+i]) != (op == 'M')) {
+        *invalid_run = run;
+        return -1;
+      }
+    }
+    v += pattern_op ? length : 0;
+    h += text_op ? length : 0;
+    cost += (op != 'M') ? length : 0;
+    ++run;
+  }
+  if (v != pattern_length || h != text_length) {
+    *invalid_run = run;
+    return -1;
+  }
+  return cost;
+}
+
+/*
+ * Verify the result of a pair (without CIGAR if score only)
+ *   Heuristic scores (reduction) may be above the reference but not below it,
+ *   their CIGARs are replayed all the same
+ */
+int check_references_verify(
+    const check_references_t* const references,
+    const int pair,
+    const char* const pattern,
+    const int pattern_length,
+    const char* const text,
+    const int text_length,
+    const char* const cigar,
+    const int cigar_length,
+    const int score,
+    const bool heuristic) {
+  if (pair >= references->num_pairs) return CHECK_MISSING;
+  const int score_ref = references->scores[pair];
+  if (!heuristic && score != score_ref) return CHECK_SCORE;
+  // CIGAR (compared with the reference if strict, heuristic ones are always replayed)
+  if (cigar != NULL) {
+    int invalid_run;
+    if (references->strict && !heuristic) {
+      if (check_cigar_compare(references->cigars[pair],references->cigar_lengths[pair],cigar,cigar_length) >= 0) return CHECK_CIGAR;
+    }
+    else if (score == EWF_SCORE_UNALIGNED) {
+      if (cigar_length > 0) return CHECK_CIGAR;
+    }
+    else if (check_cigar_replay(pattern,pattern_length,text,text_length,cigar,cigar_length,&invalid_run) != score) {
+      return CHECK_CIGAR;
+    }
+  }
+  // Heuristic score
+  if (!heuristic || score == score_ref) return CHECK_OK;
+  if (score != EWF_SCORE_UNALIGNED && (score_ref == EWF_SCORE_UNALIGNED || score < score_ref)) return CHECK_BELOW;
+  return CHECK_SUBOPTIMAL;
+}
+
+/*
+ * Print a failed verification
+ */
+void check_references_report(
+    const check_references_t* const references,
+    const int pair,
+    const int status,
+    const char* const pattern,
+    const int pattern_length,
+    const char* const text,
+    const int text_length,
+    const char* const cigar,
+    const int cigar_length,
+    const int score,
+    const bool heuristic) {
+  switch (status) {
+    case CHECK_MISSING:
+      PRINTF_ERROR("Check has failed: pair %d has no reference result\n", pair);
+      break;
+    case CHECK_SCORE:
+      PRINTF_ERROR("Check has failed: pair %d reference score %d != result score %d\n", pair, references->scores[pair], score);
+      break;
+    case CHECK_BELOW:
+      PRINTF_ERROR("Check has failed: pair %d result score %d is below reference score %d\n", pair, score, references->scores[pair]);
+      break;
+    case CHECK_CIGAR: {
+      if (!references->strict || heuristic) {
+        int invalid_run, idx = 0, length = 0, i;
+        char op = '-';
+        const int cost = check_cigar_replay(pattern,pattern_length,text,text_length,cigar,cigar_length,&invalid_run);
+        if (cost >= 0) {
+          PRINTF_ERROR("Check has failed: pair %d result CIGAR cost %d != result score %d\n", pair, cost, score);
+          break;
+        }
+        for (i=0;i<=invalid_run;++i) {
+          length = edit_cigar_next_run(cigar,cigar_length,&idx,&op);
+        }
+        PRINTF_ERROR("Check has failed: pair %d result CIGAR is not an alignment of the pair at run %d (result %d%c)\n",
+            pair, invalid_run, length, (length > 0) ? op : '-');
+        break;
+      }
+      const char* const reference = references->cigars[pair];
+      const int reference_length = references->cigar_lengths[pair];
+      const int run = check_cigar_compare(reference,reference_length,cigar,cigar_length);
+      int idx = 0, ref_idx = 0, length = 0, ref_length = 0, i;
+      char op = '-', ref_op = '-';
+      for (i=0;i<=run;++i) {
+        length = edit_cigar_next_run(cigar,cigar_length,&idx,&op);
+        ref_length = check_reference_next_run(reference,reference_length,&ref_idx,&ref_op);
+      }
+      PRINTF_ERROR("Check has failed: pair %d reference CIGAR != result CIGAR at run %d (reference %d%c, result %d%c)\n",
+          pair, run, ref_length, ref_op, length, op);
+      break;
+    }
+  }
+}
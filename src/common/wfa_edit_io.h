@@ -0,0 +1,196 @@
+/*
+ *  Wavefront Alignments Algorithms
+ *  Copyright (c) 2024 by Diego García Aranda <diego.garcia1@bsc.es>
+ *
+ *  This file is part of Wavefront Alignments Algorithms.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * PROJECT: Wavefront Alignments Algorithms
+ * AUTHOR(S): Diego García Aranda <diego.garcia1@bsc.es>
+ */
+
+/*
+ * Host input and output shared by the programs of every device
+ *   Sequence pairs reader (memory-mapped, read by lines or inflated from gzip),
+ *   result writer (text, PAF or binary, written by a background thread) and
+ *   reference results (CHECK)
+ */
+#ifndef WFA_EDIT_IO_H
+#define WFA_EDIT_IO_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+#define INFLATE_MAX_THREADS 64
+#define CHECK_OK 0
+#define CHECK_SCORE 1 // Different score
+#define CHECK_CIGAR 2 // Same score, CIGAR not an alignment of that score (or different one if strict)
+#define CHECK_SUBOPTIMAL 3 // Heuristic score above the reference (reduction)
+#define CHECK_BELOW 4 // Heuristic score below the reference
+#define CHECK_MISSING 5 // No reference result for the pair
+#define CHECK_STATUSES 6
+#define CHECK_MAX_REPORTED 10 // Failed verifications printed per rep
+
+/*
+ * Sequence pairs reader
+ *   Input format (one pair per two lines):
+ *     >PATTERN
+ *     <TEXT
+ *   Regular files are memory-mapped and pairs are returned as slices of the
+ *   mapping (zero-copy), other files (e.g. pipes) are read by lines, and gzip
+ *   files are read by lines as they are inflated
+ */
+typedef struct {
+  FILE* file;
+  bool compressed;             // Read inflated (file is the stream of the inflater)
+  bool bgzf;
+  int num_threads;             // Inflate threads
+  // Memory-mapped file (NULL if it cannot be mapped)
+  char* map_mem;               // Mapping (a padding page, the file and a zero padding page)
+  size_t map_mem_length;
+  const char* map;             // File contents
+  size_t map_length;
+  size_t map_position;         // Next line
+  size_t map_released;         // File bytes before it are released (whole pages)
+  size_t page_size;
+  // Line buffers (reused across pairs)
+  char* pattern_line;
+  size_t pattern_line_size;
+  char* text_line;
+  size_t text_line_size;
+  // Stats
+  int num_pairs;
+} sequence_reader_t;
+
+int sequence_reader_open(
+    sequence_reader_t* const reader,
+    const char* const filename,
+    const int num_threads);
+void sequence_reader_release(
+    sequence_reader_t* const reader,
+    const size_t position);
+void sequence_reader_rewind(
+    sequence_reader_t* const reader);
+void sequence_reader_close(
+    sequence_reader_t* const reader);
+int sequence_reader_read_pair(
+    sequence_reader_t* const reader,
+    const char** const pattern,
+    int* const pattern_length,
+    const char** const text,
+    int* const text_length);
+
+/*
+ * Result writer
+ *   Results are formatted into a large buffer, handed over to a writer thread
+ *   when it is full (double buffering), so aligning never waits on the file.
+ *   Formats (one record per pair, in input order):
+ *     text   -> score line and run-length CIGAR line (e.g. 12M1X3M, read back by CHECK)
+ *     paf    -> PAF line, the text is the query and the pattern the target
+ *               (I consumes the text only, D the pattern only), NM:i:score and
+ *               cg:Z:CIGAR tags, unaligned pairs have empty ranges
+ *     binary -> "EWF1" header, then int32 score, uint32 CIGAR length and the CIGAR
+ *               runs (little endian, a byte per run: CIGAR_OPS index in the low
+ *               2 bits and length-1 above)
+ */
+typedef enum {
+  RESULT_FORMAT_TEXT,
+  RESULT_FORMAT_PAF,
+  RESULT_FORMAT_BINARY,
+} result_format_t;
+
+typedef struct {
+  FILE* file;
+  result_format_t format;
+  int num_results;
+  // Buffer being filled
+  char* buffer;
+  size_t length;
+  size_t capacity;
+  // Buffer being written (NULL if none) and writer thread
+  char* pending;
+  size_t pending_length;
+  size_t pending_capacity;
+  pthread_t thread;
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;         // A buffer was handed over or written
+  bool stop;
+  bool error;
+} result_writer_t;
+
+int result_writer_open(
+    result_writer_t* const writer,
+    const char* const filename,
+    const result_format_t format);
+int result_writer_write(
+    result_writer_t* const writer,
+    const char* const cigar,
+    const int cigar_length,
+    const int score,
+    const int pattern_length,
+    const int text_length);
+int result_writer_close(
+    result_writer_t* const writer);
+
+/*
+ * Reference results (CHECK file)
+ *   The file is memory-mapped and indexed once (score and CIGAR line of each
+ *   pair), so the results of a batch are verified independently of each other.
+ *   CIGARs are replayed on their pair (any optimal one is valid), or compared
+ *   with the reference if strict
+ */
+typedef struct {
+  bool strict;                 // CIGARs compared byte for byte with the reference
+  char* map;                   // File contents (NULL if empty)
+  size_t map_length;
+  int num_pairs;
+  int* scores;
+  const char** cigars;         // CIGAR line of each pair (without its end of line)
+  int* cigar_lengths;
+} check_references_t;
+
+int check_references_load(
+    check_references_t* const references,
+    const char* const filename,
+    const bool strict);
+void check_references_free(
+    check_references_t* const references);
+int check_references_verify(
+    const check_references_t* const references,
+    const int pair,
+    const char* const pattern,
+    const int pattern_length,
+    const char* const text,
+    const int text_length,
+    const char* const cigar,
+    const int cigar_length,
+    const int score,
+    const bool heuristic);
+void check_references_report(
+    const check_references_t* const references,
+    const int pair,
+    const int status,
+    const char* const pattern,
+    const int pattern_length,
+    const char* const text,
+    const int text_length,
+    const char* const cigar,
+    const int cigar_length,
+    const int score,
+    const bool heuristic);
+
+#endif // WFA_EDIT_IO_H